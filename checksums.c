@@ -16,6 +16,8 @@
 #include <stdlib.h>
 #include <parec.h>
 #include <getopt.h>
+#include <time.h>
+#include <unistd.h>
 
 static const char    *usage = 
 "  -h, --help               Print this help text and exit.\n"
@@ -25,9 +27,35 @@ static const char    *usage =
 "  -e, --exclude PTN        Exclude checking files matching PTN.\n"
 "  -c, --check, --verify    Check the already calculated checksums.\n"
 "  -f, --force              Force re-calculating the checksums.\n"
+"  -j, --jobs N             Process files and directories in N threads.\n"
+"  -b, --buffers N          Read large files ahead into N buffers.\n"
+"  -d, --digest-threads     Calculate each checksum in its own thread.\n"
+"  -t, --tree-threads N     Hash one file by a tree hash (blake3) in N threads.\n"
+"  -B, --multi-buffer       Hash small files together in SIMD lanes (md5, sha1, sha256).\n"
+"  -k, --chunk-size N       Hash files by chunks of N bytes, stored under separate names.\n"
+"  -K, --chunk-store DIR    Keep the chunk digests in DIR and rehash only new chunks.\n"
+"  -i, --io METHOD          Read files by METHOD: stdio (default), uring or mmap.\n"
+"  -m, --mmap-threshold N   Map only the files of at least N bytes.\n"
+"  -C, --cache POLICY       Page cache usage: normal (default), drop or direct.\n"
+"  -x, --xattr-format FMT   Store the checksums separate (default) or packed.\n"
+"  -V, --dir-digest N       Order the directory entries as C strings (1, default)\n"
+"                           or by all bytes (2).\n"
+"  -L, --memory-budget N    Sort the entries of a directory in N bytes, the rest\n"
+"                           in runs through a temporary file.\n"
+"  -I, --index FILE         Store the checksums in the index FILE.\n"
+"  -M, --migrate            Migrate the stored checksums to the xattr format\n"
+"                           or into the index.\n"
+"  -E, --export FILE        Export the checksums into the manifest FILE.\n"
+"  -T, --text               Export a manifest in the format of 'md5sum --tag'.\n"
+"  -R, --import FILE        Import the checksums of the unchanged entries\n"
+"                           from the manifest FILE.\n"
+"  -D, --diff               Compare two processed trees by their checksums.\n"
+"  -P, --progress           Print the progress of the processing to stderr.\n"
+"  -S, --profile            Print the time of each phase and other statistics\n"
+"                           of the processing to stderr.\n"
 "  -w, --wipe, --purge      Purge/wipe checksum attributes.\n";
 
-static const char    *short_options = "hva:p:cfw";
+static const char    *short_options = "hva:p:cfj:b:dt:Bk:K:i:m:C:x:V:L:I:ME:TR:DPSw";
 static struct option long_options[] = {
     {"help",        no_argument,        NULL, 'h'},
     {"verbose",     no_argument,        NULL, 'v'},
@@ -37,6 +65,27 @@ static struct option long_options[] = {
     {"check",       no_argument,        NULL, 'c'},
     {"verify",      no_argument,        NULL, 'c'},
     {"force",       no_argument,        NULL, 'f'},
+    {"jobs",        required_argument,  NULL, 'j'},
+    {"buffers",     required_argument,  NULL, 'b'},
+    {"digest-threads", no_argument,     NULL, 'd'},
+    {"tree-threads", required_argument, NULL, 't'},
+    {"multi-buffer", no_argument,       NULL, 'B'},
+    {"chunk-size",  required_argument,  NULL, 'k'},
+    {"chunk-store", required_argument,  NULL, 'K'},
+    {"io",          required_argument,  NULL, 'i'},
+    {"mmap-threshold", required_argument, NULL, 'm'},
+    {"cache",       required_argument,  NULL, 'C'},
+    {"xattr-format", required_argument, NULL, 'x'},
+    {"dir-digest",  required_argument,  NULL, 'V'},
+    {"memory-budget", required_argument, NULL, 'L'},
+    {"index",       required_argument,  NULL, 'I'},
+    {"migrate",     no_argument,        NULL, 'M'},
+    {"export",      required_argument,  NULL, 'E'},
+    {"text",        no_argument,        NULL, 'T'},
+    {"import",      required_argument,  NULL, 'R'},
+    {"diff",        no_argument,        NULL, 'D'},
+    {"progress",    no_argument,        NULL, 'P'},
+    {"profile",     no_argument,        NULL, 'S'},
     {"wipe",        no_argument,        NULL, 'w'},
     {"purge",       no_argument,        NULL, 'w'},
     { NULL,         no_argument,        NULL, 0}
@@ -45,12 +94,122 @@ static struct option long_options[] = {
 int verbose_flag = 0;
 int default_checksums_flag = 1;
 int purge_flag = 0;
+int migrate_flag = 0;
+const char *export_file = NULL;
+parec_manifest_format export_format = PAREC_MANIFEST_BINARY;
+const char *import_file = NULL;
+int diff_flag = 0;
+int progress_flag = 0;
+int profile_flag = 0;
+
+// the counters of --progress
+typedef struct {
+    long long   entries;
+    long long   files;
+    long long   bytes;
+    long long   skipped;
+    long long   directories;
+    double      start;
+    double      printed;        // the last time of printing
+} progress;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_progress(progress *p, const char *end)
+{
+    double elapsed = now() - p->start;
+
+    fprintf(stderr, "%lld entries, %lld files hashed (%.1f MB, %.1f MB/s), %lld unchanged, %lld directories in %.0fs%s",
+            p->entries, p->files, p->bytes / 1e6, elapsed > 0 ? p->bytes / 1e6 / elapsed : 0.0,
+            p->skipped, p->directories, elapsed, end);
+}
+
+// counting the events for --progress, which are printed twice a second
+static int count_event(const parec_event *event, void *arg)
+{
+    progress *p = arg;
+
+    switch (event->type) {
+        case PAREC_EVENT_START:
+            p->entries++;
+            break;
+        case PAREC_EVENT_FILE:
+            p->files++;
+            p->bytes += event->size;
+            break;
+        case PAREC_EVENT_SKIP:
+            p->skipped++;
+            break;
+        case PAREC_EVENT_DIRECTORY:
+            p->directories++;
+            break;
+        case PAREC_EVENT_ERROR:
+            break;
+    }
+    if (now() - p->printed >= 0.5) {
+        // a terminal keeps a single line
+        print_progress(p, isatty(2) ? "\r" : "\n");
+        p->printed = now();
+    }
+
+    return 0;
+}
+
+// printing the statistics of --profile
+static int print_stats(parec_ctx *ctx)
+{
+    static const char *phases[PAREC_PHASES] = { "open", "directory", "storage", "read", "digest", "sort" };
+    parec_stats *stats;
+    int i;
+
+    if (!(stats = parec_get_stats(ctx)))
+        return -1;
+
+    fprintf(stderr, "%-10s %12s %12s %12s\n", "phase", "calls", "wall (s)", "cpu (s)");
+    for (i = 0; i < PAREC_PHASES; i++) {
+        fprintf(stderr, "%-10s %12llu %12.3f %12.3f\n", phases[i], stats->calls[i], stats->wall_ns[i] / 1e9, stats->cpu_ns[i] / 1e9);
+    }
+    fprintf(stderr, "files hashed: %llu, directories hashed: %llu, entries skipped: %llu\n",
+            stats->files_hashed, stats->directories_hashed, stats->entries_skipped);
+    fprintf(stderr, "xattr calls: %llu get, %llu set, %llu remove\n", stats->xattr_get, stats->xattr_set, stats->xattr_remove);
+    for (i = 0; i < stats->algorithms; i++) {
+        fprintf(stderr, "%s: %llu bytes\n", parec_get_checksum_name(ctx, i), stats->bytes[i]);
+    }
+    fprintf(stderr, "latency of the files:\n");
+    for (i = 0; i < PAREC_STATS_BUCKETS; i++) {
+        if (!stats->latency[i])
+            continue;
+        if (i == PAREC_STATS_BUCKETS - 1)
+            fprintf(stderr, "  >= %10lluus %12llu\n", 1ULL << (i - 1), stats->latency[i]);
+        else
+            fprintf(stderr, "  <  %10lluus %12llu\n", 1ULL << i, stats->latency[i]);
+    }
+    free(stats);
+
+    return 0;
+}
+
+// printing a difference found by --diff
+static void print_difference(const char *path, parec_diff_type type, void *arg)
+{
+    int *differences = arg;
+
+    printf("%c %s\n", "+-*?"[type], path);
+    (*differences)++;
+}
 
 int main(int argc, char *argv[]) {
     int c;
     int options_index = 0;
     parec_ctx *ctx;
     char *prog_name;
+    progress counters;
 
     // determine the program name
     prog_name = strrchr(argv[0], '/');
@@ -103,6 +262,161 @@ int main(int argc, char *argv[]) {
                     return 1;
                 }
                 break;
+            case 'j':
+                if (parec_set_threads(ctx, atoi(optarg))) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 'b':
+                if (parec_set_pipeline(ctx, atoi(optarg))) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 'd':
+                if (parec_set_parallel_digests(ctx, 1)) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 't':
+                if (parec_set_tree_threads(ctx, atoi(optarg))) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 'B':
+                if (parec_set_multi_buffer(ctx, 1)) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 'k':
+                if (parec_set_chunk_size(ctx, atoll(optarg))) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 'K':
+                if (parec_set_chunk_store(ctx, optarg)) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 'i':
+                if (!strcmp(optarg, "stdio")) {
+                    c = parec_set_io_method(ctx, PAREC_IO_STDIO);
+                }
+                else if (!strcmp(optarg, "uring")) {
+                    c = parec_set_io_method(ctx, PAREC_IO_URING);
+                }
+                else if (!strcmp(optarg, "mmap")) {
+                    c = parec_set_io_method(ctx, PAREC_IO_MMAP);
+                }
+                else {
+                    fprintf(stderr, "ERROR: unknown I/O method: %s\n", optarg);
+                    return 1;
+                }
+                if (c) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 'm':
+                if (parec_set_mmap_threshold(ctx, atoll(optarg))) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 'C':
+                if (!strcmp(optarg, "normal")) {
+                    c = parec_set_cache_policy(ctx, PAREC_CACHE_NORMAL);
+                }
+                else if (!strcmp(optarg, "drop")) {
+                    c = parec_set_cache_policy(ctx, PAREC_CACHE_DROP_BEHIND);
+                }
+                else if (!strcmp(optarg, "direct")) {
+                    c = parec_set_cache_policy(ctx, PAREC_CACHE_DIRECT);
+                }
+                else {
+                    fprintf(stderr, "ERROR: unknown cache policy: %s\n", optarg);
+                    return 1;
+                }
+                if (c) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 'x':
+                if (!strcmp(optarg, "separate")) {
+                    c = parec_set_xattr_format(ctx, PAREC_XATTR_SEPARATE);
+                }
+                else if (!strcmp(optarg, "packed")) {
+                    c = parec_set_xattr_format(ctx, PAREC_XATTR_PACKED);
+                }
+                else {
+                    fprintf(stderr, "ERROR: unknown xattr format: %s\n", optarg);
+                    return 1;
+                }
+                if (c) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 'V':
+                if (!strcmp(optarg, "1")) {
+                    c = parec_set_dir_digest(ctx, PAREC_DIR_DIGEST_V1);
+                }
+                else if (!strcmp(optarg, "2")) {
+                    c = parec_set_dir_digest(ctx, PAREC_DIR_DIGEST_V2);
+                }
+                else {
+                    fprintf(stderr, "ERROR: unknown directory digest version: %s\n", optarg);
+                    return 1;
+                }
+                if (c) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 'L':
+                if (parec_set_memory_budget(ctx, atoll(optarg))) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 'I':
+                if (parec_set_index_file(ctx, optarg) || parec_set_storage(ctx, PAREC_STORAGE_INDEX)) {
+                    fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                    return 1;
+                }
+                break;
+            case 'M':
+                migrate_flag = 1;
+                verbose_flag = 0;
+                break;
+            case 'E':
+                // the manifest may be written to the standard output
+                export_file = strcmp(optarg, "-") ? optarg : "/dev/stdout";
+                break;
+            case 'T':
+                export_format = PAREC_MANIFEST_TEXT;
+                break;
+            case 'R':
+                import_file = optarg;
+                verbose_flag = 0;
+                break;
+            case 'D':
+                diff_flag = 1;
+                verbose_flag = 0;
+                break;
+            case 'P':
+                progress_flag = 1;
+                break;
+            case 'S':
+                profile_flag = 1;
+                break;
             case 'w':
                 purge_flag = 1;
                 verbose_flag = 0;
@@ -126,6 +440,41 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // like diff(1), the exit code is 1, if the trees differ
+    if (diff_flag) {
+        int differences = 0;
+
+        if (argc != 2) {
+            fprintf(stderr, "ERROR: two FILE/DIRECTORY arguments are expected\n");
+            return 2;
+        }
+        if (parec_diff(ctx, argv[0], argv[1], print_difference, &differences)) {
+            fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+            return 2;
+        }
+        parec_free(ctx);
+        return differences ? 1 : 0;
+    }
+
+    // the paths of a manifest are relative to a single root
+    if (export_file && argc > 1) {
+        fprintf(stderr, "ERROR: only one FILE/DIRECTORY can be exported\n");
+        return 1;
+    }
+
+    if (profile_flag && parec_set_profile(ctx, 1)) {
+        fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+        return 1;
+    }
+    if (progress_flag) {
+        memset(&counters, 0, sizeof(counters));
+        counters.start = counters.printed = now();
+        if (parec_set_event_callback(ctx, count_event, &counters)) {
+            fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+            return 1;
+        }
+    }
+
     for (int i = 0; i < argc; i++) {
         if (purge_flag) {
             if (parec_purge(ctx, argv[i])) {
@@ -133,8 +482,23 @@ int main(int argc, char *argv[]) {
                 return 1;
             }
         }
+        else if (migrate_flag) {
+            if (parec_migrate(ctx, argv[i])) {
+                fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                return 1;
+            }
+        }
+        else if (import_file) {
+            if (parec_import(ctx, argv[i], import_file)) {
+                fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                return 1;
+            }
+        }
         else {
-            if (parec_process(ctx, argv[i])) {
+            c = parec_process(ctx, argv[i]);
+            if (progress_flag)
+                print_progress(&counters, "\n");
+            if (c) {
                 fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
                 return 1;
             }
@@ -151,6 +515,17 @@ int main(int argc, char *argv[]) {
                 }
             }
         }
+        if (export_file) {
+            if (parec_export(ctx, argv[i], export_file, export_format)) {
+                fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+                return 1;
+            }
+        }
+    }
+
+    if (profile_flag && print_stats(ctx)) {
+        fprintf(stderr, "ERROR: %s\n", parec_get_error(ctx));
+        return 1;
     }
 
     parec_free(ctx);
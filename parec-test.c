@@ -18,6 +18,7 @@ int main(int argc __attribute__((__unused__)), char *argv[] __attribute__((__unu
     parec_ctx   *ctx;
     int  c;
     const char *s;
+    parec_stats *stats;
 
     printf("test %02d: creating context -- ", testcount++);
     if((ctx = parec_new()) == NULL) {
@@ -97,6 +98,205 @@ int main(int argc __attribute__((__unused__)), char *argv[] __attribute__((__unu
     }
     printf("OK\n");
 
+    TEST_PRINT("set_threads(4)")
+    TEST_ZERO(parec_set_threads(ctx, 4))
+
+    TEST_PRINT("get_threads()")
+    if((c = parec_get_threads(ctx)) < 0 || c != 4) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_threads(-1)")
+    if(!parec_set_threads(ctx, -1)) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_pipeline(4)")
+    TEST_ZERO(parec_set_pipeline(ctx, 4))
+
+    TEST_PRINT("get_pipeline()")
+    if((c = parec_get_pipeline(ctx)) < 0 || c != 4) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_parallel_digests(1)")
+    TEST_ZERO(parec_set_parallel_digests(ctx, 1))
+
+    TEST_PRINT("get_parallel_digests()")
+    if((c = parec_get_parallel_digests(ctx)) < 0 || c != 1) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_tree_threads(2)")
+    TEST_ZERO(parec_set_tree_threads(ctx, 2))
+
+    TEST_PRINT("get_tree_threads()")
+    if((c = parec_get_tree_threads(ctx)) < 0 || c != 2) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_multi_buffer(1)")
+    TEST_ZERO(parec_set_multi_buffer(ctx, 1))
+
+    TEST_PRINT("get_multi_buffer()")
+    if((c = parec_get_multi_buffer(ctx)) < 0 || c != 1) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_chunk_size(4096)")
+    TEST_ZERO(parec_set_chunk_size(ctx, 4096))
+
+    TEST_PRINT("get_chunk_size()")
+    if(parec_get_chunk_size(ctx) != 4096) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("get_xattr_name(0) chunked")
+    if(!(s = parec_get_xattr_name(ctx, 0)) || strcmp(s, "user.localhost.md5.chunked-4K")) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_chunk_size(1000)")
+    if(!parec_set_chunk_size(ctx, 1000)) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_chunk_size(0)")
+    TEST_ZERO(parec_set_chunk_size(ctx, 0))
+
+    TEST_PRINT("set_chunk_store(chunks)")
+    TEST_ZERO(parec_set_chunk_store(ctx, "chunks"))
+
+    TEST_PRINT("get_chunk_store()")
+    if(!(s = parec_get_chunk_store(ctx)) || strcmp(s, "chunks")) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_io_method(URING)")
+    TEST_ZERO(parec_set_io_method(ctx, PAREC_IO_URING))
+
+    TEST_PRINT("get_io_method()")
+    if((c = parec_get_io_method(ctx)) < 0 || c != PAREC_IO_URING) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_mmap_threshold(4096)")
+    TEST_ZERO(parec_set_mmap_threshold(ctx, 4096))
+
+    TEST_PRINT("get_mmap_threshold()")
+    if(parec_get_mmap_threshold(ctx) != 4096) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_cache_policy(DIRECT)")
+    TEST_ZERO(parec_set_cache_policy(ctx, PAREC_CACHE_DIRECT))
+
+    TEST_PRINT("get_cache_policy()")
+    if((c = parec_get_cache_policy(ctx)) < 0 || c != PAREC_CACHE_DIRECT) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_xattr_format(PACKED)")
+    TEST_ZERO(parec_set_xattr_format(ctx, PAREC_XATTR_PACKED))
+
+    TEST_PRINT("get_xattr_format()")
+    if((c = parec_get_xattr_format(ctx)) < 0 || c != PAREC_XATTR_PACKED) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_dir_digest(V2)")
+    TEST_ZERO(parec_set_dir_digest(ctx, PAREC_DIR_DIGEST_V2))
+
+    TEST_PRINT("get_dir_digest()")
+    if((c = parec_get_dir_digest(ctx)) < 0 || c != PAREC_DIR_DIGEST_V2) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_memory_budget(1048576)")
+    TEST_ZERO(parec_set_memory_budget(ctx, 1048576))
+
+    TEST_PRINT("get_memory_budget()")
+    if(parec_get_memory_budget(ctx) != 1048576) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_memory_budget(-1)")
+    if(!parec_set_memory_budget(ctx, -1)) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_profile(1)")
+    TEST_ZERO(parec_set_profile(ctx, 1))
+
+    TEST_PRINT("get_profile()")
+    if((c = parec_get_profile(ctx)) < 0 || c != 1) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("get_stats()")
+    if(!(stats = parec_get_stats(ctx)) || stats->algorithms != 2 || stats->files_hashed || stats->bytes[1]) {
+        printf("FAILED\n");
+        return -1;
+    }
+    free(stats);
+    printf("OK\n");
+
+    TEST_PRINT("set_index_file(parec.idx)")
+    TEST_ZERO(parec_set_index_file(ctx, "parec.idx"))
+
+    TEST_PRINT("get_index_file()")
+    if(!(s = parec_get_index_file(ctx)) || strcmp(s, "parec.idx")) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    TEST_PRINT("set_storage(INDEX)")
+    TEST_ZERO(parec_set_storage(ctx, PAREC_STORAGE_INDEX))
+
+    TEST_PRINT("get_storage()")
+    if((c = parec_get_storage(ctx)) < 0 || c != PAREC_STORAGE_INDEX) {
+        printf("FAILED\n");
+        return -1;
+    }
+    printf("OK\n");
+
     TEST_PRINT("free")
     parec_free(ctx);
     printf("OK\n");
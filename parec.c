@@ -13,9 +13,13 @@
 
 #include <stdarg.h>
 #define _GNU_SOURCE
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include <errno.h>
+#include <ctype.h>
 #include <openssl/evp.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -24,37 +28,164 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <fnmatch.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
 
 #include <parec.h>
 #include <parec_log4c.h>
+#include <parec_pool.h>
+#include <parec_ring.h>
+#include <parec_uring.h>
+#include <parec_index.h>
+#include <parec_blake3.h>
+#include <parec_xxh3.h>
+#include <parec_crc32c.h>
+#include <parec_mb.h>
+
+typedef struct _parec_worker parec_worker;
+typedef struct _parec_dir parec_dir;
+typedef struct _parec_chunk_team parec_chunk_team;
+typedef struct _parec_counters parec_counters;
+
+// the fingerprint of an entry, which is stored with its checksums
+typedef struct {
+    int                         layout;         // PAREC_XATTR_*, STORED_INDEX or -1, if nothing is stored
+    time_t                      mtime;
+    long                        mtime_nsec;     // -1, if it is not known
+    off_t                       size;           // -1, if it is not known
+    long long                   clock;          // of the start of the processing in nanoseconds, only for the events
+} parec_stamp;
+
+// an entry of the walk, which is reached relative to its directory
+typedef struct _parec_entry {
+    int                         dirfd;          // the directory or AT_FDCWD
+    const char                  *dname;         // name relative to dirfd
+    const char                  *name;          // full name for the messages
+    int                         fd;             // the opened entry or -1
+    unsigned char               type;           // d_type of the entry or DT_UNKNOWN
+    dev_t                       dev;            // device of the opened entry
+    ino_t                       ino;            // inode of the opened entry
+    const struct _parec_entry   *parent;        // the directory of the entry, NULL for the root
+} parec_entry;
+
+// the operations of a storage of the checksums (see parec_storage)
+typedef struct {
+    int (*stored)(parec_ctx *ctx, const parec_entry *e, const parec_stamp *actual, parec_stamp *stored, unsigned char **digest);
+    int (*store)(parec_ctx *ctx, const parec_entry *e, const parec_stamp *stamp, const parec_stamp *stored, unsigned char **digest);
+    int (*purge)(parec_ctx *ctx, const parec_entry *e);
+} parec_backend;
+
+// an algorithm implemented by parec itself, next to the ones of OpenSSL
+typedef struct {
+    const char                  *name;
+    unsigned int                dlen;
+    void *(*create)(parec_ctx *ctx);
+    void (*destroy)(void *md);
+    void (*init)(void *md);
+    void (*update)(void *md, const void *data, size_t len);
+    void (*final)(void *md, unsigned char *digest);
+} parec_native;
+
+// the digest context of an algorithm: OpenSSL or native
+typedef union {
+    EVP_MD_CTX                  *evp;
+    void                        *native;
+} parec_md;
 
 struct _parec_ctx {
     int                         algorithms;    // number of algorithms
     int                         alg_len;       // allocation length of the alg arrays
     char                        **algorithm;
     const EVP_MD                **evp_algorithm;
+    const parec_native          **native_algorithm; // NULL for the OpenSSL ones
     int                         evp_initialized;
+    unsigned int                *dlen;         // digest length of each algorithm
+    int                         *mb_algorithm; // of the multi-buffer engine, -1 if not supported
+    int                         mb_algorithms; // number of algorithms of the multi-buffer engine
     char                        **exclude;     // exclude patterns
     int                         excludes;      // number of exclude patterns
     int                         excl_len;      // allocation length of the exclude array
     char                        *xattr_prefix;
     char                        *xattr_mtime;
+    char                        *xattr_record; // name of the packed record
     char                        **xattr_algorithm;
+    parec_xattr_format          xattr_format;  // layout of the stored checksums
+    parec_dir_digest            dir_digest;    // ordering of the entry checksums of a directory
+    long long                   memory_budget; // of the entry checksums of a directory, 0 if unlimited
+    parec_storage               storage;       // storage of the checksums
+    const parec_backend         *backend;      // operations of the storage
+    char                        *index_file;
+    parec_index                 *index;        // opened at the first use
     parec_method                method;
     char                        *error_message;
+    int                         threads;       // number of worker threads
+    parec_pool                  *pool;         // started at the first parallel processing
+    pthread_mutex_t             lock;          // protects the error message
+    parec_event_callback        event;         // NULL, if the events are disabled
+    void                        *event_arg;
+    pthread_mutex_t             event_lock;    // the callback is called by one thread at a time
+    int                         event_failed;  // the error of the processing is already reported
+    unsigned long               profile;       // generation of the profiling, 0 if it is disabled
+    parec_counters              *counters;     // of the threads since the profiling is enabled
+    int                         pipeline;      // number of read-ahead buffers
+    int                         parallel_digests; // one thread for each algorithm
+    int                         tree_threads;  // threads hashing one file by a tree hash
+    int                         multi_buffer;  // small files are digested together in SIMD lanes
+    parec_blake3_team           *team;         // the threads of the tree hashes
+    long long                   chunk_size;    // of the chunked file digests, 0 if disabled
+    parec_chunk_team            *chunk_team;   // the threads of the chunks of a file
+    char                        *chunk_store;  // directory of the chunk lists, NULL if they are not kept
+    parec_io_method             io;            // reading method of the files
+    int                         use_uring;     // io_uring is available
+    long long                   mmap_threshold; // smallest file to be mapped
+    parec_cache_policy          cache;         // page cache usage of the reads
+    parec_worker                *worker;       // resources of each worker and the caller
+    int                         workers;       // number of the workers and the caller
 };
 
 /* Buffer length for file operations. */
 static const unsigned int BUFLEN = 1024 * 1024;
+/* Number of buffers for the parallel digests, if pipelining is not set. */
+static const int PIPELINE_LEN = 4;
+/* Number of reads in flight with io_uring, if pipelining is not set. */
+static const int URING_DEPTH = 8;
+/* Buffer length for reading the directories. */
+static const unsigned int DIR_BUFLEN = 256 * 1024;
+/* Size of the mapped window of a file, a multiple of the page size. */
+static const size_t MMAP_WINDOW = 64 * 1024 * 1024;
+/* Alignment of the offsets, lengths and buffers for direct I/O. */
+static const size_t DIRECT_ALIGN = 4096;
+/* Number of small files digested together by the multi-buffer engine. */
+static const int MB_BATCH = 64;
+/* Largest file digested by the multi-buffer engine, since a large file
+ * would keep the other lanes idle. */
+static const off_t MB_FILE_MAX = 64 * 1024;
+/* Largest file read by a single system call, without the advices and
+ * the direct I/O of the large files. */
+static const off_t SMALL_FILE_MAX = 64 * 1024;
 static const unsigned int ERRLEN = 300;
-static const unsigned int PATHLEN = 1024;
 static const unsigned int XATTR_NAME_LEN = 230; // with overhead for 'user.' and alg.name
 static const char DEFAULT_XATTR_PREFIX[] = "user.";
 static const char MTIME_XATTR_NAME[] = "mtime";
+static const char RECORD_XATTR_NAME[] = "parec";
+/* Version, maximum length and header length of the packed record. */
+static const unsigned char RECORD_VERSION = 1;
+static const size_t RECORD_LEN = 4096;
+static const size_t RECORD_HEADER = 24;
+/* Layout of the checksums stored in the index, next to PAREC_XATTR_*. */
+static const int STORED_INDEX = 2;
 
 static void _parec_set_error(parec_ctx *ctx, char *fmt, ...)
 {
     va_list ap;
+
+    // the workers of a parallel processing may fail at the same time
+    pthread_mutex_lock(&ctx->lock);
     if (ctx->error_message)
         free(ctx->error_message);
         
@@ -62,6 +193,7 @@ static void _parec_set_error(parec_ctx *ctx, char *fmt, ...)
     ctx->error_message = calloc(sizeof(*(ctx->error_message)), ERRLEN);
     vsnprintf(ctx->error_message, ERRLEN, fmt, ap);
     va_end(ap);
+    pthread_mutex_unlock(&ctx->lock);
 }
 
 #define PAREC_ERROR(ctx, fmt, ...)  _parec_set_error(ctx, fmt,##__VA_ARGS__); \
@@ -77,6 +209,18 @@ static const char *_parec_hex(char *hex, const unsigned char *digest, int len) {
     return hex;
 }
 
+static void _parec_workers_stop(parec_ctx *ctx);
+static int _parec_workers_start(parec_ctx *ctx);
+static parec_chunk_team *_parec_chunk_team_new(parec_ctx *ctx, int threads);
+static void _parec_chunk_team_free(parec_ctx *ctx, parec_chunk_team *team);
+static parec_dir *_parec_dir_open(parec_ctx *ctx, int worker, const parec_entry *e);
+static struct dirent64 *_parec_dir_read(parec_ctx *ctx, parec_dir *dir, int *rc);
+static void _parec_dir_close(parec_ctx *ctx, int worker, parec_dir *dir);
+static int _parec_storage_start(parec_ctx *ctx);
+static void _parec_storage_stop(parec_ctx *ctx);
+static int _parec_stored_digest(parec_ctx *ctx, int idx, const char *name, unsigned char *digest);
+static void _parec_counters_free(parec_ctx *ctx);
+
 const char *parec_get_error(parec_ctx *ctx)
 {
     if (!ctx)
@@ -95,6 +239,8 @@ parec_ctx *parec_new()
     ctx = calloc(sizeof(*ctx), 1);
     if (!ctx)
         return NULL;
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_mutex_init(&ctx->event_lock, NULL);
     
     // setting defaults and initializing structures
     ctx->algorithms = 0;
@@ -114,6 +260,11 @@ parec_ctx *parec_new()
         PAREC_ERROR(ctx, "parec: out of memory");
         return ctx;
     }
+    ctx->native_algorithm = calloc(sizeof(*(ctx->native_algorithm)), ctx->alg_len);
+    if (!ctx->native_algorithm) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return ctx;
+    }
     ctx->evp_initialized = 0;
 
     ctx->excludes = 0;
@@ -133,6 +284,16 @@ parec_ctx *parec_new()
         parec_free(ctx);
         return NULL;
     }
+
+    if (parec_set_threads(ctx, 1)) {
+        parec_free(ctx);
+        return NULL;
+    }
+
+    if (parec_set_mmap_threshold(ctx, BUFLEN)) {
+        parec_free(ctx);
+        return NULL;
+    }
     
     return ctx;
 }
@@ -149,9 +310,16 @@ void parec_free(parec_ctx *ctx)
             //free(ctx->evp_algorithm[a]);
         free(ctx->xattr_algorithm[a]);
     }
+    // the pooled digest contexts are released by the workers
+    parec_pool_free(ctx->pool);
+    _parec_workers_stop(ctx);
+
     free(ctx->algorithm);
     free(ctx->evp_algorithm);
+    free(ctx->native_algorithm);
     free(ctx->xattr_algorithm);
+    free(ctx->dlen);
+    free(ctx->mb_algorithm);
 
     for (int e = 0; e < ctx->excludes; e++) {
         free(ctx->exclude[e]);
@@ -160,13 +328,123 @@ void parec_free(parec_ctx *ctx)
 
     free(ctx->xattr_prefix);
     free(ctx->xattr_mtime);
+    free(ctx->xattr_record);
+    _parec_storage_stop(ctx);
+    free(ctx->index_file);
+    free(ctx->chunk_store);
     
     if (ctx->error_message) 
         free(ctx->error_message);
+    pthread_mutex_destroy(&ctx->lock);
+    pthread_mutex_destroy(&ctx->event_lock);
+    _parec_counters_free(ctx);
 
     free(ctx);
 }
 
+/* Native algorithms
+ *
+ * The algorithms, which are not provided by OpenSSL, are implemented by
+ * parec itself. They are looked up by their names before the OpenSSL
+ * digests, and they are used through the same digest contexts.
+ */
+
+static void *_parec_blake3_create(parec_ctx *ctx)
+{
+    return parec_blake3_new(ctx->team);
+}
+
+static void _parec_blake3_destroy(void *md)
+{
+    parec_blake3_free(md);
+}
+
+static void _parec_blake3_init(void *md)
+{
+    parec_blake3_init(md);
+}
+
+static void _parec_blake3_update(void *md, const void *data, size_t len)
+{
+    parec_blake3_update(md, data, len);
+}
+
+static void _parec_blake3_final(void *md, unsigned char *digest)
+{
+    parec_blake3_final(md, digest);
+}
+
+static void *_parec_xxh3_create(parec_ctx *ctx __attribute__((__unused__)))
+{
+    return parec_xxh3_new();
+}
+
+static void _parec_xxh3_destroy(void *md)
+{
+    parec_xxh3_free(md);
+}
+
+static void _parec_xxh3_init(void *md)
+{
+    parec_xxh3_init(md);
+}
+
+static void _parec_xxh3_update(void *md, const void *data, size_t len)
+{
+    parec_xxh3_update(md, data, len);
+}
+
+static void _parec_xxh3_final(void *md, unsigned char *digest)
+{
+    parec_xxh3_final(md, digest);
+}
+
+// the context of CRC-32C is the checksum itself
+static void *_parec_crc32c_create(parec_ctx *ctx __attribute__((__unused__)))
+{
+    return calloc(1, sizeof(uint32_t));
+}
+
+static void _parec_crc32c_destroy(void *md)
+{
+    free(md);
+}
+
+static void _parec_crc32c_init(void *md)
+{
+    *(uint32_t *)md = 0;
+}
+
+static void _parec_crc32c_update(void *md, const void *data, size_t len)
+{
+    *(uint32_t *)md = parec_crc32c(*(uint32_t *)md, data, len);
+}
+
+static void _parec_crc32c_final(void *md, unsigned char *digest)
+{
+    uint32_t crc = *(uint32_t *)md;
+
+    digest[0] = crc >> 24;
+    digest[1] = crc >> 16;
+    digest[2] = crc >> 8;
+    digest[3] = crc;
+}
+
+static const parec_native NATIVE_ALGORITHMS[] = {
+    { "blake3", PAREC_BLAKE3_LEN, _parec_blake3_create, _parec_blake3_destroy, _parec_blake3_init, _parec_blake3_update, _parec_blake3_final },
+    { "xxh3-128", PAREC_XXH3_LEN, _parec_xxh3_create, _parec_xxh3_destroy, _parec_xxh3_init, _parec_xxh3_update, _parec_xxh3_final },
+    { "crc32c", PAREC_CRC32C_LEN, _parec_crc32c_create, _parec_crc32c_destroy, _parec_crc32c_init, _parec_crc32c_update, _parec_crc32c_final },
+};
+
+static const parec_native *_parec_native(const char *name)
+{
+    for (size_t n = 0; n < sizeof(NATIVE_ALGORITHMS) / sizeof(NATIVE_ALGORITHMS[0]); n++) {
+        if (!strcmp(NATIVE_ALGORITHMS[n].name, name))
+            return &NATIVE_ALGORITHMS[n];
+    }
+    return NULL;
+}
+
 static int parec_init_evp(parec_ctx *ctx) 
 {
     PAREC_CHECK_CONTEXT(ctx)
@@ -174,12 +452,30 @@ static int parec_init_evp(parec_ctx *ctx)
     if (ctx->evp_initialized)
         return 0;
 
+    if (!ctx->dlen && !(ctx->dlen = calloc(sizeof(*(ctx->dlen)), ctx->algorithms ? ctx->algorithms : 1))) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return -1;
+    }
+    if (!ctx->mb_algorithm && !(ctx->mb_algorithm = calloc(sizeof(*(ctx->mb_algorithm)), ctx->algorithms ? ctx->algorithms : 1))) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return -1;
+    }
+
     OpenSSL_add_all_digests();
+    ctx->mb_algorithms = 0;
     for (int a = 0; a < ctx->algorithms; a++) {
+        if ((ctx->mb_algorithm[a] = parec_mb_find(ctx->algorithm[a])) >= 0)
+            ctx->mb_algorithms++;
+        if ((ctx->native_algorithm[a] = _parec_native(ctx->algorithm[a]))) {
+            ctx->dlen[a] = ctx->native_algorithm[a]->dlen;
+            parec_log4c_DEBUG("Native digest %s is initialized", ctx->algorithm[a]);
+            continue;
+        }
         if (!(ctx->evp_algorithm[a] = EVP_get_digestbyname(ctx->algorithm[a]))) {
             PAREC_ERROR(ctx, "Could not load digest: %s", ctx->algorithm[a]);
             return -1;
         }
+        ctx->dlen[a] = EVP_MD_size(ctx->evp_algorithm[a]);
         parec_log4c_DEBUG("OpenSSL digest %s is initialized", ctx->algorithm[a]);
     }
  
@@ -203,6 +499,35 @@ static char *_parec_xattr_name(parec_ctx *ctx, const char *name)
     return x_name;
 }
 
+// the name of the extended attribute of an algorithm, which has the chunk
+// size as well, like 'user.md5.chunked-4M', since the chunked digests
+// differ from the plain ones
+static char *_parec_xattr_algorithm(parec_ctx *ctx, const char *alg)
+{
+    char name[strlen(alg) + 32];
+    long long size = ctx->chunk_size;
+    const char *unit = "KMGT";
+
+    if (!size)
+        return _parec_xattr_name(ctx, alg);
+
+    // the largest unit, which divides the size
+    size /= 1024;
+    while (unit[1] && size % 1024 == 0) {
+        size /= 1024;
+        unit++;
+    }
+    snprintf(name, sizeof(name), "%s.chunked-%lld%c", alg, size, *unit);
+    return _parec_xattr_name(ctx, name);
+}
+
+// the name of an algorithm in the packed records and the manifests,
+// which is the name of its extended attribute without the prefix
+static const char *_parec_stored_name(parec_ctx *ctx, int a)
+{
+    return ctx->xattr_algorithm[a] + strlen(ctx->xattr_prefix);
+}
+
 int parec_add_checksum(parec_ctx *ctx, const char *alg)
 {
     PAREC_CHECK_CONTEXT(ctx)
@@ -230,6 +555,16 @@ int parec_add_checksum(parec_ctx *ctx, const char *alg)
             PAREC_ERROR(ctx, "parec: out of memory");
             return -1;
         }
+        ctx->evp_algorithm = realloc(ctx->evp_algorithm, sizeof(*(ctx->evp_algorithm)) * ctx->alg_len);
+        if (!ctx->evp_algorithm) {
+            PAREC_ERROR(ctx, "parec: out of memory");
+            return -1;
+        }
+        ctx->native_algorithm = realloc(ctx->native_algorithm, sizeof(*(ctx->native_algorithm)) * ctx->alg_len);
+        if (!ctx->native_algorithm) {
+            PAREC_ERROR(ctx, "parec: out of memory");
+            return -1;
+        }
     }
 
     // actually adding the algorithm name
@@ -239,7 +574,7 @@ int parec_add_checksum(parec_ctx *ctx, const char *alg)
             PAREC_ERROR(ctx, "parec: out of memory");
             return -1;
         }
-        ctx->xattr_algorithm[ctx->algorithms] = _parec_xattr_name(ctx, alg);
+        ctx->xattr_algorithm[ctx->algorithms] = _parec_xattr_algorithm(ctx, alg);
         if (!(ctx->xattr_algorithm[ctx->algorithms])) {
             PAREC_ERROR(ctx, "parec: out of memory");
             return -1;
@@ -297,10 +632,10 @@ char *parec_get_xattr_value(parec_ctx *ctx, int idx, const char *name)
         return NULL;
     }
 
-    if ((dlen = getxattr(name, ctx->xattr_algorithm[idx], digest, EVP_MAX_MD_SIZE)) < 0 && (errno != ENODATA)) {
-        PAREC_ERROR(ctx, "parec: fetching attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_algorithm[idx], name, strerror(errno), errno);
+    if (parec_init_evp(ctx) || _parec_storage_start(ctx))
+        return NULL;
+    if ((dlen = _parec_stored_digest(ctx, idx, name, digest)) < 0)
         return NULL;
-    }
 
     hex_digest = calloc(sizeof(*hex_digest), dlen * 2 + 1);
     if (!hex_digest) {
@@ -311,7 +646,7 @@ char *parec_get_xattr_value(parec_ctx *ctx, int idx, const char *name)
     for (int d = 0; d < dlen; d++) {
         sprintf(&hex_digest[d * 2], "%02x", digest[d]);
     }
-    hex_digest[dlen * 2 + 1] = '\0';
+    hex_digest[dlen * 2] = '\0';
 
     return hex_digest;
 }
@@ -379,6 +714,7 @@ int parec_set_xattr_prefix(parec_ctx *ctx, const char *prefix)
     }
     free(ctx->xattr_prefix);
     free(ctx->xattr_mtime);
+    free(ctx->xattr_record);
 
     // if not specified, use the default
     if (!prefix) 
@@ -422,7 +758,7 @@ int parec_set_xattr_prefix(parec_ctx *ctx, const char *prefix)
 
     // setting derived attributes
     for (int a = 0; a < ctx->algorithms; a++) {
-        ctx->xattr_algorithm[a] = _parec_xattr_name(ctx, ctx->algorithm[a]);
+        ctx->xattr_algorithm[a] = _parec_xattr_algorithm(ctx, ctx->algorithm[a]);
         if (!(ctx->xattr_algorithm[a])) {
             PAREC_ERROR(ctx, "parec: out of memory");
             return -1;
@@ -433,6 +769,11 @@ int parec_set_xattr_prefix(parec_ctx *ctx, const char *prefix)
         PAREC_ERROR(ctx, "parec: out of memory");
         return -1;
     }
+    ctx->xattr_record = _parec_xattr_name(ctx, RECORD_XATTR_NAME);
+    if (!ctx->xattr_record) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return -1;
+    }
 
     return 0;
 }
@@ -448,314 +789,4061 @@ int parec_set_method(parec_ctx *ctx, parec_method method)
     return 0;
 }
 
-// filterint the directory entries
-static int _parec_filter(parec_ctx *ctx, const char *dname) 
+int parec_set_threads(parec_ctx *ctx, int threads)
 {
-    // skip '.' and '..'
-    if ((dname[0] == '.') 
-        && (dname[1] == '\0' 
-            || (dname[1] == '.' && dname[2] == '\0')))
-        return -1;
+    PAREC_CHECK_CONTEXT(ctx)
 
-    // skip also the ones matching any of the glob patterns
-    for (int e = 0; e < ctx->excludes; e++) {
-        if (!fnmatch(ctx->exclude[e], dname, 0)) {
-            parec_log4c_DEBUG("skipping '%s' because of pattern '%s'", dname, ctx->exclude[e]);
-            return -1;
-        }
-        // note that fnmatch(3) may also return a non-zero value
-        // to indicate an error, however we just skip that here
+    if (threads < 0) {
+        PAREC_ERROR(ctx, "parec: invalid number of threads: %d", threads);
+        return -1;
     }
+
+    parec_log4c_DEBUG("Setting number of threads to %d", threads);
+
+    // the pool and the workers are started with the new size at the next processing
+    parec_pool_free(ctx->pool);
+    ctx->pool = NULL;
+    _parec_workers_stop(ctx);
+    ctx->threads = threads;
+
     return 0;
 }
 
+int parec_get_threads(parec_ctx *ctx)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    return ctx->threads;
+}
 
-/* Purging extended attributes */
-static int _parec_purge(parec_ctx *ctx, const char *name)
+int parec_set_pipeline(parec_ctx *ctx, int buffers)
 {
-    int rc;
-    for (int a = 0; a < ctx->algorithms; a++) {
-        parec_log4c_DEBUG("Removing xattr(%s) of '%s'", ctx->xattr_algorithm[a], name);
-        // sliently ignoring, if the attribute was not set before
-        if ((rc = removexattr(name, ctx->xattr_algorithm[a])) && (errno != ENODATA)) {
-            PAREC_ERROR(ctx, "parec: removing attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_algorithm[a], name, strerror(errno), errno);
-            return -1;
-        }
-    }
-    parec_log4c_DEBUG("Removing xattr(%s) of '%s'", ctx->xattr_mtime, name);
-    // sliently ignoring, if the attribute was not set before
-    if ((rc = removexattr(name, ctx->xattr_mtime)) && (errno != ENODATA)) {
-        PAREC_ERROR(ctx, "parec: removing attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_mtime, name, strerror(errno), errno);
+    PAREC_CHECK_CONTEXT(ctx)
+
+    if (buffers < 0) {
+        PAREC_ERROR(ctx, "parec: invalid number of buffers: %d", buffers);
         return -1;
     }
+
+    parec_log4c_DEBUG("Setting number of read-ahead buffers to %d", buffers);
+
+    // it is also the depth of the io_uring engines of the workers
+    _parec_workers_stop(ctx);
+    ctx->pipeline = buffers;
+
     return 0;
 }
 
-int parec_purge(parec_ctx *ctx, const char *name)
+int parec_get_pipeline(parec_ctx *ctx)
 {
-    int rc;
-    struct stat p_stat;
+    PAREC_CHECK_CONTEXT(ctx)
 
+    return ctx->pipeline;
+}
+
+int parec_set_parallel_digests(parec_ctx *ctx, int enabled)
+{
     PAREC_CHECK_CONTEXT(ctx)
 
-    parec_log4c_DEBUG("Purging '%s'", name);
+    parec_log4c_DEBUG("Setting parallel digests to %d", enabled);
 
-    // purging the entry itself
-    if (_parec_purge(ctx, name)) {
-        return -1;
-    }
+    ctx->parallel_digests = enabled ? 1 : 0;
 
-    // checking if the entry is a directory
-    if ((rc = stat(name, &p_stat))) {
-        PAREC_ERROR(ctx, "parec: could not stat %s (%d)", name, rc);
-        return -1;
-    }
-    // skip the rest, if it is not a directory
-    if (!S_ISDIR(p_stat.st_mode)) {
-        return 0;
-    }
+    return 0;
+}
 
-    struct dirent *p_dirent;
-    char full_name[PATHLEN], full_dirname[PATHLEN];
-    unsigned int max_name_len;
+int parec_get_parallel_digests(parec_ctx *ctx)
+{
+    PAREC_CHECK_CONTEXT(ctx)
 
-    DIR *d = opendir(name);
-    if (!d) {
-        PAREC_ERROR(ctx, "parec: could not open directory '%s'", name);
-        return -1;
-    }
+    return ctx->parallel_digests;
+}
+
+int parec_set_tree_threads(parec_ctx *ctx, int threads)
+{
+    PAREC_CHECK_CONTEXT(ctx)
 
-    // pre-calculating the directory name
-    strncpy(full_dirname, name, PATHLEN);
-    max_name_len = strlen(full_dirname);
-    if (max_name_len == PATHLEN) {
-        PAREC_ERROR(ctx, "parec: too long name '%s'", name);
+    if (threads < 0) {
+        PAREC_ERROR(ctx, "parec: invalid number of tree hashing threads: %d", threads);
         return -1;
     }
-    // make sure there is a slash at the end
-    if (full_dirname[max_name_len - 1] != '/') {
-        max_name_len++;
-        full_dirname[max_name_len - 1] = '/';
-        full_dirname[max_name_len] = '\0';
-    }
-    max_name_len = PATHLEN - max_name_len;
-    parec_log4c_DEBUG("full_dirname = %s", full_dirname);
 
-    while ((p_dirent = readdir(d)) != NULL) {
-        if (_parec_filter(ctx, p_dirent->d_name)) continue;
-        strncpy(full_name, full_dirname, PATHLEN);
-        strncat(full_name, p_dirent->d_name, max_name_len); 
-        if (parec_purge(ctx, full_name)) return -1;
-    }
+    parec_log4c_DEBUG("Setting number of tree hashing threads to %d", threads);
 
-    if (closedir(d)) {
-        PAREC_ERROR(ctx, "parec: failed to close directory '%s' with '%s(%d)'.\n", name, strerror(errno), errno);
-        return -1;
-    }
+    // the team is started with the new size at the next processing
+    _parec_workers_stop(ctx);
+    ctx->tree_threads = threads;
 
     return 0;
 }
 
-static int _parec_file(parec_ctx *ctx, const char *filename, EVP_MD_CTX *md_ctx) {
-    int a,n;
-    unsigned char *buffer;
-
-    buffer = malloc(sizeof(*(buffer)) * BUFLEN);
-    if (!buffer) {
-        PAREC_ERROR(ctx, "parec: out of memory");
-        return -1;
-    }
+int parec_get_tree_threads(parec_ctx *ctx)
+{
+    PAREC_CHECK_CONTEXT(ctx)
 
-    // processing the file by blocks
-    FILE *f = fopen(filename, "rb");
-    if (!f) {
-        PAREC_ERROR(ctx, "parec: could not open file '%s'", filename);
-        return -1;
-    }
+    return ctx->tree_threads;
+}
 
-    // giving some hints to the kernel about our usage pattern
-    if (posix_fadvise(fileno(f), 0, 0, POSIX_FADV_SEQUENTIAL | POSIX_FADV_DONTNEED)) {
-        parec_log4c_WARN("parec: could not advise the kernel on buffer usage: %s(%d)", strerror(errno), errno);
-    }
+int parec_set_multi_buffer(parec_ctx *ctx, int enabled)
+{
+    PAREC_CHECK_CONTEXT(ctx)
 
-    while (feof(f) == 0) {
-        n = fread(buffer, sizeof (unsigned char), BUFLEN, f);
-        if (n > 0) {
-            // processing one block
-            for (a = 0; a < ctx->algorithms; a++) {
-                if (EVP_DigestUpdate(&md_ctx[a], buffer, n) != 1) {
-                    PAREC_ERROR(ctx, "parec: calculating digest '%s' has failed", ctx->algorithm[a]);
-                    return -1;
-                }
-            }
-        }
-    }
-    // we already have the final block, so the file can be closed
-    fclose(f);
+    parec_log4c_DEBUG("Setting multi-buffer digests to %d", enabled);
 
-    free (buffer);
+    // the batches of the workers are allocated for the new length
+    _parec_workers_stop(ctx);
+    ctx->multi_buffer = enabled ? 1 : 0;
 
     return 0;
 }
 
-// The directory checksum is the checksum of the entry checksums.
-// To be independent of the order or name of the entries, the 
-// checksums of the entries has to be ordered by the checksums
-// themselves.
-//
-// There are a number of possibilities:
-// 1. double scan
-//      process each entry and count them
-//      allocate checksum arrays
-//      fetch the checksums from the extended attributes
-//      sort the arrays
-//      calculate the directory checksum based on the arrays
-// 
-// 2. dynamic allocation
-//      merge the above two loops into a single loop by dynamically
-//      reallocating the checksum arrays, if they are not big enough
-// 
-// 3. dynamic heap
-//      merge the sort step into the loop by maintaining a sorted structure
-//
-// 2.a returning checksums
-//      instead of passing attributes through extended attributes
-//      the processing function could return them to the calling
-//      context directly
+int parec_get_multi_buffer(parec_ctx *ctx)
+{
+    PAREC_CHECK_CONTEXT(ctx)
 
-static int _parec_directory(parec_ctx *ctx, const char *dirname, EVP_MD_CTX *md_ctx) {
-    int dcount = 0;
-    struct dirent *p_dirent;
-    char full_name[PATHLEN], full_dirname[PATHLEN], hex[EVP_MAX_MD_SIZE*2+1];
-    unsigned char **x_digest, x_digest_tmp[EVP_MAX_MD_SIZE];
-    int *x_dlen, x_dlen_tmp, a;
-    unsigned int max_name_len;
+    return ctx->multi_buffer;
+}
 
-    DIR *d = opendir(dirname);
-    if (!d) {
-        PAREC_ERROR(ctx, "parec: could not open directory '%s'", dirname);
-        return -1;
-    }
+int parec_set_chunk_size(parec_ctx *ctx, long long size)
+{
+    char *x_name;
 
-    // pre-calculating the directory name
-    strncpy(full_dirname, dirname, PATHLEN);
-    max_name_len = strlen(full_dirname);
-    if (max_name_len == PATHLEN) {
-        PAREC_ERROR(ctx, "parec: too long name '%s'", dirname);
-        return -1;
-    }
-    // make sure there is a slash at the end
-    if (full_dirname[max_name_len - 1] != '/') {
-        max_name_len++;
-        full_dirname[max_name_len - 1] = '/';
-        full_dirname[max_name_len] = '\0';
-    }
-    max_name_len = PATHLEN - max_name_len;
-    parec_log4c_DEBUG("full_dirname = %s", full_dirname);
+    PAREC_CHECK_CONTEXT(ctx)
 
-    // the array to hold the pointer to the array of digests
-    x_digest = calloc(sizeof(*(x_digest)), ctx->algorithms);
-    if (!x_digest) {
-        PAREC_ERROR(ctx, "parec: out of memory");
+    if (ctx->evp_initialized) {
+        PAREC_ERROR(ctx, "parec: checksums are already initialized, cannot change the chunk size");
         return -1;
     }
-    // the array to hold the digest lengths
-    x_dlen = calloc(sizeof(*(x_dlen)), ctx->algorithms);
-    if (!x_dlen) {
-        PAREC_ERROR(ctx, "parec: out of memory");
+
+    if (size < 0 || size % DIRECT_ALIGN) {
+        PAREC_ERROR(ctx, "parec: invalid chunk size: %lld (not a multiple of %d)", size, (int) DIRECT_ALIGN);
         return -1;
     }
 
-    while ((p_dirent = readdir(d)) != NULL) {
-        if (_parec_filter(ctx, p_dirent->d_name)) continue;
-        strncpy(full_name, full_dirname, PATHLEN);
-        strncat(full_name, p_dirent->d_name, max_name_len); 
-        parec_log4c_DEBUG("1. processing '%s' for directory '%s'", full_name, dirname);
-        if (parec_process(ctx, full_name)) return -1;
-        dcount++;
-    }
-    parec_log4c_DEBUG("# processed entries: %d", dcount);
+    parec_log4c_DEBUG("Setting chunk size to %lld", size);
 
-    rewinddir(d);
+    // the team is started for the chunks at the next processing
+    _parec_workers_stop(ctx);
+    ctx->chunk_size = size;
 
-    int i = 0;
-    while ((p_dirent = readdir(d)) != NULL && (i <= dcount)) {
-        if (_parec_filter(ctx, p_dirent->d_name)) continue;
-        strncpy(full_name, full_dirname, PATHLEN);
-        strncat(full_name, p_dirent->d_name, max_name_len); 
-        parec_log4c_DEBUG("2. processing '%s' for directory '%s'", full_name, dirname);
-        for (a = 0; a < ctx->algorithms; a++) {
-            // we have to allocate an array for the digests at the first time
-            // we know the exact size of one digest of a particular algorithm
-            if (!x_dlen[a]) {
-                if ((x_dlen[a] = getxattr(full_name, ctx->xattr_algorithm[a], x_digest_tmp, EVP_MAX_MD_SIZE)) < 0 && (errno != ENODATA)) {
-                    PAREC_ERROR(ctx, "parec: fetching attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_algorithm[a], full_name, strerror(errno), errno);
-                }
-                // allocating the array of (dcount * (x_dlen[a] + 1))
-                x_digest[a] = calloc(sizeof(**(x_digest)), (x_dlen[a] + 1) * dcount);
-                if (!x_digest[a]) {
-                    PAREC_ERROR(ctx, "parec: out of memory");
-                    return -1;
-                }
-            }
-            // normal case
-            if ((x_dlen_tmp = getxattr(full_name, ctx->xattr_algorithm[a], x_digest[a] + i * (x_dlen[a] + 1), EVP_MAX_MD_SIZE)) < 0 && (errno != ENODATA)) {
-                PAREC_ERROR(ctx, "parec: fetching attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_algorithm[a], full_name, strerror(errno), errno);
-                return -1;
-            }
-            if (x_dlen_tmp != x_dlen[a]) {
-                PAREC_ERROR(ctx, "parec: fetched an ivalid size (%d) digest entry from file '%s' (expected: %d for %s)", x_dlen_tmp, full_name, x_dlen[a], ctx->xattr_algorithm[a]);
-                return -1;
-            }
-            parec_log4c_DEBUG("%s(%d:%s) = 0x%s", ctx->xattr_algorithm[a], i, full_name, _parec_hex(hex, x_digest[a] + i * (x_dlen[a] + 1), x_dlen[a]));
+    // the chunked checksums are stored under their own names
+    for (int a = 0; a < ctx->algorithms; a++) {
+        if (!(x_name = _parec_xattr_algorithm(ctx, ctx->algorithm[a]))) {
+            PAREC_ERROR(ctx, "parec: out of memory");
+            return -1;
         }
-        i++;
+        free(ctx->xattr_algorithm[a]);
+        ctx->xattr_algorithm[a] = x_name;
     }
 
-    if (closedir(d)) {
-        PAREC_ERROR(ctx, "parec: failed to close directory '%s' with '%s(%d)'.\n", dirname, strerror(errno), errno);
-        return -1;
-    }
+    return 0;
+}
 
-    // sorting the checksums and calculating the digests
-    for (a = 0; a < ctx->algorithms; a++) {
-        qsort(x_digest[a], dcount, x_dlen[a] + 1, (__compar_fn_t)strcmp);
-        for (int i = 0; i < dcount; i++) {
-            if (EVP_DigestUpdate(&md_ctx[a], x_digest[a] + i * (x_dlen[a] + 1), x_dlen[a]) != 1) {
-                PAREC_ERROR(ctx, "parec: calculating digest '%s' has failed", ctx->algorithm[a]);
-                return -1;
-            }
-            parec_log4c_DEBUG("%s(%d) = 0x%s", ctx->xattr_algorithm[a], i, _parec_hex(hex, x_digest[a] + i * (x_dlen[a] + 1), x_dlen[a]));
-        }
-        free(x_digest[a]);
-    }
-    free(x_digest);
-    free(x_dlen);
+long long parec_get_chunk_size(parec_ctx *ctx)
+{
+    PAREC_CHECK_CONTEXT(ctx)
 
-    return 0;
+    return ctx->chunk_size;
 }
 
-int parec_process(parec_ctx *ctx, const char *name) {
-    int a,rc;
-    EVP_MD_CTX *md_ctx;
-    unsigned char digest[EVP_MAX_MD_SIZE], x_digest[EVP_MAX_MD_SIZE];
-    unsigned int dlen;
-    time_t   start_mtime, end_mtime, x_mtime = 0;
+int parec_set_chunk_store(parec_ctx *ctx, const char *dirname)
+{
+    char *chunk_store = NULL;
+
+    PAREC_CHECK_CONTEXT(ctx)
+
+    if (dirname && !dirname[0]) {
+        PAREC_ERROR(ctx, "parec: invalid chunk store name");
+        return -1;
+    }
+
+    parec_log4c_DEBUG("Setting chunk store to '%s'", dirname ? dirname : "");
+
+    if (dirname && !(chunk_store = strdup(dirname))) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return -1;
+    }
+    free(ctx->chunk_store);
+    ctx->chunk_store = chunk_store;
+
+    return 0;
+}
+
+const char *parec_get_chunk_store(parec_ctx *ctx)
+{
+    if (!ctx)
+        return NULL;
+
+    return ctx->chunk_store;
+}
+
+int parec_set_io_method(parec_ctx *ctx, parec_io_method io)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    if (io != PAREC_IO_STDIO && io != PAREC_IO_URING && io != PAREC_IO_MMAP) {
+        PAREC_ERROR(ctx, "parec: invalid I/O method: %d", io);
+        return -1;
+    }
+
+    parec_log4c_DEBUG("Setting I/O method to %d", io);
+
+    _parec_workers_stop(ctx);
+    ctx->io = io;
+
+    return 0;
+}
+
+int parec_get_io_method(parec_ctx *ctx)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    return ctx->io;
+}
+
+int parec_set_mmap_threshold(parec_ctx *ctx, long long size)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    if (size < 0) {
+        PAREC_ERROR(ctx, "parec: invalid mmap threshold: %lld", size);
+        return -1;
+    }
+
+    parec_log4c_DEBUG("Setting mmap threshold to %lld", size);
+
+    ctx->mmap_threshold = size;
+
+    return 0;
+}
+
+long long parec_get_mmap_threshold(parec_ctx *ctx)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    return ctx->mmap_threshold;
+}
+
+int parec_set_cache_policy(parec_ctx *ctx, parec_cache_policy cache)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    if (cache != PAREC_CACHE_NORMAL && cache != PAREC_CACHE_DROP_BEHIND && cache != PAREC_CACHE_DIRECT) {
+        PAREC_ERROR(ctx, "parec: invalid cache policy: %d", cache);
+        return -1;
+    }
+
+    parec_log4c_DEBUG("Setting cache policy to %d", cache);
+
+    ctx->cache = cache;
+
+    return 0;
+}
+
+int parec_get_cache_policy(parec_ctx *ctx)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    return ctx->cache;
+}
+
+int parec_set_xattr_format(parec_ctx *ctx, parec_xattr_format format)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    if (format != PAREC_XATTR_SEPARATE && format != PAREC_XATTR_PACKED) {
+        PAREC_ERROR(ctx, "parec: invalid xattr format: %d", format);
+        return -1;
+    }
+
+    parec_log4c_DEBUG("Setting xattr format to %d", format);
+
+    ctx->xattr_format = format;
+
+    return 0;
+}
+
+int parec_get_xattr_format(parec_ctx *ctx)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    return ctx->xattr_format;
+}
+
+int parec_set_dir_digest(parec_ctx *ctx, parec_dir_digest version)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    if (version != PAREC_DIR_DIGEST_V1 && version != PAREC_DIR_DIGEST_V2) {
+        PAREC_ERROR(ctx, "parec: invalid directory digest version: %d", version);
+        return -1;
+    }
+
+    parec_log4c_DEBUG("Setting directory digest version to %d", version);
+
+    // the digest arrays of the workers are allocated for the new layout
+    _parec_workers_stop(ctx);
+    ctx->dir_digest = version;
+
+    return 0;
+}
+
+int parec_get_dir_digest(parec_ctx *ctx)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    return ctx->dir_digest;
+}
+
+int parec_set_memory_budget(parec_ctx *ctx, long long bytes)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    if (bytes < 0) {
+        PAREC_ERROR(ctx, "parec: invalid memory budget: %lld", bytes);
+        return -1;
+    }
+
+    parec_log4c_DEBUG("Setting memory budget to %lld", bytes);
+
+    ctx->memory_budget = bytes;
+
+    return 0;
+}
+
+long long parec_get_memory_budget(parec_ctx *ctx)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    return ctx->memory_budget;
+}
+
+int parec_set_storage(parec_ctx *ctx, parec_storage storage)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    if (storage != PAREC_STORAGE_XATTR && storage != PAREC_STORAGE_INDEX) {
+        PAREC_ERROR(ctx, "parec: invalid storage: %d", storage);
+        return -1;
+    }
+
+    parec_log4c_DEBUG("Setting storage to %d", storage);
+
+    _parec_storage_stop(ctx);
+    ctx->storage = storage;
+
+    return 0;
+}
+
+int parec_get_storage(parec_ctx *ctx)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    return ctx->storage;
+}
+
+int parec_set_index_file(parec_ctx *ctx, const char *filename)
+{
+    char *index_file;
+
+    PAREC_CHECK_CONTEXT(ctx)
+
+    if (!filename || !filename[0]) {
+        PAREC_ERROR(ctx, "parec: invalid index file name");
+        return -1;
+    }
+
+    parec_log4c_DEBUG("Setting index file to '%s'", filename);
+
+    if (!(index_file = strdup(filename))) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return -1;
+    }
+    _parec_storage_stop(ctx);
+    free(ctx->index_file);
+    ctx->index_file = index_file;
+
+    return 0;
+}
+
+const char *parec_get_index_file(parec_ctx *ctx)
+{
+    if (!ctx)
+        return NULL;
+
+    return ctx->index_file;
+}
+
+int parec_set_event_callback(parec_ctx *ctx, parec_event_callback callback, void *arg)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    parec_log4c_DEBUG("Setting event callback to %p", (void *) callback);
+
+    ctx->event = callback;
+    ctx->event_arg = arg;
+
+    return 0;
+}
+
+/* Profiling
+ *
+ * Each thread counts into its own counters, which are created at its
+ * first timed operation and linked into the list of the context, so
+ * the counting needs neither locks nor atomic operations. A thread
+ * remembers only the counters of its last context, and it looks up its
+ * counters in the list after switching between contexts. The counters
+ * belong to a generation of the profiling, which is unique among all
+ * the contexts, so a thread never uses the released counters of an
+ * earlier generation.
+ */
+
+/* Indices of the xattr system calls in the counters. */
+static const int XATTR_GET = 0;
+static const int XATTR_SET = 1;
+static const int XATTR_REMOVE = 2;
+
+struct _parec_counters {
+    parec_counters              *next;          // of the same context
+    pthread_t                   thread;         // counting into them
+    unsigned long long          wall[PAREC_PHASES];
+    unsigned long long          cpu[PAREC_PHASES];
+    unsigned long long          calls[PAREC_PHASES];
+    unsigned long long          xattr[3];
+    unsigned long long          files_hashed;
+    unsigned long long          entries_skipped;
+    unsigned long long          directories_hashed;
+    unsigned long long          latency[PAREC_STATS_BUCKETS];
+    int                         algorithms;
+    unsigned long long          bytes[];        // of each algorithm
+};
+
+// the start of a timed operation
+typedef struct {
+    long long                   wall;
+    long long                   cpu;
+} parec_tick;
+
+/* The last generation of the profiling of all the contexts. */
+static unsigned long _parec_profiles = 0;
+/* The counters of the thread and their generation. */
+static __thread parec_counters *_parec_thread_counters = NULL;
+static __thread unsigned long _parec_thread_profile = 0;
+
+// the monotonic time in nanoseconds
+static long long _parec_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// the CPU time of the calling thread in nanoseconds
+static long long _parec_cpu_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// the counters of the calling thread, which are created at its first use;
+// NULL, if there is no memory for them
+static parec_counters *_parec_counters(parec_ctx *ctx)
+{
+    unsigned long profile = ctx->profile;
+    pthread_t self = pthread_self();
+    parec_counters *c, *head;
+
+    if (_parec_thread_profile == profile)
+        return _parec_thread_counters;
+
+    // the counters of an earlier use of the context by the thread; the
+    // published counters are not changed, only new ones are pushed
+    for (c = __atomic_load_n(&ctx->counters, __ATOMIC_ACQUIRE); c; c = c->next) {
+        if (pthread_equal(c->thread, self))
+            break;
+    }
+    if (!c) {
+        if (!(c = calloc(1, sizeof(*c) + sizeof(*(c->bytes)) * ctx->algorithms)))
+            return NULL;
+        c->thread = self;
+        c->algorithms = ctx->algorithms;
+        // pushing them to the list by the actual head, which is returned,
+        // if it was not the expected one
+        c->next = NULL;
+        while ((head = __sync_val_compare_and_swap(&ctx->counters, c->next, c)) != c->next) {
+            c->next = head;
+        }
+    }
+
+    _parec_thread_counters = c;
+    _parec_thread_profile = profile;
+    return c;
+}
+
+static void _parec_counters_free(parec_ctx *ctx)
+{
+    parec_counters *c;
+
+    while ((c = ctx->counters)) {
+        ctx->counters = c->next;
+        free(c);
+    }
+}
+
+// starting a timed operation, if the profiling is enabled
+static void _parec_tick(parec_ctx *ctx, parec_tick *tick)
+{
+    if (ctx->profile) {
+        tick->wall = _parec_clock();
+        tick->cpu = _parec_cpu_clock();
+    }
+}
+
+// adding a finished operation to its phase
+static void _parec_tock(parec_ctx *ctx, const parec_tick *tick, parec_phase phase)
+{
+    parec_counters *c;
+
+    if (!ctx->profile || !(c = _parec_counters(ctx)))
+        return;
+    c->wall[phase] += _parec_clock() - tick->wall;
+    c->cpu[phase] += _parec_cpu_clock() - tick->cpu;
+    c->calls[phase]++;
+}
+
+// counting the bytes digested by an algorithm
+static void _parec_count_bytes(parec_ctx *ctx, int a, size_t len)
+{
+    parec_counters *c;
+
+    if (ctx->profile && (c = _parec_counters(ctx)) && a < c->algorithms)
+        c->bytes[a] += len;
+}
+
+// counting an xattr system call
+static void _parec_count_xattr(parec_ctx *ctx, int op)
+{
+    parec_counters *c;
+
+    if (ctx->profile && (c = _parec_counters(ctx)))
+        c->xattr[op]++;
+}
+
+// counting a hashed or skipped entry, the files by their latency since
+// 'start' as well
+static void _parec_count_entry(parec_ctx *ctx, parec_event_type type, long long start)
+{
+    parec_counters *c;
+    unsigned long long us;
+    int bucket = 0;
+
+    if (!ctx->profile || !(c = _parec_counters(ctx)))
+        return;
+
+    if (type == PAREC_EVENT_SKIP) {
+        c->entries_skipped++;
+    }
+    else if (type == PAREC_EVENT_DIRECTORY) {
+        c->directories_hashed++;
+    }
+    else {
+        c->files_hashed++;
+        if ((us = (_parec_clock() - start) / 1000) > 0)
+            bucket = 64 - __builtin_clzll(us);
+        c->latency[bucket < PAREC_STATS_BUCKETS ? bucket : PAREC_STATS_BUCKETS - 1]++;
+    }
+}
+
+int parec_set_profile(parec_ctx *ctx, int enabled)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    parec_log4c_DEBUG("Setting profiling to %d", enabled);
+
+    _parec_counters_free(ctx);
+    ctx->profile = enabled ? __sync_add_and_fetch(&_parec_profiles, 1) : 0;
+
+    return 0;
+}
+
+int parec_get_profile(parec_ctx *ctx)
+{
+    PAREC_CHECK_CONTEXT(ctx)
+
+    return ctx->profile ? 1 : 0;
+}
+
+parec_stats *parec_get_stats(parec_ctx *ctx)
+{
+    parec_stats *stats;
+    parec_counters *c;
+    int i;
+
+    if (!ctx)
+        return NULL;
+
+    if (!(stats = calloc(1, sizeof(*stats) + sizeof(*(stats->bytes)) * ctx->algorithms))) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return NULL;
+    }
+    stats->algorithms = ctx->algorithms;
+    stats->bytes = (unsigned long long *) (stats + 1);
+
+    for (c = ctx->counters; c; c = c->next) {
+        for (i = 0; i < PAREC_PHASES; i++) {
+            stats->wall_ns[i] += c->wall[i];
+            stats->cpu_ns[i] += c->cpu[i];
+            stats->calls[i] += c->calls[i];
+        }
+        stats->xattr_get += c->xattr[XATTR_GET];
+        stats->xattr_set += c->xattr[XATTR_SET];
+        stats->xattr_remove += c->xattr[XATTR_REMOVE];
+        stats->files_hashed += c->files_hashed;
+        stats->entries_skipped += c->entries_skipped;
+        stats->directories_hashed += c->directories_hashed;
+        for (i = 0; i < PAREC_STATS_BUCKETS; i++) {
+            stats->latency[i] += c->latency[i];
+        }
+        for (i = 0; i < c->algorithms && i < stats->algorithms; i++) {
+            stats->bytes[i] += c->bytes[i];
+        }
+    }
+
+    return stats;
+}
+
+// filterint the directory entries
+static int _parec_filter(parec_ctx *ctx, const char *dname) 
+{
+    // skip '.' and '..'
+    if ((dname[0] == '.') 
+        && (dname[1] == '\0' 
+            || (dname[1] == '.' && dname[2] == '\0')))
+        return -1;
+
+    // skip also the ones matching any of the glob patterns
+    for (int e = 0; e < ctx->excludes; e++) {
+        if (!fnmatch(ctx->exclude[e], dname, 0)) {
+            parec_log4c_DEBUG("skipping '%s' because of pattern '%s'", dname, ctx->exclude[e]);
+            return -1;
+        }
+        // note that fnmatch(3) may also return a non-zero value
+        // to indicate an error, however we just skip that here
+    }
+    return 0;
+}
+
+
+/* Entries of the walk
+ *
+ * Every entry is reached relative to the descriptor of its directory and
+ * it is kept open, while it is processed: its attributes are read and
+ * written, and a file is read through the same descriptor. So the kernel
+ * resolves only one name for each entry, however deep it is in the tree,
+ * and the length of the full names is not limited. The full names are
+ * kept only for the messages.
+ *
+ * The type of the entries is taken from the directory, so the regular
+ * files and directories are opened right away and the rest is not even
+ * looked up. Only the metadata of the fingerprint is fetched by statx(2).
+ */
+
+#ifdef STATX_TYPE
+/* Metadata needed for the fingerprint and the type of an entry. */
+static const unsigned int STATX_MASK = STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME;
+#endif
+
+// fetching the metadata of the entry 'name' of 'dirfd', or of 'dirfd'
+// itself for an empty name; only the type, device, inode, size and
+// modification time are filled
+static int _parec_statx(int dirfd, const char *name, struct stat *p_stat)
+{
+#ifdef STATX_TYPE
+    struct statx stx;
+
+    if (!statx(dirfd, name, name[0] ? 0 : AT_EMPTY_PATH, STATX_MASK, &stx)) {
+        p_stat->st_mode = stx.stx_mode;
+        p_stat->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        p_stat->st_ino = stx.stx_ino;
+        p_stat->st_size = stx.stx_size;
+        p_stat->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+        p_stat->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+        return 0;
+    }
+    // falling back on kernels without statx(2)
+    if (errno != ENOSYS)
+        return -1;
+#endif
+    return name[0] ? fstatat(dirfd, name, p_stat, 0) : fstat(dirfd, p_stat);
+}
+
+// checking and opening an entry; only the regular files and directories
+// are opened, for the rest 'fd' is left -1
+static int _parec_entry_open(parec_ctx *ctx, parec_entry *e, struct stat *p_stat)
+{
+    int known = (e->type == DT_REG || e->type == DT_DIR);
+
+    e->fd = -1;
+
+    // the other types are known without looking them up
+    if (e->type != DT_UNKNOWN && e->type != DT_LNK && e->type != DT_REG && e->type != DT_DIR) {
+        p_stat->st_mode = DTTOIF(e->type);
+        return 0;
+    }
+
+    // the entries of unknown type (including the symbolic links, which
+    // are followed) have to be checked first, since opening a fifo blocks
+    if (!known) {
+        if (_parec_statx(e->dirfd, e->dname, p_stat)) {
+            PAREC_ERROR(ctx, "parec: could not stat %s with '%s(%d)'", e->name, strerror(errno), errno);
+            return -1;
+        }
+        if (!S_ISREG(p_stat->st_mode) && !S_ISDIR(p_stat->st_mode))
+            return 0;
+        e->type = S_ISDIR(p_stat->st_mode) ? DT_DIR : DT_REG;
+    }
+
+    if ((e->fd = openat(e->dirfd, e->dname, O_RDONLY | O_NOCTTY | (e->type == DT_DIR ? O_DIRECTORY : 0))) < 0) {
+        PAREC_ERROR(ctx, "parec: could not open '%s' with '%s(%d)'", e->name, strerror(errno), errno);
+        return -1;
+    }
+    // the fingerprint is taken from the opened entry, unless it is
+    // looked up already
+    if (known && _parec_statx(e->fd, "", p_stat)) {
+        PAREC_ERROR(ctx, "parec: could not stat %s with '%s(%d)'", e->name, strerror(errno), errno);
+        close(e->fd);
+        e->fd = -1;
+        return -1;
+    }
+    e->dev = p_stat->st_dev;
+    e->ino = p_stat->st_ino;
+
+    // a directory is reached again through a symbolic link, which would be
+    // followed without an end, since openat(2) resolves only one level
+    if (e->type == DT_DIR) {
+        for (const parec_entry *up = e->parent; up; up = up->parent) {
+            if (up->dev == e->dev && up->ino == e->ino) {
+                PAREC_ERROR(ctx, "parec: '%s' is a loop to '%s'", e->name, up->name);
+                close(e->fd);
+                e->fd = -1;
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void _parec_entry_close(parec_entry *e)
+{
+    if (e->fd >= 0)
+        close(e->fd);
+    e->fd = -1;
+}
+
+// allocating a buffer for the full names of the entries of a directory,
+// which are copied to the returned buffer after 'len' bytes
+static char *_parec_entry_names(parec_ctx *ctx, const char *dirname, size_t *len)
+{
+    size_t n = strlen(dirname);
+    char *names;
+
+    if (!(names = malloc(n + NAME_MAX + 2))) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return NULL;
+    }
+    strcpy(names, dirname);
+    // make sure there is a slash at the end
+    if (n == 0 || names[n - 1] != '/')
+        names[n++] = '/';
+    names[n] = '\0';
+    *len = n;
+    return names;
+}
+
+
+/* Stored checksums
+ *
+ * The checksums of an entry are stored together with a fingerprint of the
+ * entry at the start of the calculation by one of the backends of the
+ * storages (see parec_storage).
+ *
+ * The extended attributes have two layouts (see parec_xattr_format). Both
+ * layouts are read, the one of the context first, and an entry found in
+ * the other one is migrated, when it is stored next time or found to be
+ * unchanged.
+ *
+ * The index keeps the packed record of each entry, keyed by its device
+ * and inode numbers. The entries stored in the extended attributes are
+ * copied into the index only by parec_migrate().
+ *
+ * The packed record is little endian:
+ *      2 bytes     magic "PR"
+ *      1 byte      version
+ *      1 byte      number of digests
+ *      4 bytes     nanoseconds of the modification time
+ *      8 bytes     modification time in seconds
+ *      8 bytes     size
+ *      and for each digest:
+ *      1 byte      length of the algorithm name
+ *      n bytes     algorithm name
+ *      1 byte      length of the digest
+ *      n bytes     digest
+ */
+
+static void _parec_stamp(parec_stamp *stamp, const struct stat *p_stat)
+{
+    stamp->layout = -1;
+    stamp->mtime = p_stat->st_mtime;
+    stamp->mtime_nsec = p_stat->st_mtim.tv_nsec;
+    stamp->size = p_stat->st_size;
+}
+
+// comparing an actual fingerprint with a stored one, whose unknown
+// parts are ignored
+static int _parec_stamp_equal(const parec_stamp *actual, const parec_stamp *stored)
+{
+    return actual->mtime == stored->mtime
+        && (stored->mtime_nsec < 0 || actual->mtime_nsec == stored->mtime_nsec)
+        && (stored->size < 0 || actual->size == stored->size);
+}
+
+static int _parec_other_layout(int layout)
+{
+    return (layout == PAREC_XATTR_PACKED) ? PAREC_XATTR_SEPARATE : PAREC_XATTR_PACKED;
+}
+
+// the layout of the checksums stored by the context
+static int _parec_layout(parec_ctx *ctx)
+{
+    return (ctx->storage == PAREC_STORAGE_INDEX) ? STORED_INDEX : (int)ctx->xattr_format;
+}
+
+static void _parec_put_le(unsigned char *p, uint64_t value, int len)
+{
+    for (int i = 0; i < len; i++) {
+        p[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+static uint64_t _parec_get_le(const unsigned char *p, int len)
+{
+    uint64_t value = 0;
+
+    for (int i = len - 1; i >= 0; i--) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+// parsing the header of a packed record, returns -1, if it is not valid
+static int _parec_record_parse(const unsigned char *rec, ssize_t len, parec_stamp *stamp)
+{
+    if (len < (ssize_t)RECORD_HEADER || rec[0] != 'P' || rec[1] != 'R' || rec[2] != RECORD_VERSION)
+        return -1;
+
+    stamp->layout = PAREC_XATTR_PACKED;
+    stamp->mtime_nsec = (long) _parec_get_le(rec + 4, 4);
+    stamp->mtime = (time_t) (int64_t) _parec_get_le(rec + 8, 8);
+    stamp->size = (off_t) (int64_t) _parec_get_le(rec + 16, 8);
+    return 0;
+}
+
+// looking up the digest of an algorithm in a packed record,
+// returns NULL, if it is not there
+static const unsigned char *_parec_record_digest(const unsigned char *rec, size_t len, const char *alg, int *dlen)
+{
+    size_t p = RECORD_HEADER, n;
+
+    for (int i = 0; i < rec[3]; i++) {
+        if (p + 1 > len || p + 2 + (n = rec[p]) > len || p + 2 + n + rec[p + 1 + n] > len)
+            return NULL;
+        if (n == strlen(alg) && !memcmp(rec + p + 1, alg, n)) {
+            *dlen = rec[p + 1 + n];
+            return rec + p + 2 + n;
+        }
+        p += 2 + n + rec[p + 1 + n];
+    }
+    return NULL;
+}
+
+// the length of the packed record of the checksums of the context
+static size_t _parec_record_len(parec_ctx *ctx)
+{
+    size_t len = RECORD_HEADER;
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        len += 2 + strlen(_parec_stored_name(ctx, a)) + ctx->dlen[a];
+    }
+    return len;
+}
+
+// building the packed record of the checksums (one buffer for each
+// algorithm) and the fingerprint of an entry, returns its length
+static ssize_t _parec_record_build(parec_ctx *ctx, const parec_entry *e, const parec_stamp *stamp, unsigned char **digest, unsigned char *rec)
+{
+    size_t len = RECORD_HEADER, n;
+
+    rec[0] = 'P';
+    rec[1] = 'R';
+    rec[2] = RECORD_VERSION;
+    rec[3] = ctx->algorithms;
+    _parec_put_le(rec + 4, stamp->mtime_nsec, 4);
+    _parec_put_le(rec + 8, stamp->mtime, 8);
+    _parec_put_le(rec + 16, stamp->size, 8);
+    for (int a = 0; a < ctx->algorithms; a++) {
+        n = strlen(_parec_stored_name(ctx, a));
+        if (n > 255 || len + 2 + n + ctx->dlen[a] > RECORD_LEN) {
+            PAREC_ERROR(ctx, "parec: the checksums do not fit into the record of '%s'", e->name);
+            return -1;
+        }
+        rec[len] = n;
+        memcpy(rec + len + 1, _parec_stored_name(ctx, a), n);
+        rec[len + 1 + n] = ctx->dlen[a];
+        memcpy(rec + len + 2 + n, digest[a], ctx->dlen[a]);
+        len += 2 + n + ctx->dlen[a];
+    }
+    return len;
+}
+
+// loading a packed record like _parec_stored_xattr(), it is used only, if it has
+// every checksum of the context
+static int _parec_record_load(parec_ctx *ctx, const parec_entry *e, const unsigned char *rec, ssize_t len, const parec_stamp *actual, parec_stamp *stored, unsigned char **digest)
+{
+    const unsigned char *d[ctx->algorithms + 1];    // avoiding a zero length array
+    parec_stamp stamp;
+    int dlen;
+
+    if (_parec_record_parse(rec, len, &stamp)) {
+        parec_log4c_WARN("parec: ignoring the invalid record of '%s'", e->name);
+        return 0;
+    }
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        if (!(d[a] = _parec_record_digest(rec, len, _parec_stored_name(ctx, a), &dlen)))
+            return 0;
+        if (dlen != (int)ctx->dlen[a]) {
+            PAREC_ERROR(ctx, "parec: fetched an ivalid size (%d) digest entry from file '%s' (expected: %d for %s)", dlen, e->name, ctx->dlen[a], _parec_stored_name(ctx, a));
+            return -1;
+        }
+    }
+
+    *stored = stamp;
+    if (digest && (!actual || _parec_stamp_equal(actual, stored))) {
+        for (int a = 0; a < ctx->algorithms; a++) {
+            memcpy(digest[a], d[a], ctx->dlen[a]);
+        }
+    }
+    return 0;
+}
+
+static int _parec_stored_packed(parec_ctx *ctx, const parec_entry *e, const parec_stamp *actual, parec_stamp *stored, unsigned char **digest)
+{
+    unsigned char rec[RECORD_LEN];
+    ssize_t len;
+
+    _parec_count_xattr(ctx, XATTR_GET);
+    if ((len = fgetxattr(e->fd, ctx->xattr_record, rec, RECORD_LEN)) < 0) {
+        if (errno == ENODATA)
+            return 0;
+        PAREC_ERROR(ctx, "parec: fetching attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_record, e->name, strerror(errno), errno);
+        return -1;
+    }
+    return _parec_record_load(ctx, e, rec, len, actual, stored, digest);
+}
+
+static int _parec_stored_separate(parec_ctx *ctx, const parec_entry *e, const parec_stamp *actual, parec_stamp *stored, unsigned char **digest)
+{
+    unsigned char x_digest[EVP_MAX_MD_SIZE];
+    time_t x_mtime;
+    int rc;
+
+    _parec_count_xattr(ctx, XATTR_GET);
+    if ((rc = fgetxattr(e->fd, ctx->xattr_mtime, &x_mtime, sizeof(x_mtime))) < 0) {
+        if (errno == ENODATA)
+            return 0;
+        PAREC_ERROR(ctx, "parec: fetching attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_mtime, e->name, strerror(errno), errno);
+        return -1;
+    }
+    if (rc != sizeof(x_mtime))
+        return 0;
+
+    stored->layout = PAREC_XATTR_SEPARATE;
+    stored->mtime = x_mtime;
+    stored->mtime_nsec = -1;
+    stored->size = -1;
+
+    // the digests are fetched one by one, only if they are needed
+    if (!digest || (actual && !_parec_stamp_equal(actual, stored)))
+        return 0;
+    for (int a = 0; a < ctx->algorithms; a++) {
+        _parec_count_xattr(ctx, XATTR_GET);
+        if ((rc = fgetxattr(e->fd, ctx->xattr_algorithm[a], x_digest, EVP_MAX_MD_SIZE)) < 0) {
+            PAREC_ERROR(ctx, "parec: fetching attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_algorithm[a], e->name, strerror(errno), errno);
+            return -1;
+        }
+        if (rc != (int)ctx->dlen[a]) {
+            PAREC_ERROR(ctx, "parec: fetched an ivalid size (%d) digest entry from file '%s' (expected: %d for %s)", rc, e->name, ctx->dlen[a], ctx->xattr_algorithm[a]);
+            return -1;
+        }
+        memcpy(digest[a], x_digest, rc);
+    }
+    return 0;
+}
+
+// loading the stored fingerprint of an entry, and its checksums into
+// 'digest' (one buffer for each algorithm), if it is set and 'actual'
+// is either NULL or matches the stored fingerprint;
+// stored->layout is -1, if the entry is not stored in either layout
+static int _parec_stored_xattr(parec_ctx *ctx, const parec_entry *e, const parec_stamp *actual, parec_stamp *stored, unsigned char **digest)
+{
+    int layout = ctx->xattr_format, rc;
+
+    stored->layout = -1;
+    for (int i = 0; i < 2; i++, layout = _parec_other_layout(layout)) {
+        if (layout == PAREC_XATTR_PACKED)
+            rc = _parec_stored_packed(ctx, e, actual, stored, digest);
+        else
+            rc = _parec_stored_separate(ctx, e, actual, stored, digest);
+        if (rc || stored->layout >= 0)
+            return rc;
+    }
+    return 0;
+}
+
+// removing the checksums stored in a layout
+static int _parec_purge_layout(parec_ctx *ctx, const parec_entry *e, int layout)
+{
+    if (layout == PAREC_XATTR_PACKED) {
+        parec_log4c_DEBUG("Removing xattr(%s) of '%s'", ctx->xattr_record, e->name);
+        _parec_count_xattr(ctx, XATTR_REMOVE);
+        if (fremovexattr(e->fd, ctx->xattr_record) && (errno != ENODATA)) {
+            PAREC_ERROR(ctx, "parec: removing attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_record, e->name, strerror(errno), errno);
+            return -1;
+        }
+        return 0;
+    }
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        parec_log4c_DEBUG("Removing xattr(%s) of '%s'", ctx->xattr_algorithm[a], e->name);
+        _parec_count_xattr(ctx, XATTR_REMOVE);
+        // sliently ignoring, if the attribute was not set before
+        if (fremovexattr(e->fd, ctx->xattr_algorithm[a]) && (errno != ENODATA)) {
+            PAREC_ERROR(ctx, "parec: removing attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_algorithm[a], e->name, strerror(errno), errno);
+            return -1;
+        }
+    }
+    parec_log4c_DEBUG("Removing xattr(%s) of '%s'", ctx->xattr_mtime, e->name);
+    _parec_count_xattr(ctx, XATTR_REMOVE);
+    // sliently ignoring, if the attribute was not set before
+    if (fremovexattr(e->fd, ctx->xattr_mtime) && (errno != ENODATA)) {
+        PAREC_ERROR(ctx, "parec: removing attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_mtime, e->name, strerror(errno), errno);
+        return -1;
+    }
+    return 0;
+}
+
+// storing the checksums (one buffer for each algorithm) and the fingerprint
+// of an entry in the layout of the context, the previously stored checksums
+// are removed from the other layout
+static int _parec_store_xattr(parec_ctx *ctx, const parec_entry *e, const parec_stamp *stamp, const parec_stamp *stored, unsigned char **digest)
+{
+    unsigned char rec[RECORD_LEN];
+    ssize_t len;
+
+    if (ctx->xattr_format == PAREC_XATTR_PACKED) {
+        if ((len = _parec_record_build(ctx, e, stamp, digest, rec)) < 0)
+            return -1;
+        parec_log4c_DEBUG("Storing xattr(%s)", ctx->xattr_record);
+        _parec_count_xattr(ctx, XATTR_SET);
+        if (fsetxattr(e->fd, ctx->xattr_record, rec, len, 0)) {
+            PAREC_ERROR(ctx, "parec: setting attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_record, e->name, strerror(errno), errno);
+            return -1;
+        }
+    }
+    else {
+        for (int a = 0; a < ctx->algorithms; a++) {
+            parec_log4c_DEBUG("Storing xattr(%s)", ctx->xattr_algorithm[a]);
+            _parec_count_xattr(ctx, XATTR_SET);
+            if (fsetxattr(e->fd, ctx->xattr_algorithm[a], digest[a], ctx->dlen[a], 0)) {
+                PAREC_ERROR(ctx, "parec: setting attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_algorithm[a], e->name, strerror(errno), errno);
+                return -1;
+            }
+        }
+        // storing the mtime, that we know of unchanged during processing
+        if (stored->layout != PAREC_XATTR_SEPARATE || stored->mtime != stamp->mtime) {
+            parec_log4c_DEBUG("Storing xattr(%s)", ctx->xattr_mtime);
+            _parec_count_xattr(ctx, XATTR_SET);
+            if (fsetxattr(e->fd, ctx->xattr_mtime, &stamp->mtime, sizeof(stamp->mtime), 0)) {
+                PAREC_ERROR(ctx, "parec: setting attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_mtime, e->name, strerror(errno), errno);
+                return -1;
+            }
+        }
+    }
+
+    if (stored->layout >= 0 && stored->layout != (int)ctx->xattr_format)
+        return _parec_purge_layout(ctx, e, stored->layout);
+    return 0;
+}
+
+/* Purging extended attributes */
+static int _parec_purge_xattr(parec_ctx *ctx, const parec_entry *e)
+{
+    if (_parec_purge_layout(ctx, e, PAREC_XATTR_SEPARATE))
+        return -1;
+    return _parec_purge_layout(ctx, e, PAREC_XATTR_PACKED);
+}
+
+// the records of the index are looked up in memory
+static int _parec_stored_index(parec_ctx *ctx, const parec_entry *e, const parec_stamp *actual, parec_stamp *stored, unsigned char **digest)
+{
+    unsigned char rec[RECORD_LEN];
+
+    stored->layout = -1;
+    if (!parec_index_get(ctx->index, e->dev, e->ino, rec))
+        return 0;
+    if (_parec_record_load(ctx, e, rec, parec_index_get_value_len(ctx->index), actual, stored, digest))
+        return -1;
+    if (stored->layout >= 0)
+        stored->layout = STORED_INDEX;
+    return 0;
+}
+
+static int _parec_store_index(parec_ctx *ctx, const parec_entry *e, const parec_stamp *stamp, const parec_stamp *stored __attribute__((__unused__)), unsigned char **digest)
+{
+    unsigned char rec[RECORD_LEN];
+
+    if (_parec_record_build(ctx, e, stamp, digest, rec) < 0)
+        return -1;
+    parec_log4c_DEBUG("Storing the record of '%s' in the index", e->name);
+    if (parec_index_put(ctx->index, e->dev, e->ino, e->name, rec)) {
+        PAREC_ERROR(ctx, "parec: storing the record of %s in the index has failed with '%s(%d)'.\n", e->name, strerror(errno), errno);
+        return -1;
+    }
+    return 0;
+}
+
+static int _parec_purge_index(parec_ctx *ctx, const parec_entry *e)
+{
+    parec_log4c_DEBUG("Removing the record of '%s' from the index", e->name);
+    parec_index_remove(ctx->index, e->dev, e->ino);
+    return 0;
+}
+
+static const parec_backend XATTR_BACKEND = { _parec_stored_xattr, _parec_store_xattr, _parec_purge_xattr };
+static const parec_backend INDEX_BACKEND = { _parec_stored_index, _parec_store_index, _parec_purge_index };
+
+// selecting the backend of the storage and opening the index, if it is
+// not open yet; the digest lengths have to be initialized
+static int _parec_storage_start(parec_ctx *ctx)
+{
+    size_t len;
+
+    if (ctx->storage != PAREC_STORAGE_INDEX) {
+        ctx->backend = &XATTR_BACKEND;
+        return 0;
+    }
+
+    ctx->backend = &INDEX_BACKEND;
+    if (ctx->index)
+        return 0;
+    if (!ctx->index_file) {
+        PAREC_ERROR(ctx, "parec: the index file is not set");
+        return -1;
+    }
+    if ((len = _parec_record_len(ctx)) > RECORD_LEN) {
+        PAREC_ERROR(ctx, "parec: the checksums do not fit into the records of the index");
+        return -1;
+    }
+    if (!(ctx->index = parec_index_open(ctx->index_file, len))) {
+        if (errno == EINVAL) {
+            PAREC_ERROR(ctx, "parec: '%s' is not an index file", ctx->index_file);
+        }
+        else if (errno == EWOULDBLOCK) {
+            PAREC_ERROR(ctx, "parec: the index '%s' is used by another process", ctx->index_file);
+        }
+        else {
+            PAREC_ERROR(ctx, "parec: opening the index '%s' has failed with '%s(%d)'", ctx->index_file, strerror(errno), errno);
+        }
+        return -1;
+    }
+    if (parec_index_get_value_len(ctx->index) != len) {
+        PAREC_ERROR(ctx, "parec: the index '%s' has records of %zu bytes instead of %zu for these checksums", ctx->index_file, parec_index_get_value_len(ctx->index), len);
+        _parec_storage_stop(ctx);
+        return -1;
+    }
+    parec_log4c_DEBUG("Opened the index '%s' with %llu records", ctx->index_file, (unsigned long long) parec_index_get_count(ctx->index));
+    return 0;
+}
+
+static void _parec_storage_stop(parec_ctx *ctx)
+{
+    parec_index_close(ctx->index);
+    ctx->index = NULL;
+}
+
+// storing the checksums of an entry, which are found in the extended
+// attributes, in the storage and layout of the context, unless it has
+// changed since they were stored (its actual fingerprint is 'stamp')
+static int _parec_migrate(parec_ctx *ctx, const parec_entry *e, const parec_stamp *stamp)
+{
+    unsigned char x_digest[ctx->algorithms + 1][EVP_MAX_MD_SIZE];
+    unsigned char *digest[ctx->algorithms + 1];
+    parec_stamp stored;
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        digest[a] = x_digest[a];
+    }
+    if (_parec_stored_xattr(ctx, e, NULL, &stored, digest))
+        return -1;
+    if (stored.layout < 0 || stored.layout == _parec_layout(ctx) || !_parec_stamp_equal(stamp, &stored))
+        return 0;
+
+    parec_log4c_INFO("migrating the checksums of '%s'", e->name);
+    return ctx->backend->store(ctx, e, stamp, &stored, digest);
+}
+
+// fetching the stored checksum of an algorithm of an entry into 'digest',
+// returns its length, 0, if nothing is stored, and -1 in case of an error
+static int _parec_stored_digest(parec_ctx *ctx, int idx, const char *name, unsigned char *digest)
+{
+    parec_entry e = { AT_FDCWD, name, name, -1, DT_UNKNOWN, 0, 0, NULL };
+    unsigned char x_digest[ctx->algorithms][EVP_MAX_MD_SIZE];
+    unsigned char *p_digest[ctx->algorithms];
+    parec_stamp stored;
+    struct stat p_stat;
+    int rc;
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        p_digest[a] = x_digest[a];
+    }
+    if (_parec_entry_open(ctx, &e, &p_stat))
+        return -1;
+    // nothing is stored on the other types
+    if (e.fd < 0)
+        return 0;
+
+    rc = ctx->backend->stored(ctx, &e, NULL, &stored, p_digest);
+    _parec_entry_close(&e);
+    if (rc)
+        return -1;
+    if (stored.layout < 0)
+        return 0;
+
+    memcpy(digest, x_digest[idx], ctx->dlen[idx]);
+    return ctx->dlen[idx];
+}
+
+// visiting an entry and, if it is a directory, all the entries below it;
+// 'arg' is passed to the visitor
+static int _parec_visit(parec_ctx *ctx, parec_entry *e, int (*visit)(parec_ctx *ctx, const parec_entry *e, const struct stat *p_stat, void *arg), void *arg)
+{
+    struct stat p_stat;
+    struct dirent64 *p_dirent;
+    parec_entry child;
+    char *names;
+    size_t len;
+    parec_dir *dir;
+    int rc = 0;
+
+    if (_parec_entry_open(ctx, e, &p_stat))
+        return -1;
+    // nothing is stored on the other types
+    if (e->fd < 0)
+        return 0;
+
+    // visiting the entry itself
+    if (visit(ctx, e, &p_stat, arg)) {
+        _parec_entry_close(e);
+        return -1;
+    }
+
+    // skip the rest, if it is not a directory
+    if (!S_ISDIR(p_stat.st_mode)) {
+        _parec_entry_close(e);
+        return 0;
+    }
+
+    if (!(names = _parec_entry_names(ctx, e->name, &len))) {
+        _parec_entry_close(e);
+        return -1;
+    }
+    if (!(dir = _parec_dir_open(ctx, -1, e))) {
+        _parec_entry_close(e);
+        free(names);
+        return -1;
+    }
+
+    child.dirfd = e->fd;
+    child.name = names;
+    child.parent = e;
+    while (!rc && (p_dirent = _parec_dir_read(ctx, dir, &rc)) != NULL) {
+        if (_parec_filter(ctx, p_dirent->d_name)) continue;
+        strcpy(names + len, p_dirent->d_name);
+        child.dname = names + len;
+        child.type = p_dirent->d_type;
+        rc = _parec_visit(ctx, &child, visit, arg);
+    }
+    _parec_dir_close(ctx, -1, dir);
+    _parec_entry_close(e);
+    free(names);
+
+    return rc;
+}
+
+static int _parec_purge_entry(parec_ctx *ctx, const parec_entry *e, const struct stat *p_stat __attribute__((__unused__)), void *arg __attribute__((__unused__)))
+{
+    parec_log4c_DEBUG("Purging '%s'", e->name);
+
+    return ctx->backend->purge(ctx, e);
+}
+
+int parec_purge(parec_ctx *ctx, const char *name)
+{
+    parec_entry e = { AT_FDCWD, name, name, -1, DT_UNKNOWN, 0, 0, NULL };
+
+    PAREC_CHECK_CONTEXT(ctx)
+
+    // the digest lengths are needed for the records of the index
+    if (parec_init_evp(ctx) || _parec_storage_start(ctx) || _parec_workers_start(ctx)) return -1;
+
+    return _parec_visit(ctx, &e, _parec_purge_entry, NULL);
+}
+
+static int _parec_migrate_entry(parec_ctx *ctx, const parec_entry *e, const struct stat *p_stat, void *arg __attribute__((__unused__)))
+{
+    parec_stamp stamp;
+
+    _parec_stamp(&stamp, p_stat);
+    return _parec_migrate(ctx, e, &stamp);
+}
+
+int parec_migrate(parec_ctx *ctx, const char *name)
+{
+    parec_entry e = { AT_FDCWD, name, name, -1, DT_UNKNOWN, 0, 0, NULL };
+
+    PAREC_CHECK_CONTEXT(ctx)
+
+    // the digest lengths are needed for the stored checksums
+    if (parec_init_evp(ctx) || _parec_storage_start(ctx) || _parec_workers_start(ctx)) return -1;
+
+    return _parec_visit(ctx, &e, _parec_migrate_entry, NULL);
+}
+
+/* Manifests
+ *
+ * A manifest lists the stored checksums of a tree in the order of the
+ * walk, with the paths relative to the root of the tree ("." for the root
+ * itself) and the fingerprint of each entry. It is written while the tree
+ * is walked, only the previous path is kept in memory.
+ *
+ * The binary manifest:
+ *      8 bytes     magic "PARECMAN"
+ *      1 byte      version
+ *      1 byte      number of digests
+ *      and for each digest:
+ *      1 byte      length of the algorithm name
+ *      n bytes     algorithm name
+ *      1 byte      length of the digest
+ *      then for each entry:
+ *      1 byte      type, 'f' for files and 'd' for directories
+ *      varint      length of the prefix shared with the previous path
+ *      varint      length of the rest of the path
+ *      n bytes     rest of the path
+ *      varint      size
+ *      varint      modification time in seconds (zigzag encoded)
+ *      varint      nanoseconds of the modification time
+ *      n bytes     digests in the order of the header
+ *      and at the end:
+ *      1 byte      zero
+ * The varints are little endian base 128 numbers.
+ *
+ * The text manifest has a line in the format of 'md5sum --tag' for each
+ * algorithm of each file, with the same escaping of the special names.
+ */
+
+static const char MANIFEST_MAGIC[] = "PARECMAN";
+static const unsigned char MANIFEST_VERSION = 1;
+/* Longest path accepted from a manifest. */
+static const uint64_t MANIFEST_PATH_MAX = 1024 * 1024;
+
+// the state of an export
+typedef struct {
+    FILE                        *out;
+    parec_manifest_format       format;
+    const char                  *root;          // name of the root entry
+    size_t                      root_len;       // prefix of the names below the root
+    char                        *prev;          // the previous path
+    size_t                      prev_len;
+    size_t                      prev_cap;
+} parec_export_state;
+
+static void _parec_put_varint(FILE *out, uint64_t value)
+{
+    do {
+        putc((value & 0x7f) | (value > 0x7f ? 0x80 : 0), out);
+        value >>= 7;
+    } while (value);
+}
+
+static int _parec_get_varint(FILE *in, uint64_t *value)
+{
+    int c, shift = 0;
+
+    *value = 0;
+    do {
+        if ((c = getc(in)) == EOF || shift > 63)
+            return -1;
+        *value |= (uint64_t) (c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return 0;
+}
+
+static void _parec_export_header(parec_ctx *ctx, FILE *out)
+{
+    fwrite(MANIFEST_MAGIC, 1, sizeof(MANIFEST_MAGIC) - 1, out);
+    putc(MANIFEST_VERSION, out);
+    putc(ctx->algorithms, out);
+    for (int a = 0; a < ctx->algorithms; a++) {
+        putc(strlen(_parec_stored_name(ctx, a)), out);
+        fputs(_parec_stored_name(ctx, a), out);
+        putc(ctx->dlen[a], out);
+    }
+}
+
+// writing the lines of a file in the format of 'md5sum --tag'
+static void _parec_export_text(parec_ctx *ctx, FILE *out, const char *path, unsigned char **digest)
+{
+    // the names with a backslash or a newline are escaped
+    int escape = (strpbrk(path, "\\\n") != NULL);
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        if (escape)
+            putc('\\', out);
+        for (const char *p = _parec_stored_name(ctx, a); *p; p++) {
+            putc(toupper((unsigned char) *p), out);
+        }
+        fputs(" (", out);
+        for (const char *p = path; *p; p++) {
+            if (*p == '\\')
+                fputs("\\\\", out);
+            else if (*p == '\n')
+                fputs("\\n", out);
+            else
+                putc(*p, out);
+        }
+        fputs(") = ", out);
+        for (unsigned int d = 0; d < ctx->dlen[a]; d++) {
+            fprintf(out, "%02x", digest[a][d]);
+        }
+        putc('\n', out);
+    }
+}
+
+static int _parec_export_binary(parec_ctx *ctx, parec_export_state *st, const char *path, const struct stat *p_stat, unsigned char **digest)
+{
+    size_t len = strlen(path), shared = 0;
+    char *prev;
+
+    while (shared < len && shared < st->prev_len && path[shared] == st->prev[shared]) {
+        shared++;
+    }
+
+    putc(S_ISDIR(p_stat->st_mode) ? 'd' : 'f', st->out);
+    _parec_put_varint(st->out, shared);
+    _parec_put_varint(st->out, len - shared);
+    fwrite(path + shared, 1, len - shared, st->out);
+    _parec_put_varint(st->out, p_stat->st_size);
+    // zigzag encoding of the signed seconds
+    _parec_put_varint(st->out, ((uint64_t) p_stat->st_mtime << 1) ^ (uint64_t) -(p_stat->st_mtime < 0));
+    _parec_put_varint(st->out, p_stat->st_mtim.tv_nsec);
+    for (int a = 0; a < ctx->algorithms; a++) {
+        fwrite(digest[a], 1, ctx->dlen[a], st->out);
+    }
+
+    if (len + 1 > st->prev_cap) {
+        if (!(prev = realloc(st->prev, len + 1))) {
+            PAREC_ERROR(ctx, "parec: out of memory");
+            return -1;
+        }
+        st->prev = prev;
+        st->prev_cap = len + 1;
+    }
+    memcpy(st->prev, path, len + 1);
+    st->prev_len = len;
+    return 0;
+}
+
+static int _parec_export_entry(parec_ctx *ctx, const parec_entry *e, const struct stat *p_stat, void *arg)
+{
+    parec_export_state *st = arg;
+    unsigned char x_digest[ctx->algorithms + 1][EVP_MAX_MD_SIZE];
+    unsigned char *digest[ctx->algorithms + 1];
+    parec_stamp actual, stored;
+    const char *path;
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        digest[a] = x_digest[a];
+    }
+    _parec_stamp(&actual, p_stat);
+    if (ctx->backend->stored(ctx, e, &actual, &stored, digest))
+        return -1;
+    // only the up-to-date checksums are exported
+    if (stored.layout < 0 || !_parec_stamp_equal(&actual, &stored)) {
+        parec_log4c_INFO("checksums of '%s' are not up-to-date, skipping it", e->name);
+        return 0;
+    }
+
+    path = (e->name == st->root) ? "." : e->name + st->root_len;
+    if (st->format == PAREC_MANIFEST_TEXT) {
+        // only the files can be checked, the root file by its own name
+        if (S_ISREG(p_stat->st_mode))
+            _parec_export_text(ctx, st->out, (e->name == st->root) ? e->name : path, digest);
+        return 0;
+    }
+    return _parec_export_binary(ctx, st, path, p_stat, digest);
+}
+
+int parec_export(parec_ctx *ctx, const char *name, const char *manifest, parec_manifest_format format)
+{
+    parec_entry e = { AT_FDCWD, name, name, -1, DT_UNKNOWN, 0, 0, NULL };
+    parec_export_state st;
+    int rc;
+
+    PAREC_CHECK_CONTEXT(ctx)
+
+    if (format != PAREC_MANIFEST_BINARY && format != PAREC_MANIFEST_TEXT) {
+        PAREC_ERROR(ctx, "parec: invalid manifest format: %d", format);
+        return -1;
+    }
+
+    if (parec_init_evp(ctx) || _parec_storage_start(ctx) || _parec_workers_start(ctx)) return -1;
+
+    memset(&st, 0, sizeof(st));
+    st.format = format;
+    st.root = name;
+    st.root_len = strlen(name);
+    // the names below the root are separated by a slash (see _parec_entry_names())
+    if (st.root_len == 0 || name[st.root_len - 1] != '/')
+        st.root_len++;
+    if (!(st.out = fopen(manifest, "w"))) {
+        PAREC_ERROR(ctx, "parec: could not open '%s' with '%s(%d)'", manifest, strerror(errno), errno);
+        return -1;
+    }
+
+    if (format == PAREC_MANIFEST_BINARY)
+        _parec_export_header(ctx, st.out);
+    rc = _parec_visit(ctx, &e, _parec_export_entry, &st);
+    if (format == PAREC_MANIFEST_BINARY)
+        putc(0, st.out);
+
+    if ((ferror(st.out) | fclose(st.out)) && !rc) {
+        PAREC_ERROR(ctx, "parec: writing the manifest '%s' has failed with '%s(%d)'", manifest, strerror(errno), errno);
+        rc = -1;
+    }
+    free(st.prev);
+    return rc;
+}
+
+// reading the header of a binary manifest, 'offset' is set to the offset
+// of the digest of each algorithm of the context in the records, which
+// are 'len' bytes long
+static int _parec_import_header(parec_ctx *ctx, FILE *in, const char *manifest, size_t *offset, size_t *len)
+{
+    char magic[sizeof(MANIFEST_MAGIC)], alg[256];
+    int version, count, n, dlen, a;
+
+    for (a = 0; a < ctx->algorithms; a++) {
+        offset[a] = SIZE_MAX;
+    }
+    *len = 0;
+
+    if (fread(magic, 1, sizeof(MANIFEST_MAGIC) - 1, in) != sizeof(MANIFEST_MAGIC) - 1
+        || memcmp(magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC) - 1)
+        || (version = getc(in)) != MANIFEST_VERSION || (count = getc(in)) == EOF) {
+        PAREC_ERROR(ctx, "parec: '%s' is not a binary manifest", manifest);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if ((n = getc(in)) == EOF || fread(alg, 1, n, in) != (size_t) n || (dlen = getc(in)) == EOF) {
+            PAREC_ERROR(ctx, "parec: the manifest '%s' is truncated", manifest);
+            return -1;
+        }
+        alg[n] = '\0';
+        for (a = 0; a < ctx->algorithms; a++) {
+            if (!strcmp(alg, _parec_stored_name(ctx, a)) && dlen == (int) ctx->dlen[a])
+                offset[a] = *len;
+        }
+        *len += dlen;
+    }
+
+    for (a = 0; a < ctx->algorithms; a++) {
+        if (offset[a] == SIZE_MAX) {
+            PAREC_ERROR(ctx, "parec: the manifest '%s' has no %s checksums", manifest, _parec_stored_name(ctx, a));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// storing the checksums of an entry of the manifest, if its fingerprint
+// matches; returns 1, if it is stored
+static int _parec_import_entry(parec_ctx *ctx, parec_entry *e, int type, uint64_t size, int64_t mtime, uint64_t mtime_nsec, unsigned char **digest)
+{
     struct stat p_stat;
+    parec_stamp actual, stored;
+    int rc;
+
+    // the missing entries are not an error
+    if (fstatat(e->dirfd, e->dname, &p_stat, 0) && (errno == ENOENT || errno == ENOTDIR)) {
+        parec_log4c_INFO("'%s' is missing, skipping it", e->name);
+        return 0;
+    }
+    if (_parec_entry_open(ctx, e, &p_stat))
+        return -1;
+
+    if ((type == 'd' ? !S_ISDIR(p_stat.st_mode) : !S_ISREG(p_stat.st_mode))
+        || (int64_t) p_stat.st_mtime != mtime || (uint64_t) p_stat.st_mtim.tv_nsec != mtime_nsec
+        || (type == 'f' && (uint64_t) p_stat.st_size != size)) {
+        parec_log4c_INFO("'%s' differs from the manifest, skipping it", e->name);
+        _parec_entry_close(e);
+        return 0;
+    }
+
+    _parec_stamp(&actual, &p_stat);
+    rc = ctx->backend->stored(ctx, e, NULL, &stored, NULL);
+    if (!rc)
+        rc = ctx->backend->store(ctx, e, &actual, &stored, digest);
+    _parec_entry_close(e);
+    return rc ? -1 : 1;
+}
+
+// checking, that a path of the manifest stays in the tree: it is "." for
+// the root, otherwise it is relative and it has no empty, "." or ".."
+// components
+static int _parec_import_path_valid(const char *path, size_t len)
+{
+    const char *c = path, *end = path + len, *slash;
+
+    if (len == 1 && path[0] == '.')
+        return 1;
+    if (len == 0 || memchr(path, '\0', len))
+        return 0;
+    for (; c <= end; c = slash + 1) {
+        if (!(slash = memchr(c, '/', end - c)))
+            slash = end;
+        if (slash == c || (slash - c == 1 && c[0] == '.')
+            || (slash - c == 2 && c[0] == '.' && c[1] == '.'))
+            return 0;
+    }
+    return 1;
+}
+
+static int _parec_import(parec_ctx *ctx, const char *root, FILE *in, const char *manifest)
+{
+    size_t offset[ctx->algorithms + 1], len, root_len = strlen(root);
+    unsigned char *digests = NULL, *digest[ctx->algorithms + 1];
+    uint64_t shared, rest, size, mtime, mtime_nsec;
+    char *name = NULL, *p;
+    size_t path_len = 0, name_cap = 0;
+    int type, rc = 0, entries = 0, imported = 0;
+    parec_entry e;
+
+    if (_parec_import_header(ctx, in, manifest, offset, &len))
+        return -1;
+    if (!(digests = malloc(len + 1))) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return -1;
+    }
+    for (int a = 0; a < ctx->algorithms; a++) {
+        digest[a] = digests + offset[a];
+    }
+
+    // the names are the root, a slash and the path of the manifest
+    while (!rc && (type = getc(in)) != 0) {
+        if ((type != 'f' && type != 'd')
+            || _parec_get_varint(in, &shared) || _parec_get_varint(in, &rest)
+            || shared > path_len || shared + rest > MANIFEST_PATH_MAX) {
+            PAREC_ERROR(ctx, "parec: the manifest '%s' is invalid or truncated", manifest);
+            rc = -1;
+            break;
+        }
+        if (root_len + 1 + shared + rest + 1 > name_cap) {
+            name_cap = root_len + 1 + shared + rest + 1;
+            if (!(p = realloc(name, name_cap))) {
+                PAREC_ERROR(ctx, "parec: out of memory");
+                rc = -1;
+                break;
+            }
+            if (!name) {
+                strcpy(p, root);
+                p[root_len] = '/';
+            }
+            name = p;
+        }
+        path_len = shared + rest;
+        name[root_len + 1 + path_len] = '\0';
+        if (fread(name + root_len + 1 + shared, 1, rest, in) != rest
+            || _parec_get_varint(in, &size) || _parec_get_varint(in, &mtime) || _parec_get_varint(in, &mtime_nsec)
+            || fread(digests, 1, len, in) != len
+            || !_parec_import_path_valid(name + root_len + 1, path_len)) {
+            PAREC_ERROR(ctx, "parec: the manifest '%s' is invalid or truncated", manifest);
+            rc = -1;
+            break;
+        }
+
+        e.dirfd = AT_FDCWD;
+        e.parent = NULL;
+        e.name = e.dname = strcmp(name + root_len + 1, ".") ? name : root;
+        e.fd = -1;
+        e.type = DT_UNKNOWN;
+        entries++;
+        // zigzag decoding of the signed seconds
+        if ((rc = _parec_import_entry(ctx, &e, type, size, (int64_t) (mtime >> 1) ^ -(int64_t) (mtime & 1), mtime_nsec, digest)) > 0) {
+            imported++;
+            rc = 0;
+        }
+    }
+    parec_log4c_INFO("imported %d of %d entries of '%s'", imported, entries, manifest);
+
+    free(name);
+    free(digests);
+    return rc;
+}
+
+int parec_import(parec_ctx *ctx, const char *name, const char *manifest)
+{
+    FILE *in;
+    int rc;
+
+    PAREC_CHECK_CONTEXT(ctx)
+
+    if (parec_init_evp(ctx) || _parec_storage_start(ctx)) return -1;
+
+    if (!(in = fopen(manifest, "r"))) {
+        PAREC_ERROR(ctx, "parec: could not open '%s' with '%s(%d)'", manifest, strerror(errno), errno);
+        return -1;
+    }
+    rc = _parec_import(ctx, name, in, manifest);
+    fclose(in);
+    return rc;
+}
+
+/* Differences of trees
+ *
+ * Since the checksum of a directory is calculated from the checksums of
+ * its entries, two trees are compared from the top: only the directories
+ * with different checksums are read, and their entries are matched by
+ * name. Only the stored checksums are used, the files are not read.
+ */
+
+// an entry of a directory of a diff
+typedef struct {
+    char                        *name;
+    unsigned char               type;
+} parec_diff_name;
+
+// the state of a diff
+typedef struct {
+    parec_diff_callback         callback;
+    void                        *arg;
+    int                         reported;       // number of the differences
+} parec_diff_state;
+
+static int _parec_diff_name_cmp(const void *a, const void *b)
+{
+    return strcmp(((const parec_diff_name *) a)->name, ((const parec_diff_name *) b)->name);
+}
+
+static void _parec_diff_names_free(parec_diff_name *names, int count)
+{
+    for (int i = 0; i < count; i++) {
+        free(names[i].name);
+    }
+    free(names);
+}
+
+// reading the entries of a directory, which are not excluded, sorted by
+// their names; returns their number or -1 in case of an error
+static int _parec_diff_names(parec_ctx *ctx, const parec_entry *e, parec_diff_name **p_names)
+{
+    struct dirent64 *p_dirent;
+    parec_diff_name *names = NULL, *n;
+    int count = 0, len = 0, rc = 0;
+    parec_dir *dir;
+
+    if (!(dir = _parec_dir_open(ctx, -1, e)))
+        return -1;
+    while (!rc && (p_dirent = _parec_dir_read(ctx, dir, &rc)) != NULL) {
+        if (_parec_filter(ctx, p_dirent->d_name)) continue;
+        if (count == len) {
+            len = len ? len * 2 : 64;
+            if (!(n = realloc(names, sizeof(*names) * len))) {
+                PAREC_ERROR(ctx, "parec: out of memory");
+                rc = -1;
+                break;
+            }
+            names = n;
+        }
+        if (!(names[count].name = strdup(p_dirent->d_name))) {
+            PAREC_ERROR(ctx, "parec: out of memory");
+            rc = -1;
+            break;
+        }
+        names[count++].type = p_dirent->d_type;
+    }
+    _parec_dir_close(ctx, -1, dir);
+
+    if (rc) {
+        _parec_diff_names_free(names, count);
+        return -1;
+    }
+    qsort(names, count, sizeof(*names), _parec_diff_name_cmp);
+    *p_names = names;
+    return count;
+}
+
+// opening an entry of a diff and loading its stored checksums into 'digest',
+// returns 1, if they are up-to-date, and 0, if they are not
+static int _parec_diff_load(parec_ctx *ctx, parec_entry *e, struct stat *p_stat, unsigned char **digest)
+{
+    parec_stamp actual, stored;
+
+    if (_parec_entry_open(ctx, e, p_stat))
+        return -1;
+    if (e->fd < 0)
+        return 0;
+
+    _parec_stamp(&actual, p_stat);
+    if (ctx->backend->stored(ctx, e, &actual, &stored, digest)) {
+        _parec_entry_close(e);
+        return -1;
+    }
+    return (stored.layout >= 0 && _parec_stamp_equal(&actual, &stored));
+}
+
+static void _parec_diff_report(parec_diff_state *st, const char *path, parec_diff_type type)
+{
+    st->reported++;
+    st->callback(path, type, st->arg);
+}
+
+static int _parec_diff_entry(parec_ctx *ctx, parec_diff_state *st, parec_entry *e_a, parec_entry *e_b, const char *path);
+
+// matching the entries of two directories by their names
+static int _parec_diff_children(parec_ctx *ctx, parec_diff_state *st, const parec_entry *e_a, const parec_entry *e_b, const char *path)
+{
+    parec_diff_name *names_a = NULL, *names_b = NULL;
+    int count_a, count_b, i = 0, j = 0, cmp, rc = 0;
+    char *paths = NULL, *fullname_a = NULL, *fullname_b = NULL;
+    size_t len = 0, len_a, len_b;
+    parec_entry child_a, child_b;
+
+    if ((count_a = _parec_diff_names(ctx, e_a, &names_a)) < 0)
+        return -1;
+    if ((count_b = _parec_diff_names(ctx, e_b, &names_b)) < 0) {
+        _parec_diff_names_free(names_a, count_a);
+        return -1;
+    }
+    // the paths of the entries are relative to the roots
+    if (!strcmp(path, ".") && (paths = malloc(NAME_MAX + 1)))
+        paths[0] = '\0';
+    else if (strcmp(path, "."))
+        paths = _parec_entry_names(ctx, path, &len);
+    else {
+        PAREC_ERROR(ctx, "parec: out of memory");
+    }
+    if (!paths || !(fullname_a = _parec_entry_names(ctx, e_a->name, &len_a)) || !(fullname_b = _parec_entry_names(ctx, e_b->name, &len_b)))
+        rc = -1;
+
+    child_a.dirfd = e_a->fd;
+    child_a.name = fullname_a;
+    child_a.parent = e_a;
+    child_b.dirfd = e_b->fd;
+    child_b.name = fullname_b;
+    child_b.parent = e_b;
+    while (!rc && (i < count_a || j < count_b)) {
+        if (i == count_a)
+            cmp = 1;
+        else if (j == count_b)
+            cmp = -1;
+        else
+            cmp = strcmp(names_a[i].name, names_b[j].name);
+
+        strcpy(paths + len, cmp > 0 ? names_b[j].name : names_a[i].name);
+        if (cmp < 0) {
+            _parec_diff_report(st, paths, PAREC_DIFF_REMOVED);
+            i++;
+        }
+        else if (cmp > 0) {
+            _parec_diff_report(st, paths, PAREC_DIFF_ADDED);
+            j++;
+        }
+        else {
+            strcpy(fullname_a + len_a, names_a[i].name);
+            child_a.dname = fullname_a + len_a;
+            child_a.type = names_a[i++].type;
+            strcpy(fullname_b + len_b, names_b[j].name);
+            child_b.dname = fullname_b + len_b;
+            child_b.type = names_b[j++].type;
+            rc = _parec_diff_entry(ctx, st, &child_a, &child_b, paths);
+        }
+    }
+
+    free(paths);
+    free(fullname_a);
+    free(fullname_b);
+    _parec_diff_names_free(names_a, count_a);
+    _parec_diff_names_free(names_b, count_b);
+    return rc;
+}
+
+// comparing two entries of the same path, which are closed at the end
+static int _parec_diff_entry(parec_ctx *ctx, parec_diff_state *st, parec_entry *e_a, parec_entry *e_b, const char *path)
+{
+    unsigned char x_digest[2][ctx->algorithms + 1][EVP_MAX_MD_SIZE];
+    unsigned char *digest[2][ctx->algorithms + 1];
+    struct stat p_stat_a, p_stat_b;
+    int known_a, known_b, same, reported, rc = 0;
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        digest[0][a] = x_digest[0][a];
+        digest[1][a] = x_digest[1][a];
+    }
+    if ((known_a = _parec_diff_load(ctx, e_a, &p_stat_a, digest[0])) < 0)
+        return -1;
+    if ((known_b = _parec_diff_load(ctx, e_b, &p_stat_b, digest[1])) < 0) {
+        _parec_entry_close(e_a);
+        return -1;
+    }
+
+    same = known_a && known_b;
+    for (int a = 0; same && a < ctx->algorithms; a++) {
+        same = !memcmp(digest[0][a], digest[1][a], ctx->dlen[a]);
+    }
+
+    // the other types have no checksums
+    if (e_a->fd < 0 && e_b->fd < 0) {
+        if ((p_stat_a.st_mode & S_IFMT) != (p_stat_b.st_mode & S_IFMT))
+            _parec_diff_report(st, path, PAREC_DIFF_CHANGED);
+    }
+    else if ((p_stat_a.st_mode & S_IFMT) != (p_stat_b.st_mode & S_IFMT)) {
+        _parec_diff_report(st, path, PAREC_DIFF_CHANGED);
+    }
+    else if (!same && S_ISDIR(p_stat_a.st_mode)) {
+        // the directories are reported, only if their entries do not
+        // explain the difference of their checksums
+        reported = st->reported;
+        rc = _parec_diff_children(ctx, st, e_a, e_b, path);
+        if (!rc && st->reported == reported)
+            _parec_diff_report(st, path, (known_a && known_b) ? PAREC_DIFF_CHANGED : PAREC_DIFF_UNKNOWN);
+    }
+    else if (!same) {
+        _parec_diff_report(st, path, (known_a && known_b) ? PAREC_DIFF_CHANGED : PAREC_DIFF_UNKNOWN);
+    }
+
+    _parec_entry_close(e_a);
+    _parec_entry_close(e_b);
+    return rc;
+}
+
+int parec_diff(parec_ctx *ctx, const char *a, const char *b, parec_diff_callback callback, void *arg)
+{
+    parec_entry e_a = { AT_FDCWD, a, a, -1, DT_UNKNOWN, 0, 0, NULL };
+    parec_entry e_b = { AT_FDCWD, b, b, -1, DT_UNKNOWN, 0, 0, NULL };
+    parec_diff_state st = { callback, arg, 0 };
+
+    PAREC_CHECK_CONTEXT(ctx)
+
+    if (!callback) {
+        PAREC_ERROR(ctx, "parec: the callback of the diff is not set");
+        return -1;
+    }
+
+    if (parec_init_evp(ctx) || _parec_storage_start(ctx) || _parec_workers_start(ctx)) return -1;
+
+    return _parec_diff_entry(ctx, &st, &e_a, &e_b, ".");
+}
+
+// creating the digest context of an algorithm
+static int _parec_md_create(parec_ctx *ctx, parec_md *md_ctx, int a)
+{
+    if (ctx->native_algorithm[a])
+        md_ctx[a].native = ctx->native_algorithm[a]->create(ctx);
+    else
+        md_ctx[a].evp = EVP_MD_CTX_create();
+
+    if (ctx->native_algorithm[a] ? !md_ctx[a].native : !md_ctx[a].evp) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return -1;
+    }
+    return 0;
+}
+
+static int _parec_md_init(parec_ctx *ctx, parec_md *md_ctx, int a)
+{
+    if (ctx->native_algorithm[a]) {
+        ctx->native_algorithm[a]->init(md_ctx[a].native);
+    }
+    else if (EVP_DigestInit_ex(md_ctx[a].evp, ctx->evp_algorithm[a], NULL) != 1) {
+        PAREC_ERROR(ctx, "parec: initializing digest '%s' has failed", ctx->algorithm[a]);
+        return -1;
+    }
+    return 0;
+}
+
+static int _parec_md_update(parec_ctx *ctx, parec_md *md_ctx, int a, const void *data, size_t len)
+{
+    parec_tick tick;
+
+    _parec_tick(ctx, &tick);
+    if (ctx->native_algorithm[a]) {
+        ctx->native_algorithm[a]->update(md_ctx[a].native, data, len);
+    }
+    else if (EVP_DigestUpdate(md_ctx[a].evp, data, len) != 1) {
+        PAREC_ERROR(ctx, "parec: calculating digest '%s' has failed", ctx->algorithm[a]);
+        return -1;
+    }
+    _parec_tock(ctx, &tick, PAREC_PHASE_DIGEST);
+    _parec_count_bytes(ctx, a, len);
+    return 0;
+}
+
+// the digest of ctx->dlen[a] bytes
+static int _parec_md_final(parec_ctx *ctx, parec_md *md_ctx, int a, unsigned char *digest)
+{
+    if (ctx->native_algorithm[a]) {
+        ctx->native_algorithm[a]->final(md_ctx[a].native, digest);
+    }
+    else if (EVP_DigestFinal(md_ctx[a].evp, digest, NULL) != 1) {
+        PAREC_ERROR(ctx, "parec: finalizing digest '%s' has failed", ctx->algorithm[a]);
+        return -1;
+    }
+    return 0;
+}
+
+static void _parec_md_destroy(parec_ctx *ctx, parec_md *md_ctx)
+{
+    if (!md_ctx)
+        return;
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        if (ctx->native_algorithm[a])
+            ctx->native_algorithm[a]->destroy(md_ctx[a].native);
+        else if (md_ctx[a].evp)
+            EVP_MD_CTX_destroy(md_ctx[a].evp);
+    }
+    free(md_ctx);
+}
+
+/* Resources of the workers
+ *
+ * Every worker thread of the pool, and the calling thread as the last one,
+ * owns a set of resources: digest contexts, buffers, read-ahead rings,
+ * io_uring engine and the nodes of the tree walk. They are kept from entry
+ * to entry and from one processing to the next, so the processing of a file
+ * or a directory does not allocate memory in the steady state. Since every
+ * worker uses only its own resources, they need no locking. The resources
+ * are released, when the threads, the buffers or the I/O method change.
+ */
+
+typedef struct _parec_node parec_node;
+typedef struct _parec_batch parec_batch;
+
+typedef struct {
+    parec_ctx                   *ctx;
+    unsigned int                *dlen;          // digest length of each algorithm
+    int                         failed;         // stops processing at the first error
+} parec_walk;
+
+// the failure flag is shared by all workers
+#define PAREC_WALK_FAILED(walk)     __sync_fetch_and_or(&(walk)->failed, 0)
+#define PAREC_WALK_FAIL(walk)       __sync_fetch_and_or(&(walk)->failed, 1)
+
+struct _parec_node {
+    parec_walk                  *walk;
+    parec_node                  *parent;        // also links the free nodes of a worker
+    int                         slot;           // index in the digest arrays of the parent
+    char                        *name;
+    size_t                      name_len;       // allocation length of the name
+    parec_entry                 entry;          // the entry relative to the parent
+    parec_stamp                 start;          // fingerprint at the beginning
+    parec_stamp                 stored;         // stored fingerprint
+    parec_md                    *md_ctx;
+    int                         count;          // number of directory entries
+    int                         pending;        // number of unfinished directory entries
+    unsigned char               **digest;       // digest arrays of the directory entries
+    int                         digest_len;     // allocation length of the digest arrays
+};
+
+// a batch of regular files of a directory for a worker
+struct _parec_batch {
+    parec_batch                 *next;          // links the free batches of a worker
+    int                         count;
+    parec_node                  *node[];
+};
+
+// a reader of a directory for a worker
+struct _parec_dir {
+    parec_dir                   *next;          // links the free readers of a worker
+    const parec_entry           *e;             // the opened directory
+    size_t                      pos;            // of the next record in the buffer
+    size_t                      end;            // of the records in the buffer
+    uint64_t                    buffer[];       // DIR_BUFLEN bytes, aligned for the records
+};
+
+struct _parec_worker {
+    parec_uring                 *uring;         // io_uring engine, if it is used
+    unsigned char               *buffer;        // page aligned buffer of BUFLEN
+    parec_ring                  *ring[2];       // read-ahead rings with one and with all consumers
+    parec_md                    **md;           // free digest contexts
+    int                         mds;            // number of free digest contexts
+    int                         md_len;         // allocation length of the md array
+    parec_node                  *node;          // free nodes
+    parec_batch                 *batch;         // free batches
+    parec_dir                   *dir;           // free directory readers
+    parec_node                  **child;        // entries of the directory being scanned
+    int                         child_len;      // allocation length of the child array
+};
+
+static void _parec_node_destroy(parec_ctx *ctx, parec_node *node)
+{
+    if (node->digest) {
+        for (int a = 0; a < ctx->algorithms; a++) {
+            free(node->digest[a]);
+        }
+        free(node->digest);
+    }
+    _parec_md_destroy(ctx, node->md_ctx);
+    free(node->name);
+    free(node);
+}
+
+static void _parec_workers_stop(parec_ctx *ctx)
+{
+    parec_worker *w;
+    parec_node *node;
+    parec_batch *batch;
+    parec_dir *dir;
+
+    if (!ctx->worker)
+        return;
+
+    for (int i = 0; i < ctx->workers; i++) {
+        w = &ctx->worker[i];
+        if (parec_uring_free(w->uring))
+            parec_log4c_WARN("parec: reads of io_uring could not be waited out, leaking its buffers: %s(%d)", strerror(errno), errno);
+        free(w->buffer);
+        parec_ring_free(w->ring[0]);
+        parec_ring_free(w->ring[1]);
+        for (int m = 0; m < w->mds; m++) {
+            _parec_md_destroy(ctx, w->md[m]);
+        }
+        free(w->md);
+        while ((node = w->node)) {
+            w->node = node->parent;
+            _parec_node_destroy(ctx, node);
+        }
+        while ((batch = w->batch)) {
+            w->batch = batch->next;
+            free(batch);
+        }
+        while ((dir = w->dir)) {
+            w->dir = dir->next;
+            free(dir);
+        }
+        free(w->child);
+    }
+    _parec_chunk_team_free(ctx, ctx->chunk_team);
+    ctx->chunk_team = NULL;
+    // after the digest contexts, which use it
+    parec_blake3_team_free(ctx->team);
+    ctx->team = NULL;
+    free(ctx->worker);
+    ctx->worker = NULL;
+    ctx->workers = 0;
+    ctx->use_uring = 0;
+}
+
+// the number of buffers of the io_uring engines, 0 if they are not used
+static int _parec_uring_depth(parec_ctx *ctx)
+{
+    if (!ctx->use_uring)
+        return 0;
+    return ctx->pipeline > 1 ? ctx->pipeline : URING_DEPTH;
+}
+
+// the small files are digested together by the multi-buffer engine
+static int _parec_mb_used(parec_ctx *ctx)
+{
+    return ctx->multi_buffer && ctx->mb_algorithms > 0;
+}
+
+// the number of regular files processed together by a worker: the reads
+// of the io_uring engine or the inputs of the multi-buffer engine, 0 if
+// they are processed one by one
+static int _parec_batch_len(parec_ctx *ctx)
+{
+    int depth = _parec_uring_depth(ctx);
+
+    // the chunked files are read one by one
+    if (ctx->chunk_size > 0)
+        return 0;
+    if (depth > 1)
+        return depth;
+    return _parec_mb_used(ctx) ? MB_BATCH : 0;
+}
+
+// preparing the resources of each worker and the calling thread at the
+// beginning of the processing, and falling back to stdio, if io_uring
+// is requested, but it is not available at all
+static int _parec_workers_start(parec_ctx *ctx)
+{
+    parec_worker *w;
+    int n;
+
+    if (ctx->worker)
+        return 0;
+
+    n = (ctx->threads > 1 ? ctx->threads : 0) + 1;
+    if (!(ctx->worker = calloc(sizeof(*(ctx->worker)), n))) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return -1;
+    }
+    ctx->workers = n;
+
+    // the engine of the calling thread is used for probing
+    if (ctx->io == PAREC_IO_URING) {
+        ctx->use_uring = 1;
+        w = &ctx->worker[n - 1];
+        if (!(w->uring = parec_uring_new(_parec_uring_depth(ctx), BUFLEN))) {
+            parec_log4c_WARN("parec: io_uring is not available, falling back to stdio: %s(%d)", strerror(errno), errno);
+            ctx->use_uring = 0;
+        }
+    }
+
+    // the team is shared by the workers, one large file at a time
+    if (ctx->tree_threads > 1 && !(ctx->team = parec_blake3_team_new(ctx->tree_threads))) {
+        parec_log4c_WARN("parec: could not start the tree hashing threads: %s(%d)", strerror(errno), errno);
+    }
+    if (ctx->tree_threads > 1 && ctx->chunk_size > 0 && !(ctx->chunk_team = _parec_chunk_team_new(ctx, ctx->tree_threads - 1))) {
+        parec_log4c_WARN("parec: could not start the chunk hashing threads: %s(%d)", strerror(errno), errno);
+    }
+
+    return 0;
+}
+
+// the resources of a worker, or the calling thread for -1
+static parec_worker *_parec_worker(parec_ctx *ctx, int worker)
+{
+    if (worker < 0 || worker >= ctx->workers - 1)
+        return &ctx->worker[ctx->workers - 1];
+    return &ctx->worker[worker];
+}
+
+// the engine of a worker, NULL means reading through stdio
+static parec_uring *_parec_uring_get(parec_ctx *ctx, int worker)
+{
+    parec_worker *w;
+
+    if (!ctx->use_uring)
+        return NULL;
+
+    w = _parec_worker(ctx, worker);
+    if (!w->uring && !(w->uring = parec_uring_new(_parec_uring_depth(ctx), BUFLEN))) {
+        parec_log4c_WARN("parec: could not start io_uring, falling back to stdio: %s(%d)", strerror(errno), errno);
+    }
+    // the completions of the reads, which could not be waited out, would
+    // be taken for the ones of the next file, so the ring is not reused
+    if (w->uring && parec_uring_get_pending(w->uring) > 0)
+        return NULL;
+    return w->uring;
+}
+
+// the page aligned buffer of a worker
+static unsigned char *_parec_buffer_get(parec_ctx *ctx, int worker)
+{
+    parec_worker *w = _parec_worker(ctx, worker);
+    void *buffer;
+
+    if (!w->buffer) {
+        if (posix_memalign(&buffer, DIRECT_ALIGN, BUFLEN)) {
+            PAREC_ERROR(ctx, "parec: out of memory");
+            return NULL;
+        }
+        w->buffer = buffer;
+    }
+    return w->buffer;
+}
+
+// the read-ahead ring of a worker for the given number of consumers
+static parec_ring *_parec_ring_get(parec_ctx *ctx, int worker, int consumers)
+{
+    parec_worker *w = _parec_worker(ctx, worker);
+    int r = (consumers > 1) ? 1 : 0;
+
+    if (!w->ring[r] && !(w->ring[r] = parec_ring_new(ctx->pipeline > 1 ? ctx->pipeline : PIPELINE_LEN, BUFLEN, consumers))) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return NULL;
+    }
+    parec_ring_reset(w->ring[r]);
+    return w->ring[r];
+}
+
+// getting an initialized digest context for each algorithm
+static parec_md *_parec_md_new(parec_ctx *ctx, int worker)
+{
+    parec_worker *w = _parec_worker(ctx, worker);
+    parec_md *md_ctx;
+
+    if (w->mds > 0) {
+        md_ctx = w->md[--w->mds];
+    }
+    else {
+        md_ctx = calloc(sizeof(*md_ctx), ctx->algorithms ? ctx->algorithms : 1);
+        if (!md_ctx) {
+            PAREC_ERROR(ctx, "parec: out of memory");
+            return NULL;
+        }
+        for (int a = 0; a < ctx->algorithms; a++) {
+            if (_parec_md_create(ctx, md_ctx, a)) {
+                _parec_md_destroy(ctx, md_ctx);
+                return NULL;
+            }
+        }
+    }
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        if (_parec_md_init(ctx, md_ctx, a)) {
+            _parec_md_destroy(ctx, md_ctx);
+            return NULL;
+        }
+    }
+
+    return md_ctx;
+}
+
+// returning the digest contexts to a worker
+static void _parec_md_free(parec_ctx *ctx, int worker, parec_md *md_ctx)
+{
+    parec_worker *w = _parec_worker(ctx, worker);
+    parec_md **tmp;
+
+    if (!md_ctx)
+        return;
+
+    if (w->mds == w->md_len) {
+        if (!(tmp = realloc(w->md, sizeof(*tmp) * (w->md_len ? w->md_len * 2 : 16)))) {
+            _parec_md_destroy(ctx, md_ctx);
+            return;
+        }
+        w->md = tmp;
+        w->md_len = w->md_len ? w->md_len * 2 : 16;
+    }
+    w->md[w->mds++] = md_ctx;
+}
+
+// getting a node for the entry 'dname' of the directory 'dirname',
+// the parent has to be opened already
+static parec_node *_parec_node_new(parec_walk *walk, int worker, parec_node *parent, int slot, const char *dirname, const char *dname)
+{
+    parec_worker *w = _parec_worker(walk->ctx, worker);
+    parec_node *node;
+    size_t len, name_len;
+    char *tmp;
+
+    if ((node = w->node)) {
+        w->node = node->parent;
+    }
+    else if (!(node = calloc(sizeof(*node), 1))) {
+        return NULL;
+    }
+
+    node->walk = walk;
+    node->parent = parent;
+    node->slot = slot;
+    node->start.layout = -1;
+    node->stored.layout = -1;
+    node->count = 0;
+    node->pending = 0;
+
+    // joining the directory and the entry names
+    len = strlen(dirname);
+    name_len = len + (dname ? strlen(dname) + 2 : 1);
+    if (node->name_len < name_len) {
+        if (!(tmp = realloc(node->name, name_len))) {
+            node->parent = w->node;
+            w->node = node;
+            return NULL;
+        }
+        node->name = tmp;
+        node->name_len = name_len;
+    }
+    strcpy(node->name, dirname);
+    if (dname) {
+        if (len == 0 || dirname[len - 1] != '/')
+            node->name[len++] = '/';
+        strcpy(node->name + len, dname);
+    }
+
+    // the entries are opened relative to their parent, which is kept open
+    node->entry.dirfd = parent ? parent->entry.fd : AT_FDCWD;
+    node->entry.dname = dname ? node->name + len : node->name;
+    node->entry.name = node->name;
+    node->entry.fd = -1;
+    node->entry.type = DT_UNKNOWN;
+    node->entry.parent = parent ? &parent->entry : NULL;
+
+    return node;
+}
+
+// returning a node to a worker
+static void _parec_node_free(parec_node *node, int worker)
+{
+    parec_ctx *ctx = node->walk->ctx;
+    parec_worker *w = _parec_worker(ctx, worker);
+
+    _parec_md_free(ctx, worker, node->md_ctx);
+    node->md_ctx = NULL;
+    _parec_entry_close(&node->entry);
+    node->parent = w->node;
+    w->node = node;
+}
+
+// the length of a slot of the digest arrays: the C strings of V1 have
+// a terminating zero byte, V2 is contiguous
+static size_t _parec_digest_stride(parec_ctx *ctx, int a)
+{
+    return ctx->dir_digest == PAREC_DIR_DIGEST_V1 ? ctx->dlen[a] + 1 : ctx->dlen[a];
+}
+
+// preparing the digest arrays of a directory for at least 'count' entries;
+// the existing digests are kept and the new slots are zeroed, so the byte
+// terminating each digest is always zero
+static int _parec_node_digests(parec_node *node, int count)
+{
+    parec_ctx *ctx = node->walk->ctx;
+    unsigned char *tmp;
+    int len = count ? count : 1;
+    size_t stride;
+
+    if (!node->digest) {
+        if (!(node->digest = calloc(sizeof(*(node->digest)), ctx->algorithms ? ctx->algorithms : 1))) {
+            PAREC_ERROR(ctx, "parec: out of memory");
+            return -1;
+        }
+        node->digest_len = 0;
+    }
+    if (node->digest_len < len) {
+        for (int a = 0; a < ctx->algorithms; a++) {
+            stride = _parec_digest_stride(ctx, a);
+            if (!(tmp = realloc(node->digest[a], stride * len))) {
+                PAREC_ERROR(ctx, "parec: out of memory");
+                return -1;
+            }
+            memset(tmp + stride * node->digest_len, 0, stride * (len - node->digest_len));
+            node->digest[a] = tmp;
+        }
+        node->digest_len = len;
+    }
+
+    return 0;
+}
+
+/* Smallest number of digests sorted by radix sort instead of insertion. */
+static const size_t RADIX_MIN = 32;
+
+// sorting 'count' digests of 'width' bytes by memcmp(), which are equal
+// up to byte 'depth', by their next byte into buckets through 'tmp', and
+// the small buckets by insertion
+static void _parec_radix_sort(unsigned char *base, size_t count, size_t width, size_t depth, unsigned char *tmp)
+{
+    size_t start[257], pos[256], i, j;
+    unsigned char key[width];
+
+    if (depth == width)
+        return;
+
+    if (count < RADIX_MIN) {
+        for (i = 1; i < count; i++) {
+            for (j = i; j > 0 && memcmp(base + (j - 1) * width + depth, base + i * width + depth, width - depth) > 0; j--)
+                ;
+            if (j < i) {
+                memcpy(key, base + i * width, width);
+                memmove(base + (j + 1) * width, base + j * width, (i - j) * width);
+                memcpy(base + j * width, key, width);
+            }
+        }
+        return;
+    }
+
+    memset(start, 0, sizeof(start));
+    for (i = 0; i < count; i++) {
+        start[base[i * width + depth] + 1]++;
+    }
+    // the digests are moved only, if they are in more than one bucket
+    if (start[base[depth] + 1] < count) {
+        for (i = 1; i < 257; i++) {
+            start[i] += start[i - 1];
+        }
+        memcpy(pos, start, sizeof(pos));
+        for (i = 0; i < count; i++) {
+            memcpy(tmp + pos[base[i * width + depth]]++ * width, base + i * width, width);
+        }
+        memcpy(base, tmp, count * width);
+    }
+    else {
+        start[0] = 0;
+        for (i = 1; i < 257; i++) {
+            start[i] = (i - 1 < base[depth]) ? 0 : count;
+        }
+    }
+
+    for (i = 0; i < 256; i++) {
+        if (start[i + 1] - start[i] > 1)
+            _parec_radix_sort(base + start[i] * width, start[i + 1] - start[i], width, depth + 1, tmp);
+    }
+}
+
+// sorting the digest array of an algorithm of a directory
+static int _parec_digest_sort(parec_ctx *ctx, int a, unsigned char *digest, int count)
+{
+    unsigned char *tmp = NULL;
+    parec_tick tick;
+
+    _parec_tick(ctx, &tick);
+    if (ctx->dir_digest == PAREC_DIR_DIGEST_V1) {
+        qsort(digest, count, ctx->dlen[a] + 1, (__compar_fn_t)strcmp);
+    }
+    else {
+        if ((size_t) count >= RADIX_MIN && !(tmp = malloc((size_t) count * ctx->dlen[a]))) {
+            PAREC_ERROR(ctx, "parec: out of memory");
+            return -1;
+        }
+        _parec_radix_sort(digest, count, ctx->dlen[a], 0, tmp);
+        free(tmp);
+    }
+    _parec_tock(ctx, &tick, PAREC_PHASE_SORT);
+
+    return 0;
+}
+
+/* Smallest number of digests in a sorted run of a directory. */
+static const long long SPILL_MIN = 16;
+
+// the digests of a directory above the memory budget are written as
+// sorted runs into an unlinked temporary file, each run holding the
+// sorted arrays of all the algorithms one after the other
+typedef struct {
+    FILE                        *file;          // NULL until the first run
+    int                         runs;
+    int                         runs_len;       // allocation length of the arrays
+    off_t                       *offset;        // of each run
+    int                         *count;         // number of digests of each run
+} parec_spill;
+
+// the position of the merge in a run
+typedef struct {
+    unsigned char               *buf;
+    int                         pos;            // of the next digest in the buffer
+    int                         len;            // number of digests in the buffer
+    int                         left;           // number of digests not yet read
+    off_t                       offset;         // of the next digest to read
+} parec_run;
+
+// the number of digests of a directory kept in memory, 0 if unlimited;
+// the radix sort of V2 needs a second array for one algorithm
+static int _parec_spill_cap(parec_ctx *ctx)
+{
+    size_t width = 0, tmp = 0;
+    long long cap;
+
+    if (!ctx->memory_budget || !ctx->algorithms)
+        return 0;
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        width += _parec_digest_stride(ctx, a);
+        if (ctx->dir_digest == PAREC_DIR_DIGEST_V2 && ctx->dlen[a] > tmp)
+            tmp = ctx->dlen[a];
+    }
+    cap = ctx->memory_budget / (long long) (width + tmp);
+
+    if (cap < SPILL_MIN)
+        return SPILL_MIN;
+    return cap > INT_MAX / 2 ? INT_MAX / 2 : cap;
+}
+
+// sorting the digest arrays and writing them as the next run
+static int _parec_spill_run(parec_ctx *ctx, parec_spill *spill, unsigned char **digest, int count)
+{
+    const char *dir = getenv("TMPDIR");
+    char *name;
+    size_t len;
+    void *tmp;
+    int fd;
+
+    if (!spill->file) {
+        if (!dir || !dir[0])
+            dir = "/tmp";
+        if (!(name = malloc(strlen(dir) + 20))) {
+            PAREC_ERROR(ctx, "parec: out of memory");
+            return -1;
+        }
+        sprintf(name, "%s/parec-runs-XXXXXX", dir);
+        if ((fd = mkstemp(name)) < 0 || !(spill->file = fdopen(fd, "w+"))) {
+            PAREC_ERROR(ctx, "parec: creating the temporary file '%s' has failed with '%s(%d)'", name, strerror(errno), errno);
+            if (fd >= 0) {
+                close(fd);
+                unlink(name);
+            }
+            free(name);
+            return -1;
+        }
+        // the runs are needed only through the open file
+        unlink(name);
+        free(name);
+    }
+
+    if (spill->runs == spill->runs_len) {
+        len = spill->runs_len ? spill->runs_len * 2 : 16;
+        if (!(tmp = realloc(spill->offset, sizeof(*(spill->offset)) * len))) {
+            PAREC_ERROR(ctx, "parec: out of memory");
+            return -1;
+        }
+        spill->offset = tmp;
+        if (!(tmp = realloc(spill->count, sizeof(*(spill->count)) * len))) {
+            PAREC_ERROR(ctx, "parec: out of memory");
+            return -1;
+        }
+        spill->count = tmp;
+        spill->runs_len = len;
+    }
+
+    spill->offset[spill->runs] = ftello(spill->file);
+    spill->count[spill->runs] = count;
+    for (int a = 0; a < ctx->algorithms; a++) {
+        len = count * _parec_digest_stride(ctx, a);
+        if (_parec_digest_sort(ctx, a, digest[a], count))
+            return -1;
+        if (fwrite(digest[a], 1, len, spill->file) != len) {
+            PAREC_ERROR(ctx, "parec: writing the sorted digests has failed with '%s(%d)'", strerror(errno), errno);
+            return -1;
+        }
+    }
+    spill->runs++;
+    parec_log4c_DEBUG("spilled run %d of %d digests", spill->runs, count);
+
+    return 0;
+}
+
+// reading the next digests of a run into its buffer
+static int _parec_run_read(parec_ctx *ctx, parec_spill *spill, parec_run *run, size_t stride, int len)
+{
+    size_t done = 0, want;
+    ssize_t n;
+
+    run->pos = 0;
+    run->len = run->left < len ? run->left : len;
+    want = run->len * stride;
+    while (done < want) {
+        if ((n = pread(fileno(spill->file), run->buf + done, want - done, run->offset + done)) <= 0) {
+            PAREC_ERROR(ctx, "parec: reading the sorted digests has failed with '%s(%d)'", n ? strerror(errno) : "end of file", n ? errno : 0);
+            return -1;
+        }
+        done += n;
+    }
+    run->offset += want;
+    run->left -= run->len;
+
+    return 0;
+}
+
+// the order of the current digests of two runs, which is the same as the
+// one of the sort in memory, the equal ones are taken by their run
+static int _parec_run_less(parec_ctx *ctx, int a, const parec_run *run, int x, int y)
+{
+    size_t stride = _parec_digest_stride(ctx, a);
+    const unsigned char *dx = run[x].buf + run[x].pos * stride, *dy = run[y].buf + run[y].pos * stride;
+    int c;
+
+    if (ctx->dir_digest == PAREC_DIR_DIGEST_V1)
+        c = strcmp((const char *) dx, (const char *) dy);
+    else
+        c = memcmp(dx, dy, ctx->dlen[a]);
+
+    return c < 0 || (c == 0 && x < y);
+}
+
+// restoring the heap of the runs from position 'i' downwards
+static void _parec_run_sift(parec_ctx *ctx, int a, const parec_run *run, int *heap, int n, int i)
+{
+    int child, top = heap[i];
+
+    while ((child = 2 * i + 1) < n) {
+        if (child + 1 < n && _parec_run_less(ctx, a, run, heap[child + 1], heap[child]))
+            child++;
+        if (!_parec_run_less(ctx, a, run, heap[child], top))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = top;
+}
+
+// merging the sorted runs of an algorithm into the digest of the directory,
+// the buffers of the runs share the memory budget
+static int _parec_spill_merge(parec_ctx *ctx, parec_spill *spill, int a, parec_md *md_ctx)
+{
+    size_t stride = _parec_digest_stride(ctx, a), before = 0;
+    char hex[EVP_MAX_MD_SIZE*2+1];
+    parec_run *run;
+    unsigned char *buf;
+    int *heap, n = 0, i, rc = 0;
+    long long len;
+
+    for (int b = 0; b < a; b++) {
+        before += _parec_digest_stride(ctx, b);
+    }
+    if (fflush(spill->file)) {
+        PAREC_ERROR(ctx, "parec: writing the sorted digests has failed with '%s(%d)'", strerror(errno), errno);
+        return -1;
+    }
+    len = ctx->memory_budget / ((long long) spill->runs * stride);
+    if (len > spill->count[0])
+        len = spill->count[0];
+    if (len < 1)
+        len = 1;
+
+    run = calloc(spill->runs, sizeof(*run));
+    heap = malloc(sizeof(*heap) * spill->runs);
+    buf = malloc(spill->runs * len * stride);
+    if (!run || !heap || !buf) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        free(run);
+        free(heap);
+        free(buf);
+        return -1;
+    }
+
+    for (i = 0; !rc && i < spill->runs; i++) {
+        run[i].buf = buf + i * len * stride;
+        run[i].left = spill->count[i];
+        run[i].offset = spill->offset[i] + spill->count[i] * before;
+        if (!(rc = _parec_run_read(ctx, spill, &run[i], stride, len)) && run[i].len)
+            heap[n++] = i;
+    }
+    for (i = n / 2 - 1; !rc && i >= 0; i--) {
+        _parec_run_sift(ctx, a, run, heap, n, i);
+    }
+
+    while (!rc && n) {
+        i = heap[0];
+        if (_parec_md_update(ctx, md_ctx, a, run[i].buf + run[i].pos * stride, ctx->dlen[a])) {
+            rc = -1;
+            break;
+        }
+        parec_log4c_DEBUG("%s(%d) = 0x%s", ctx->xattr_algorithm[a], i, _parec_hex(hex, run[i].buf + run[i].pos * stride, ctx->dlen[a]));
+        if (++run[i].pos == run[i].len) {
+            if (run[i].left)
+                rc = _parec_run_read(ctx, spill, &run[i], stride, len);
+            else
+                heap[0] = heap[--n];
+        }
+        if (n)
+            _parec_run_sift(ctx, a, run, heap, n, 0);
+    }
+
+    free(run);
+    free(heap);
+    free(buf);
+
+    return rc;
+}
+
+// releasing the runs of a directory
+static void _parec_spill_free(parec_spill *spill)
+{
+    if (spill->file)
+        fclose(spill->file);
+    free(spill->offset);
+    free(spill->count);
+}
+
+// getting an empty batch
+static parec_batch *_parec_batch_new(parec_ctx *ctx, int worker)
+{
+    parec_worker *w = _parec_worker(ctx, worker);
+    parec_batch *batch;
+
+    if ((batch = w->batch))
+        w->batch = batch->next;
+    else if (!(batch = malloc(sizeof(*batch) + sizeof(*(batch->node)) * _parec_batch_len(ctx))))
+        return NULL;
+
+    batch->count = 0;
+    return batch;
+}
+
+// returning a batch to a worker
+static void _parec_batch_free(parec_ctx *ctx, int worker, parec_batch *batch)
+{
+    parec_worker *w = _parec_worker(ctx, worker);
+
+    batch->next = w->batch;
+    w->batch = batch;
+}
+
+/* Reading the directories
+ *
+ * The directories are read by getdents64(2) into a large buffer, so even
+ * a huge directory takes only a few system calls, and the types of the
+ * entries are passed on to the walk. The readers are kept by the workers.
+ */
+
+// starting to read the opened directory 'e'
+static parec_dir *_parec_dir_open(parec_ctx *ctx, int worker, const parec_entry *e)
+{
+    parec_worker *w = _parec_worker(ctx, worker);
+    parec_dir *dir;
+
+    if ((dir = w->dir)) {
+        w->dir = dir->next;
+    }
+    else if (!(dir = malloc(sizeof(*dir) + DIR_BUFLEN))) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return NULL;
+    }
+
+    dir->e = e;
+    dir->pos = 0;
+    dir->end = 0;
+    return dir;
+}
+
+// the next entry of the directory, or NULL at the end and after an error,
+// which is also returned in 'rc'
+static struct dirent64 *_parec_dir_read(parec_ctx *ctx, parec_dir *dir, int *rc)
+{
+    struct dirent64 *p_dirent;
+    parec_tick tick;
+    long n;
+
+    if (dir->pos >= dir->end) {
+        _parec_tick(ctx, &tick);
+        n = syscall(SYS_getdents64, dir->e->fd, dir->buffer, DIR_BUFLEN);
+        _parec_tock(ctx, &tick, PAREC_PHASE_DIRECTORY);
+        if (n < 0) {
+            PAREC_ERROR(ctx, "parec: reading directory '%s' has failed with '%s(%d)'", dir->e->name, strerror(errno), errno);
+            *rc = -1;
+            return NULL;
+        }
+        if (n == 0)
+            return NULL;
+        dir->pos = 0;
+        dir->end = n;
+    }
+
+    p_dirent = (struct dirent64 *) ((unsigned char *) dir->buffer + dir->pos);
+    dir->pos += p_dirent->d_reclen;
+    return p_dirent;
+}
+
+// returning a reader to a worker, the directory itself is left open
+static void _parec_dir_close(parec_ctx *ctx, int worker, parec_dir *dir)
+{
+    parec_worker *w = _parec_worker(ctx, worker);
+
+    dir->next = w->dir;
+    w->dir = dir;
+}
+
+static int _parec_process(parec_ctx *ctx, parec_entry *e, unsigned char **out);
+static int _parec_process_batch(parec_node **node, int count);
+
+// processing one block with every 'step'th algorithm starting from 'first'
+static int _parec_update(parec_ctx *ctx, parec_md *md_ctx, const unsigned char *buffer, size_t n, int first, int step)
+{
+    for (int a = first; a < ctx->algorithms; a += step) {
+        if (_parec_md_update(ctx, md_ctx, a, buffer, n))
+            return -1;
+    }
+    return 0;
+}
+
+// processing a small file with the algorithms, which are not calculated
+// by the multi-buffer engine
+static int _parec_update_single(parec_ctx *ctx, parec_md *md_ctx, const unsigned char *buffer, size_t n)
+{
+    for (int a = 0; a < ctx->algorithms; a++) {
+        if (ctx->mb_algorithm[a] < 0 && _parec_md_update(ctx, md_ctx, a, buffer, n))
+            return -1;
+    }
+    return 0;
+}
+
+/* Reading the files
+ *
+ * A file is read through a source, which applies the cache policy of the
+ * context. With DROP_BEHIND the pages are dropped from the page cache as
+ * soon as they are read. With DIRECT the file is opened once more with
+ * O_DIRECT and only the unaligned parts (typically the tail of the file)
+ * are read through the page cache, which are then dropped as well.
+ */
+
+typedef struct {
+    parec_ctx                   *ctx;
+    const char                  *filename;
+    int                         fd;
+    int                         buffered;       // descriptor of the entry without O_DIRECT
+    int                         direct;         // fd is opened with O_DIRECT
+    off_t                       offset;         // of the next sequential read
+} parec_source;
+
+// reading the opened file 'e'
+static int _parec_source_open(parec_ctx *ctx, parec_source *src, const parec_entry *e, int allow_direct)
+{
+    int err;
+
+    src->ctx = ctx;
+    src->filename = e->name;
+    src->offset = 0;
+    src->direct = allow_direct && ctx->cache == PAREC_CACHE_DIRECT;
+    src->fd = e->fd;
+    src->buffered = e->fd;
+
+    // not every file system supports direct I/O
+    if (src->direct && (src->fd = openat(e->dirfd, e->dname, O_RDONLY | O_DIRECT)) < 0) {
+        if (errno != EINVAL) {
+            PAREC_ERROR(ctx, "parec: could not open file '%s' with '%s(%d)'", e->name, strerror(errno), errno);
+            return -1;
+        }
+        parec_log4c_DEBUG("direct I/O is not supported for '%s'", e->name);
+        src->direct = 0;
+        src->fd = e->fd;
+    }
+
+    // giving some hints to the kernel about our usage pattern,
+    // which does not return errno, but the error itself
+    if (!src->direct && (err = posix_fadvise(src->fd, 0, 0, POSIX_FADV_SEQUENTIAL))) {
+        parec_log4c_WARN("parec: could not advise the kernel on buffer usage: %s(%d)", strerror(err), err);
+    }
+
+    return 0;
+}
+
+// the descriptor of the entry is closed by its owner
+static void _parec_source_close(parec_source *src)
+{
+    if (src->fd != src->buffered)
+        close(src->fd);
+}
+
+// dropping a range, which was read through the page cache, unless the
+// cache policy is normal
+static void _parec_source_drop(parec_source *src, off_t offset, size_t len)
+{
+    int err;
+
+    if (src->ctx->cache == PAREC_CACHE_NORMAL || len == 0)
+        return;
+
+    if ((err = posix_fadvise(src->fd, offset, len, POSIX_FADV_DONTNEED))) {
+        parec_log4c_WARN("parec: could not drop the pages of '%s': %s(%d)", src->filename, strerror(err), err);
+    }
+}
+
+// reading 'len' bytes from 'offset', or less at the end of the file;
+// with direct I/O only the aligned part is read directly
+static ssize_t _parec_source_pread(parec_source *src, unsigned char *buffer, size_t len, off_t offset)
+{
+    size_t n = 0, direct_len = 0, start;
+    ssize_t r;
+    parec_tick tick;
+
+    if (src->direct && offset % DIRECT_ALIGN == 0 && (unsigned long)buffer % DIRECT_ALIGN == 0)
+        direct_len = len - len % DIRECT_ALIGN;
+
+    while (n < direct_len) {
+        _parec_tick(src->ctx, &tick);
+        r = pread(src->fd, buffer + n, direct_len - n, offset + n);
+        _parec_tock(src->ctx, &tick, PAREC_PHASE_READ);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        n += r;
+        // an unaligned direct read stops only at the end of the file
+        if (r == 0 || n % DIRECT_ALIGN)
+            return n;
+    }
+
+    if (n < len) {
+        start = n;
+        while (n < len) {
+            _parec_tick(src->ctx, &tick);
+            r = pread(src->buffered, buffer + n, len - n, offset + n);
+            _parec_tock(src->ctx, &tick, PAREC_PHASE_READ);
+            if (r < 0) {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            if (r == 0)
+                break;
+            n += r;
+        }
+        _parec_source_drop(src, offset + start, n - start);
+    }
+
+    return n;
+}
+
+static ssize_t _parec_source_read(parec_source *src, unsigned char *buffer, size_t len)
+{
+    ssize_t n;
+
+    if ((n = _parec_source_pread(src, buffer, len, src->offset)) > 0)
+        src->offset += n;
+    return n;
+}
+
+typedef struct {
+    parec_source                *src;
+    parec_ring                  *ring;
+} parec_reader;
+
+// reading the file into the ring, until the end of the file or a cancel
+static void *_parec_reader(void *arg)
+{
+    parec_reader *reader = arg;
+    unsigned char *buffer;
+    ssize_t n;
+
+    while ((buffer = parec_ring_acquire(reader->ring))) {
+        if ((n = _parec_source_read(reader->src, buffer, BUFLEN)) < 0) {
+            parec_ring_publish(reader->ring, -1, errno);
+            break;
+        }
+        parec_ring_publish(reader->ring, n, 0);
+        if (n == 0)
+            break;
+    }
+
+    return NULL;
+}
+
+typedef struct {
+    parec_ctx                   *ctx;
+    parec_ring                  *ring;
+    parec_md                    *md_ctx;
+    int                         consumer;
+    int                         consumers;
+    ssize_t                     n;              // the last value returned by the ring
+    int                         rc;
+} parec_digester;
+
+// digesting the buffers of the ring with a subset of the algorithms
+static void *_parec_digester(void *arg)
+{
+    parec_digester *digester = arg;
+    const unsigned char *buffer;
+
+    while ((digester->n = parec_ring_next(digester->ring, digester->consumer, &buffer)) > 0) {
+        if (_parec_update(digester->ctx, digester->md_ctx, buffer, digester->n, digester->consumer, digester->consumers)) {
+            digester->rc = -1;
+            // stopping the reader and the other digesters as well
+            parec_ring_cancel(digester->ring);
+            break;
+        }
+        parec_ring_release(digester->ring, digester->consumer);
+    }
+
+    return NULL;
+}
+
+// the next blocks are read by a separate thread, while the current one is
+// digested by one or more consumers, each calculating a subset of the algorithms
+static int _parec_file_pipelined(parec_ctx *ctx, int worker, parec_source *src, parec_md *md_ctx, int consumers)
+{
+    parec_reader reader;
+    parec_digester digester[consumers];
+    pthread_t thread[consumers];    // the first one is the reader
+    int c, started, rc = 0, err;
+
+    reader.src = src;
+    if (!(reader.ring = _parec_ring_get(ctx, worker, consumers)))
+        return -1;
+    for (c = 0; c < consumers; c++) {
+        digester[c].ctx = ctx;
+        digester[c].ring = reader.ring;
+        digester[c].md_ctx = md_ctx;
+        digester[c].consumer = c;
+        digester[c].consumers = consumers;
+        digester[c].n = 0;
+        digester[c].rc = 0;
+    }
+
+    if (pthread_create(&thread[0], NULL, _parec_reader, &reader)) {
+        PAREC_ERROR(ctx, "parec: could not start a reader thread for file '%s'", src->filename);
+        return -1;
+    }
+    for (started = 1; started < consumers; started++) {
+        if (pthread_create(&thread[started], NULL, _parec_digester, &digester[started])) {
+            PAREC_ERROR(ctx, "parec: could not start a digester thread for file '%s'", src->filename);
+            parec_ring_cancel(reader.ring);
+            rc = -1;
+            break;
+        }
+    }
+
+    // the first consumer runs in the calling thread
+    if (!rc)
+        _parec_digester(&digester[0]);
+
+    for (c = 1; c < started; c++) {
+        pthread_join(thread[c], NULL);
+    }
+    // stopping the reader, if it has not reached the end of the file yet
+    parec_ring_cancel(reader.ring);
+    pthread_join(thread[0], NULL);
+
+    for (c = 0; c < started; c++) {
+        if (digester[c].rc)
+            rc = -1;
+    }
+    if (!rc && digester[0].n < 0) {
+        err = parec_ring_get_error(reader.ring);
+        PAREC_ERROR(ctx, "parec: reading file '%s' has failed with '%s(%d)'", src->filename, strerror(err), err);
+        rc = -1;
+    }
+
+    return rc;
+}
+
+// completing a read of io_uring, which has returned 'n' bytes of 'len',
+// returns the total length or the negated errno value
+static ssize_t _parec_source_rest(parec_source *src, unsigned char *buffer, ssize_t n, size_t len, off_t offset)
+{
+    ssize_t r;
+
+    if (n < 0 || n >= (ssize_t)len)
+        return (n > (ssize_t)len) ? (ssize_t)len : n;
+    if ((r = _parec_source_pread(src, buffer + n, len - n, offset + n)) < 0)
+        return -errno;
+    return n + r;
+}
+
+// the length of a read, which is rounded up for direct I/O
+static size_t _parec_source_len(parec_source *src, size_t len)
+{
+    return src->direct ? (len + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN : len;
+}
+
+// keeping up to 'depth' reads of the file in flight, while the completed
+// blocks are digested in the order of the file; the k'th block is read
+// into the (k % depth)'th buffer of the engine
+static int _parec_file_uring(parec_ctx *ctx, parec_uring *uring, parec_source *src, off_t size, parec_md *md_ctx)
+{
+    const char *filename = src->filename;
+    int depth = parec_uring_get_depth(uring);
+    ssize_t res[depth];             // result of the last read into each buffer
+    int done[depth];
+    off_t blocks = (size + BUFLEN - 1) / BUFLEN, issued = 0, digested = 0, k;
+    size_t len;
+    ssize_t n;
+    void *data;
+    int b, r, rc = 0;
+    parec_tick tick;
+
+    while (!rc && digested < blocks) {
+        // filling up the queue
+        for (; issued < blocks && issued < digested + depth; issued++) {
+            b = issued % depth;
+            done[b] = 0;
+            len = (issued == blocks - 1) ? size - issued * BUFLEN : BUFLEN;
+            parec_uring_read(uring, src->fd, b, issued * BUFLEN, _parec_source_len(src, len), (void *)(long)issued);
+        }
+        if (parec_uring_submit(uring)) {
+            PAREC_ERROR(ctx, "parec: submitting reads of file '%s' has failed with '%s(%d)'", filename, strerror(errno), errno);
+            rc = -1;
+            break;
+        }
+
+        _parec_tick(ctx, &tick);
+        r = parec_uring_wait(uring, &data, &n);
+        _parec_tock(ctx, &tick, PAREC_PHASE_READ);
+        if (r) {
+            PAREC_ERROR(ctx, "parec: waiting for reads of file '%s' has failed with '%s(%d)'", filename, strerror(errno), errno);
+            rc = -1;
+            break;
+        }
+        k = (long)data;
+        res[k % depth] = n;
+        done[k % depth] = 1;
+
+        // digesting the blocks, which are complete in order
+        while (!rc && digested < issued && done[digested % depth]) {
+            b = digested % depth;
+            len = (digested == blocks - 1) ? size - digested * BUFLEN : BUFLEN;
+            res[b] = _parec_source_rest(src, parec_uring_buffer(uring, b), res[b], len, digested * BUFLEN);
+            if (res[b] < 0) {
+                PAREC_ERROR(ctx, "parec: reading file '%s' has failed with '%s(%d)'", filename, strerror(-res[b]), -res[b]);
+                rc = -1;
+            }
+            else {
+                rc = _parec_update(ctx, md_ctx, parec_uring_buffer(uring, b), res[b], 0, 1);
+                if (!src->direct)
+                    _parec_source_drop(src, digested * BUFLEN, res[b]);
+                digested++;
+            }
+        }
+    }
+
+    // the buffers and the file may be reused only after all reads are finished
+    if (parec_uring_drain(uring))
+        return -1;
+
+    return rc;
+}
+
+// digesting the file directly from the page cache, window by window,
+// without copying it into a buffer
+static int _parec_file_mmap(parec_ctx *ctx, parec_source *src, off_t size, parec_md *md_ctx)
+{
+    off_t offset;
+    size_t len;
+    void *p;
+    int rc = 0;
+
+    for (offset = 0; !rc && offset < size; offset += len) {
+        len = (size - offset < (off_t)MMAP_WINDOW) ? (size_t)(size - offset) : MMAP_WINDOW;
+        if ((p = mmap(NULL, len, PROT_READ, MAP_SHARED, src->fd, offset)) == MAP_FAILED) {
+            PAREC_ERROR(ctx, "parec: mapping file '%s' has failed with '%s(%d)'", src->filename, strerror(errno), errno);
+            return -1;
+        }
+        // the advices are not flags, they have to be given one by one
+        if (madvise(p, len, MADV_SEQUENTIAL) || madvise(p, len, MADV_WILLNEED)) {
+            parec_log4c_WARN("parec: could not advise the kernel on mapping usage: %s(%d)", strerror(errno), errno);
+        }
+        rc = _parec_update(ctx, md_ctx, p, len, 0, 1);
+        munmap(p, len);
+        _parec_source_drop(src, offset, len);
+    }
+
+    return rc;
+}
+
+/* Chunked digests
+ *
+ * With a chunk size the file is split into chunks, which are hashed on
+ * their own, and the digest of the file is the digest of the digests of
+ * its chunks. Since the chunks are independent, they are hashed by the
+ * threads of the team and the calling worker at the same time, each one
+ * taking the next chunk of a window and reading it by pread(2), while
+ * the digests of the window are added to the file in the order of the
+ * chunks by the calling worker. The team hashes one file at a time, the
+ * other files are hashed by their worker alone.
+ */
+
+/* Number of chunks hashed together before their digests are added. */
+static const int CHUNK_WINDOW = 64;
+
+// the window of chunks of a file, which are taken by the threads
+typedef struct {
+    parec_ctx                   *ctx;
+    parec_source                *src;
+    off_t                       size;
+    off_t                       next;           // the next chunk to be taken
+    off_t                       end;            // of the chunks of the window
+    off_t                       first;          // the first chunk of the window
+    unsigned char               *digest;        // of each chunk of the window
+    size_t                      stride;         // length of the digests of a chunk
+    uint64_t                    *signature;     // of the extents of each chunk of the window
+    unsigned char               *reused;        // the digests of a chunk are taken from its list
+    int                         failed;
+} parec_chunks;
+
+struct _parec_chunk_team {
+    parec_pool                  *pool;
+    pthread_mutex_t             lock;           // held by the file being hashed
+    int                         threads;
+    unsigned char               **buffer;       // of each thread
+    parec_md                    **md_ctx;       // of each thread
+    parec_chunks                *chunks;        // the window being hashed
+};
+
+// hashing chunk 'c' into its digests by every algorithm
+static int _parec_chunk_hash(parec_chunks *chunks, off_t c, unsigned char *buffer, parec_md *md_ctx)
+{
+    parec_ctx *ctx = chunks->ctx;
+    unsigned char *digest = chunks->digest + (c - chunks->first) * chunks->stride;
+    off_t offset = c * ctx->chunk_size;
+    off_t end = (chunks->size - offset < ctx->chunk_size) ? chunks->size : offset + ctx->chunk_size;
+    ssize_t n;
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        if (_parec_md_init(ctx, md_ctx, a))
+            return -1;
+    }
+    // a shrinking file is noticed by its fingerprint
+    while (offset < end) {
+        if ((n = _parec_source_pread(chunks->src, buffer, (end - offset < BUFLEN) ? (size_t)(end - offset) : BUFLEN, offset)) < 0) {
+            PAREC_ERROR(ctx, "parec: reading file '%s' has failed with '%s(%d)'", chunks->src->filename, strerror(errno), errno);
+            return -1;
+        }
+        if (n == 0)
+            break;
+        if (_parec_update(ctx, md_ctx, buffer, n, 0, 1))
+            return -1;
+        offset += n;
+    }
+    for (int a = 0; a < ctx->algorithms; a++) {
+        if (_parec_md_final(ctx, md_ctx, a, digest))
+            return -1;
+        digest += ctx->dlen[a];
+    }
+    return 0;
+}
+
+// taking the chunks of the window, until there is none left
+static void _parec_chunks_hash(parec_chunks *chunks, unsigned char *buffer, parec_md *md_ctx)
+{
+    off_t c;
+
+    while (!__sync_fetch_and_or(&chunks->failed, 0) && (c = __sync_fetch_and_add(&chunks->next, 1)) < chunks->end) {
+        if (!chunks->reused[c - chunks->first] && _parec_chunk_hash(chunks, c, buffer, md_ctx))
+            __sync_fetch_and_or(&chunks->failed, 1);
+    }
+}
+
+static void _parec_chunk_task(void *arg, int worker)
+{
+    parec_chunk_team *team = arg;
+
+    _parec_chunks_hash(team->chunks, team->buffer[worker], team->md_ctx[worker]);
+}
+
+static void _parec_chunk_team_free(parec_ctx *ctx, parec_chunk_team *team)
+{
+    if (!team)
+        return;
+
+    parec_pool_free(team->pool);
+    for (int t = 0; t < team->threads; t++) {
+        free(team->buffer[t]);
+        _parec_md_destroy(ctx, team->md_ctx[t]);
+    }
+    free(team->buffer);
+    free(team->md_ctx);
+    pthread_mutex_destroy(&team->lock);
+    free(team);
+}
+
+// the buffers and the digest contexts of the threads are allocated ahead
+static parec_chunk_team *_parec_chunk_team_new(parec_ctx *ctx, int threads)
+{
+    parec_chunk_team *team;
+    void *buffer;
+
+    if (!(team = calloc(1, sizeof(*team))))
+        return NULL;
+    pthread_mutex_init(&team->lock, NULL);
+    team->threads = threads;
+    if (!(team->buffer = calloc(threads, sizeof(*(team->buffer)))) || !(team->md_ctx = calloc(threads, sizeof(*(team->md_ctx))))) {
+        _parec_chunk_team_free(ctx, team);
+        return NULL;
+    }
+    for (int t = 0; t < threads; t++) {
+        if (posix_memalign(&buffer, DIRECT_ALIGN, BUFLEN)) {
+            _parec_chunk_team_free(ctx, team);
+            return NULL;
+        }
+        team->buffer[t] = buffer;
+        if (!(team->md_ctx[t] = calloc(sizeof(parec_md), ctx->algorithms ? ctx->algorithms : 1))) {
+            _parec_chunk_team_free(ctx, team);
+            return NULL;
+        }
+        for (int a = 0; a < ctx->algorithms; a++) {
+            if (_parec_md_create(ctx, team->md_ctx[t], a)) {
+                _parec_chunk_team_free(ctx, team);
+                return NULL;
+            }
+        }
+    }
+    if (!(team->pool = parec_pool_new(threads))) {
+        _parec_chunk_team_free(ctx, team);
+        return NULL;
+    }
+    return team;
+}
+
+/* Chunk lists
+ *
+ * With a chunk store the digests of the chunks of a file are kept in a
+ * list, one file for each inode in the store, with the signature of the
+ * extents of each chunk. When a changed file is hashed again, the digests
+ * of a chunk are taken from the list, if the chunk has the same length and
+ * it is known to be unchanged: it has no data at all (SEEK_DATA), or the
+ * same extents (FIEMAP), which are all shared or unwritten. A shared
+ * extent of a copy-on-write file system gets new blocks at a write, and an
+ * unwritten one is converted, while the other extents may be overwritten
+ * in place, so their chunks are always read. A list belongs to the inode
+ * with the same creation time only, and it is not used by CHECK and FORCE.
+ *
+ * The list is a header like the packed record with the creation time of
+ * the file instead of its modification time, the chunk size after the
+ * size of the file, followed by the signature (8 bytes) and the digests
+ * of each chunk.
+ */
+
+static const char CHUNK_LIST_MAGIC[] = "PCL";
+static const unsigned char CHUNK_LIST_VERSION = 2;
+static const size_t CHUNK_LIST_HEADER = 33;
+/* Number of extents fetched by one FIEMAP call. */
+static const int CHUNK_EXTENTS = 64;
+/* Signature of the chunks without data, which read as zeros. */
+static const uint64_t CHUNK_HOLE = 1;
+/* The extents, which are not written in place. */
+static const uint32_t CHUNK_STABLE = FIEMAP_EXTENT_SHARED | FIEMAP_EXTENT_UNWRITTEN;
+/* The extents, which may change without getting new blocks. */
+static const uint32_t CHUNK_UNSTABLE = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_ENCODED
+                                       | FIEMAP_EXTENT_NOT_ALIGNED | FIEMAP_EXTENT_DATA_INLINE | FIEMAP_EXTENT_DATA_TAIL;
+
+// the stored list of a file and the new one, which replaces it
+typedef struct {
+    char                        *name;          // NULL, if the file has no list
+    char                        *tmp;           // of the new list until it is complete
+    FILE                        *out;           // the new list
+    unsigned char               *map;           // the stored list or NULL
+    size_t                      map_len;
+    const unsigned char         *entry;         // of the first chunk of the stored list
+    off_t                       count;          // number of chunks of the stored list
+    off_t                       size;           // of the file in the stored list
+    off_t                       reused;         // number of chunks taken from the stored list
+} parec_chunk_list;
+
+// the length of a chunk of a file of 'size' bytes
+static off_t _parec_chunk_len(parec_ctx *ctx, off_t c, off_t size)
+{
+    off_t offset = c * ctx->chunk_size;
+
+    if (offset >= size)
+        return 0;
+    return (size - offset < ctx->chunk_size) ? size - offset : ctx->chunk_size;
+}
+
+// the header of the list of a file, returns its length
+static size_t _parec_chunk_list_header(parec_ctx *ctx, const struct statx_timestamp *btime, off_t size, unsigned char *hdr)
+{
+    size_t len = CHUNK_LIST_HEADER, n;
+
+    memcpy(hdr, CHUNK_LIST_MAGIC, 3);
+    hdr[3] = CHUNK_LIST_VERSION;
+    _parec_put_le(hdr + 4, btime->tv_nsec, 4);
+    _parec_put_le(hdr + 8, btime->tv_sec, 8);
+    _parec_put_le(hdr + 16, size, 8);
+    _parec_put_le(hdr + 24, ctx->chunk_size, 8);
+    hdr[32] = ctx->algorithms;
+    for (int a = 0; a < ctx->algorithms; a++) {
+        n = strlen(_parec_stored_name(ctx, a));
+        if (n > 255 || len + 2 + n > RECORD_LEN)
+            return 0;
+        hdr[len] = n;
+        memcpy(hdr + len + 1, _parec_stored_name(ctx, a), n);
+        hdr[len + 1 + n] = ctx->dlen[a];
+        len += 2 + n;
+    }
+    return len;
+}
+
+// mapping the stored list of the file and creating the new one
+static int _parec_chunk_list_start(parec_ctx *ctx, const parec_entry *e, off_t size, size_t stride, parec_chunk_list *list)
+{
+    unsigned char hdr[RECORD_LEN];
+    struct statx stx;
+    struct stat st;
+    size_t len;
+    void *map;
+    int fd;
+
+    memset(list, 0, sizeof(*list));
+    if (!ctx->chunk_store || ctx->method == PAREC_METHOD_CHECK)
+        return 0;
+
+    // without the creation time a new file could take the list of
+    // a deleted one with the same inode
+    if (statx(e->fd, "", AT_EMPTY_PATH, STATX_BTIME, &stx) || !(stx.stx_mask & STATX_BTIME)) {
+        parec_log4c_DEBUG("the creation time of '%s' is not known, its chunks are not listed", e->name);
+        return 0;
+    }
+    if (!(len = _parec_chunk_list_header(ctx, &stx.stx_btime, size, hdr))) {
+        PAREC_ERROR(ctx, "parec: the checksums do not fit into the chunk list of '%s'", e->name);
+        return -1;
+    }
+
+    list->name = malloc(strlen(ctx->chunk_store) + 40);
+    list->tmp = malloc(strlen(ctx->chunk_store) + 48);
+    if (!list->name || !list->tmp) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return -1;
+    }
+    sprintf(list->name, "%s/%llx-%llx", ctx->chunk_store, (unsigned long long) e->dev, (unsigned long long) e->ino);
+    sprintf(list->tmp, "%s.XXXXXX", list->name);
+
+    // the stored list is used, if it has the same header except the size
+    if (ctx->method == PAREC_METHOD_DEFAULT && (fd = open(list->name, O_RDONLY)) >= 0) {
+        if (!fstat(fd, &st) && (size_t) st.st_size > len
+            && (map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED) {
+            list->map = map;
+            list->map_len = st.st_size;
+            list->entry = list->map + len;
+            list->size = _parec_get_le(list->map + 16, 8);
+            list->count = (list->size + ctx->chunk_size - 1) / ctx->chunk_size;
+            if (memcmp(list->map, hdr, 16) || memcmp(list->map + 24, hdr + 24, len - 24)
+                || list->map_len != len + list->count * (8 + stride)) {
+                parec_log4c_DEBUG("ignoring the chunk list of '%s'", e->name);
+                munmap(list->map, list->map_len);
+                list->map = NULL;
+            }
+        }
+        close(fd);
+    }
+
+    // the new list replaces the stored one, when it is complete
+    if ((fd = mkstemp(list->tmp)) < 0 || !(list->out = fdopen(fd, "w"))) {
+        PAREC_ERROR(ctx, "parec: creating the chunk list '%s' has failed with '%s(%d)'", list->tmp, strerror(errno), errno);
+        if (fd >= 0) {
+            close(fd);
+            unlink(list->tmp);
+        }
+        return -1;
+    }
+    fwrite(hdr, 1, len, list->out);
+
+    return 0;
+}
+
+// the signatures of the extents of the chunks of the window: 0, if they
+// are not known or they may be overwritten in place, CHUNK_HOLE for a
+// chunk without data, or a hash of the offsets, physical addresses,
+// lengths and flags of the extents of the chunk
+static void _parec_chunk_extents(parec_chunks *chunks, int fd)
+{
+    parec_ctx *ctx = chunks->ctx;
+    uint64_t buffer[(sizeof(struct fiemap) + CHUNK_EXTENTS * sizeof(struct fiemap_extent)) / sizeof(uint64_t) + 1];
+    struct fiemap *fm = (struct fiemap *) buffer;
+    const struct fiemap_extent *x;
+    off_t start = chunks->first * ctx->chunk_size, end = start, offset, lo, hi, d;
+    uint64_t *sig = chunks->signature;
+    int n = chunks->end - chunks->first, i;
+    int unknown[n];
+
+    for (i = 0; i < n; i++) {
+        end += _parec_chunk_len(ctx, chunks->first + i, chunks->size);
+        sig[i] = CHUNK_HOLE;
+        unknown[i] = 0;
+    }
+
+    for (offset = start; offset < end; ) {
+        memset(fm, 0, sizeof(*fm));
+        fm->fm_start = offset;
+        fm->fm_length = end - offset;
+        fm->fm_extent_count = CHUNK_EXTENTS;
+        if (ioctl(fd, FS_IOC_FIEMAP, fm)) {
+            // only the holes are known without the extents
+            for (i = 0; i < n; i++) {
+                lo = (chunks->first + i) * ctx->chunk_size;
+                hi = lo + _parec_chunk_len(ctx, chunks->first + i, chunks->size);
+                d = lseek(fd, lo, SEEK_DATA);
+                sig[i] = ((d < 0 && errno == ENXIO) || d >= hi) ? CHUNK_HOLE : 0;
+            }
+            return;
+        }
+        if (fm->fm_mapped_extents == 0)
+            break;
+        for (unsigned int m = 0; m < fm->fm_mapped_extents; m++) {
+            x = &fm->fm_extents[m];
+            lo = ((off_t) x->fe_logical > start) ? (off_t) x->fe_logical : start;
+            hi = ((off_t) (x->fe_logical + x->fe_length) < end) ? (off_t) (x->fe_logical + x->fe_length) : end;
+            // the part of the extent in each chunk, by FNV-1a of its words
+            for (; lo < hi; lo = (lo / ctx->chunk_size + 1) * ctx->chunk_size) {
+                i = lo / ctx->chunk_size - chunks->first;
+                d = ((lo / ctx->chunk_size + 1) * ctx->chunk_size < hi) ? (lo / ctx->chunk_size + 1) * ctx->chunk_size : hi;
+                if ((x->fe_flags & CHUNK_UNSTABLE) || !(x->fe_flags & CHUNK_STABLE))
+                    unknown[i] = 1;
+                if (sig[i] == CHUNK_HOLE)
+                    sig[i] = 0xcbf29ce484222325ULL;
+                sig[i] = (sig[i] ^ lo) * 0x100000001b3ULL;
+                sig[i] = (sig[i] ^ (x->fe_physical + (lo - x->fe_logical))) * 0x100000001b3ULL;
+                sig[i] = (sig[i] ^ (d - lo)) * 0x100000001b3ULL;
+                sig[i] = (sig[i] ^ (x->fe_flags & CHUNK_STABLE)) * 0x100000001b3ULL;
+            }
+            offset = x->fe_logical + x->fe_length;
+            if (x->fe_flags & FIEMAP_EXTENT_LAST)
+                offset = end;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        if (unknown[i])
+            sig[i] = 0;
+        // the hash of the extents is neither unknown nor a hole
+        else if (sig[i] == 0)
+            sig[i] = 2;
+    }
+}
+
+// taking the digests of the unchanged chunks of the window from the stored list
+static void _parec_chunk_list_reuse(parec_chunk_list *list, parec_chunks *chunks)
+{
+    parec_ctx *ctx = chunks->ctx;
+    const unsigned char *entry;
+
+    for (off_t c = chunks->first; c < chunks->end; c++) {
+        if (!list->map || c >= list->count || !chunks->signature[c - chunks->first]
+            || _parec_chunk_len(ctx, c, list->size) != _parec_chunk_len(ctx, c, chunks->size))
+            continue;
+        entry = list->entry + c * (8 + chunks->stride);
+        if (_parec_get_le(entry, 8) == chunks->signature[c - chunks->first]) {
+            memcpy(chunks->digest + (c - chunks->first) * chunks->stride, entry + 8, chunks->stride);
+            chunks->reused[c - chunks->first] = 1;
+            list->reused++;
+        }
+    }
+}
+
+// adding the signatures and the digests of the chunks of the window to the new list
+static void _parec_chunk_list_add(parec_chunk_list *list, parec_chunks *chunks)
+{
+    unsigned char sig[8];
+
+    for (off_t c = chunks->first; c < chunks->end; c++) {
+        _parec_put_le(sig, chunks->signature[c - chunks->first], 8);
+        fwrite(sig, 1, 8, list->out);
+        fwrite(chunks->digest + (c - chunks->first) * chunks->stride, 1, chunks->stride, list->out);
+    }
+}
+
+// replacing the stored list by the new one, if the file has been hashed
+static int _parec_chunk_list_finish(parec_ctx *ctx, parec_chunk_list *list, const parec_entry *e, int rc)
+{
+    if (list->out) {
+        if (((ferror(list->out) | fclose(list->out)) && !rc) || (!rc && rename(list->tmp, list->name))) {
+            PAREC_ERROR(ctx, "parec: writing the chunk list '%s' has failed with '%s(%d)'", list->name, strerror(errno), errno);
+            rc = -1;
+        }
+        if (rc)
+            unlink(list->tmp);
+    }
+    if (list->map) {
+        munmap(list->map, list->map_len);
+        if (!rc)
+            parec_log4c_DEBUG("reused %lld of the chunks of '%s'", (long long) list->reused, e->name);
+    }
+    free(list->name);
+    free(list->tmp);
+
+    return rc;
+}
+
+static int _parec_file_chunked(parec_ctx *ctx, int worker, const parec_entry *e, const struct stat *p_stat, parec_md *md_ctx)
+{
+    parec_chunk_team *team = ctx->chunk_team;
+    parec_source src;
+    parec_chunks chunks;
+    parec_chunk_list list;
+    parec_md *chunk_ctx;
+    unsigned char *buffer, *digest;
+    off_t count = (p_stat->st_size + ctx->chunk_size - 1) / ctx->chunk_size;
+    unsigned char window[CHUNK_WINDOW * EVP_MAX_MD_SIZE * ctx->algorithms + 1];    // avoiding a zero length array
+    uint64_t signature[CHUNK_WINDOW];
+    unsigned char reused[CHUNK_WINDOW];
+    int shared, rc = 0;
+
+    chunks.ctx = ctx;
+    chunks.src = &src;
+    chunks.size = p_stat->st_size;
+    chunks.digest = window;
+    chunks.stride = 0;
+    for (int a = 0; a < ctx->algorithms; a++) {
+        chunks.stride += ctx->dlen[a];
+    }
+    chunks.signature = signature;
+    chunks.reused = reused;
+    chunks.failed = 0;
+
+    if (!(buffer = _parec_buffer_get(ctx, worker)) || !(chunk_ctx = _parec_md_new(ctx, worker)))
+        return -1;
+    if (_parec_chunk_list_start(ctx, e, p_stat->st_size, chunks.stride, &list) || _parec_source_open(ctx, &src, e, 1)) {
+        _parec_chunk_list_finish(ctx, &list, e, -1);
+        _parec_md_free(ctx, worker, chunk_ctx);
+        return -1;
+    }
+
+    // the team is not waited for, if it is busy with another file
+    shared = team && count > 1 && !pthread_mutex_trylock(&team->lock);
+    if (shared)
+        team->chunks = &chunks;
+
+    for (chunks.first = 0; !rc && chunks.first < count; chunks.first += CHUNK_WINDOW) {
+        chunks.next = chunks.first;
+        chunks.end = (count - chunks.first < CHUNK_WINDOW) ? count : chunks.first + CHUNK_WINDOW;
+        memset(reused, 0, sizeof(reused));
+        if (list.name) {
+            _parec_chunk_extents(&chunks, src.buffered);
+            _parec_chunk_list_reuse(&list, &chunks);
+        }
+        // the calling worker takes the chunks, which are not taken by the team
+        for (int t = 0; shared && t < team->threads && t < chunks.end - chunks.first - 1; t++) {
+            if (parec_pool_submit(team->pool, -1, _parec_chunk_task, team))
+                break;
+        }
+        _parec_chunks_hash(&chunks, buffer, chunk_ctx);
+        if (shared)
+            parec_pool_wait(team->pool);
+        if (chunks.failed) {
+            rc = -1;
+            break;
+        }
+        digest = window;
+        for (off_t c = chunks.first; !rc && c < chunks.end; c++) {
+            for (int a = 0; !rc && a < ctx->algorithms; a++) {
+                rc = _parec_md_update(ctx, md_ctx, a, digest, ctx->dlen[a]);
+                digest += ctx->dlen[a];
+            }
+        }
+        if (list.out)
+            _parec_chunk_list_add(&list, &chunks);
+    }
+
+    if (shared) {
+        team->chunks = NULL;
+        pthread_mutex_unlock(&team->lock);
+    }
+    _parec_source_close(&src);
+    _parec_md_free(ctx, worker, chunk_ctx);
+
+    return _parec_chunk_list_finish(ctx, &list, e, rc);
+}
+
+// reading a small file by a single system call into the buffer of the
+// worker, since a short read is the end of the file, and a grown file is
+// noticed by its fingerprint
+static int _parec_file_small(parec_ctx *ctx, int worker, const parec_entry *e, parec_md *md_ctx)
+{
+    unsigned char *buffer;
+    ssize_t n;
+    int err;
+    parec_tick tick;
+
+    if (!(buffer = _parec_buffer_get(ctx, worker)))
+        return -1;
+
+    _parec_tick(ctx, &tick);
+    while ((n = pread(e->fd, buffer, BUFLEN, 0)) < 0 && errno == EINTR)
+        ;
+    _parec_tock(ctx, &tick, PAREC_PHASE_READ);
+    if (n < 0) {
+        PAREC_ERROR(ctx, "parec: reading file '%s' has failed with '%s(%d)'", e->name, strerror(errno), errno);
+        return -1;
+    }
+    if (ctx->cache != PAREC_CACHE_NORMAL && n > 0 && (err = posix_fadvise(e->fd, 0, n, POSIX_FADV_DONTNEED))) {
+        parec_log4c_WARN("parec: could not drop the pages of '%s': %s(%d)", e->name, strerror(err), err);
+    }
+
+    return _parec_update(ctx, md_ctx, buffer, n, 0, 1);
+}
+
+static int _parec_file(parec_ctx *ctx, int worker, const parec_entry *e, const struct stat *p_stat, parec_md *md_ctx) {
+    int rc = 0;
+    parec_uring *uring = _parec_uring_get(ctx, worker);
+    ssize_t n;
+    unsigned char *buffer;
+    parec_source src;
+    int digest_threads = ctx->parallel_digests && ctx->algorithms > 1 && p_stat->st_size > BUFLEN;
+    // only the files above the threshold are mapped, since mapping
+    // a small file costs more than reading it
+    int mapped = !uring && ctx->io == PAREC_IO_MMAP && p_stat->st_size > 0
+                 && p_stat->st_size >= ctx->mmap_threshold && !digest_threads;
+
+    if (ctx->chunk_size > 0)
+        return _parec_file_chunked(ctx, worker, e, p_stat, md_ctx);
+    if (p_stat->st_size <= SMALL_FILE_MAX && !mapped)
+        return _parec_file_small(ctx, worker, e, md_ctx);
+    if (_parec_source_open(ctx, &src, e, !mapped))
+        return -1;
+
+    // the reads are queued with io_uring, unless the digests are calculated
+    // by their own threads, which use the read-ahead thread
+    if (uring && !digest_threads) {
+        rc = _parec_file_uring(ctx, uring, &src, p_stat->st_size, md_ctx);
+    }
+    else if (mapped) {
+        rc = _parec_file_mmap(ctx, &src, p_stat->st_size, md_ctx);
+    }
+    // reading and hashing at the same time only pays off for multiple blocks
+    else if (digest_threads) {
+        rc = _parec_file_pipelined(ctx, worker, &src, md_ctx, ctx->algorithms);
+    }
+    else if (ctx->pipeline > 1 && p_stat->st_size > BUFLEN) {
+        rc = _parec_file_pipelined(ctx, worker, &src, md_ctx, 1);
+    }
+    else if ((buffer = _parec_buffer_get(ctx, worker))) {
+        // processing the file by blocks
+        while (!rc && (n = _parec_source_read(&src, buffer, BUFLEN)) != 0) {
+            if (n < 0) {
+                PAREC_ERROR(ctx, "parec: reading file '%s' has failed with '%s(%d)'", e->name, strerror(errno), errno);
+                rc = -1;
+            }
+            else {
+                rc = _parec_update(ctx, md_ctx, buffer, n, 0, 1);
+            }
+        }
+    }
+    else {
+        rc = -1;
+    }
+    // we already have the final block, so the source can be closed
+    _parec_source_close(&src);
+
+    return rc;
+}
+
+// The directory checksum is the checksum of the entry checksums.
+// To be independent of the order or name of the entries, the 
+// checksums of the entries has to be ordered by the checksums
+// themselves.
+//
+// There are a number of possibilities:
+// 1. double scan
+//      process each entry and count them
+//      allocate checksum arrays
+//      fetch the checksums from the extended attributes
+//      sort the arrays
+//      calculate the directory checksum based on the arrays
+// 
+// 2. dynamic allocation
+//      merge the above two loops into a single loop by dynamically
+//      reallocating the checksum arrays, if they are not big enough
+// 
+// 3. dynamic heap
+//      merge the sort step into the loop by maintaining a sorted structure
+//
+// 2.a returning checksums
+//      instead of passing attributes through extended attributes
+//      the processing function could return them to the calling
+//      context directly
+//
+// The serial processing implements 2. and 2.a: the directory is read
+// only once and the checksums of the entries are returned directly into
+// the digest arrays of the directory, even for the unchanged entries,
+// which are fetched from the extended attributes by the entry itself.
+
+static int _parec_directory(parec_ctx *ctx, const parec_entry *e, parec_md *md_ctx) {
+    int dcount = 0, rc = 0;
+    struct dirent64 *p_dirent;
+    char hex[EVP_MAX_MD_SIZE*2+1], *names;
+    unsigned char *out[ctx->algorithms + 1];    // avoiding a zero length array
+    int a, i;
+    size_t len, stride;
+    parec_entry child;
+    parec_walk walk;
+    parec_node *dir;
+    parec_dir *reader;
+    int depth = _parec_batch_len(ctx);
+    parec_node *batch[depth + 1];               // avoiding a zero length array
+    int batched = 0;
+    int cap = _parec_spill_cap(ctx), total = 0;
+    parec_spill spill = { NULL, 0, 0, NULL, NULL };
+
+    if (!(names = _parec_entry_names(ctx, e->name, &len)))
+        return -1;
+    if (!(reader = _parec_dir_open(ctx, -1, e))) {
+        free(names);
+        return -1;
+    }
+
+    // the node of the directory holds the digest arrays of its entries,
+    // which are filled directly by the processing of the entries
+    walk.ctx = ctx;
+    walk.dlen = ctx->dlen;
+    walk.failed = 0;
+    if (!(dir = _parec_node_new(&walk, -1, NULL, 0, e->name, NULL))) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        _parec_dir_close(ctx, -1, reader);
+        free(names);
+        return -1;
+    }
+    // the entries of the batches are opened relative to the directory
+    dir->entry.fd = e->fd;
+
+    child.dirfd = e->fd;
+    child.name = names;
+    child.parent = e;
+    while (!rc && (p_dirent = _parec_dir_read(ctx, reader, &rc)) != NULL) {
+        if (_parec_filter(ctx, p_dirent->d_name)) continue;
+        // the full digest arrays are spilled as a sorted run over the
+        // memory budget, once the pending batch has filled its slots
+        if (cap && dcount == cap) {
+            if (batched) {
+                rc = _parec_process_batch(batch, batched);
+                batched = 0;
+            }
+            if (rc || (rc = _parec_spill_run(ctx, &spill, dir->digest, dcount)))
+                break;
+            total += dcount;
+            dcount = 0;
+        }
+        // extending the digest arrays, if necessary
+        if (dcount == dir->digest_len && (rc = _parec_node_digests(dir, cap && dcount * 2 > cap ? cap : (dcount ? dcount * 2 : 16))))
+            break;
+        // the regular files are read together through io_uring or
+        // digested together by the multi-buffer engine
+        if (depth > 1 && p_dirent->d_type == DT_REG) {
+            if (!(batch[batched] = _parec_node_new(&walk, -1, dir, dcount, e->name, p_dirent->d_name))) {
+                PAREC_ERROR(ctx, "parec: out of memory");
+                rc = -1;
+                break;
+            }
+            dcount++;
+            if (++batched == depth) {
+                rc = _parec_process_batch(batch, batched);
+                batched = 0;
+            }
+            continue;
+        }
+        strcpy(names + len, p_dirent->d_name);
+        child.dname = names + len;
+        child.type = p_dirent->d_type;
+        parec_log4c_DEBUG("processing '%s' for directory '%s'", names, e->name);
+        for (a = 0; a < ctx->algorithms; a++) {
+            out[a] = dir->digest[a] + dcount * _parec_digest_stride(ctx, a);
+        }
+        dcount++;
+        rc = _parec_process(ctx, &child, out);
+    }
+    // the last batch is processed, or just released after an error
+    if (batched && !rc) {
+        rc = _parec_process_batch(batch, batched);
+    }
+    else {
+        for (i = 0; i < batched; i++) {
+            _parec_node_free(batch[i], -1);
+        }
+    }
+    parec_log4c_DEBUG("# processed entries: %d", total + dcount);
+    _parec_dir_close(ctx, -1, reader);
+    free(names);
 
-    PAREC_CHECK_CONTEXT(ctx)
+    // merging the sorted runs with the last one
+    if (!rc && spill.runs) {
+        if (dcount)
+            rc = _parec_spill_run(ctx, &spill, dir->digest, dcount);
+        for (a = 0; !rc && a < ctx->algorithms; a++) {
+            rc = _parec_spill_merge(ctx, &spill, a, md_ctx);
+        }
+        dcount = 0;
+    }
+    _parec_spill_free(&spill);
+
+    // sorting the checksums and calculating the digests
+    for (a = 0; !rc && dcount && a < ctx->algorithms; a++) {
+        stride = _parec_digest_stride(ctx, a);
+        rc = _parec_digest_sort(ctx, a, dir->digest[a], dcount);
+        for (i = 0; !rc && i < dcount; i++) {
+            if (_parec_md_update(ctx, md_ctx, a, dir->digest[a] + i * stride, ctx->dlen[a])) {
+                rc = -1;
+            }
+            else {
+                parec_log4c_DEBUG("%s(%d) = 0x%s", ctx->xattr_algorithm[a], i, _parec_hex(hex, dir->digest[a] + i * stride, ctx->dlen[a]));
+            }
+        }
+    }
+    // the descriptor belongs to the directory stream
+    dir->entry.fd = -1;
+    _parec_node_free(dir, -1);
+
+    return rc;
+}
+
+// reporting an event of an entry, returns -1, if the callback has stopped
+// the processing; the time is measured from 'start', if it is set
+static int _parec_event(parec_ctx *ctx, parec_event_type type, const parec_entry *e, const struct stat *p_stat, const parec_stamp *start)
+{
+    parec_event event;
+    int rc;
+
+    event.type = type;
+    event.name = e->name;
+    event.size = S_ISREG(p_stat->st_mode) ? p_stat->st_size : 0;
+    event.seconds = start ? (_parec_clock() - start->clock) / 1e9 : 0.0;
+    event.error = NULL;
+
+    pthread_mutex_lock(&ctx->event_lock);
+    rc = ctx->event(&event, ctx->event_arg);
+    pthread_mutex_unlock(&ctx->event_lock);
+
+    if (rc) {
+        PAREC_ERROR(ctx, "parec: processing is stopped by the event callback at '%s'", e->name);
+        return -1;
+    }
+    return 0;
+}
+
+// reporting the first error of the processing, the entries failing after
+// it are just aborted
+static void _parec_event_error(parec_ctx *ctx, const char *name)
+{
+    char error[ERRLEN];
+    parec_event event = { PAREC_EVENT_ERROR, name, 0, 0.0, error };
+
+    if (!__sync_bool_compare_and_swap(&ctx->event_failed, 0, 1))
+        return;
+
+    pthread_mutex_lock(&ctx->lock);
+    snprintf(error, ERRLEN, "%s", ctx->error_message ? ctx->error_message : "unknown error");
+    pthread_mutex_unlock(&ctx->lock);
+
+    pthread_mutex_lock(&ctx->event_lock);
+    ctx->event(&event, ctx->event_arg);
+    pthread_mutex_unlock(&ctx->event_lock);
+}
+
+// checking the entry before the calculation, the stored checksums of an
+// unchanged entry are also returned in 'out' (one buffer for each algorithm),
+// if it is set; returns 1, if the stored checksums are up-to-date and the
+// entry can be skipped
+static int _parec_begin(parec_ctx *ctx, parec_entry *e, struct stat *p_stat, parec_stamp *start, parec_stamp *stored, unsigned char **out)
+{
+    parec_tick tick;
+    int rc;
 
-    parec_log4c_DEBUG("Processing '%s'", name);
+    stored->layout = -1;
 
     // checking the modification time at the beginning
-    if ((rc = stat(name, &p_stat))) {
-        PAREC_ERROR(ctx, "parec: could not stat %s (%d)", name, rc);
+    _parec_tick(ctx, &tick);
+    rc = _parec_entry_open(ctx, e, p_stat);
+    _parec_tock(ctx, &tick, PAREC_PHASE_OPEN);
+    if (rc)
+        return -1;
+    if (e->fd < 0) {
+        PAREC_ERROR(ctx, "parec: unknown entry type of '%s'", e->name);
         return -1;
     }
-    start_mtime = p_stat.st_mtime;
+    _parec_stamp(start, p_stat);
+    if (ctx->event || ctx->profile)
+        start->clock = _parec_clock();
+    if (ctx->event && _parec_event(ctx, PAREC_EVENT_START, e, p_stat, NULL))
+        return -1;
 
+    _parec_tick(ctx, &tick);
     if (ctx->method == PAREC_METHOD_FORCE) {
-        if (_parec_purge(ctx, name)) {
+        if (ctx->backend->purge(ctx, e)) {
             return -1;
         }
     }
@@ -763,105 +4851,647 @@ int parec_process(parec_ctx *ctx, const char *name) {
     // trying to check, if the file was modified since the last calculation,
     // and skip the rest, if it was not modified
     if (ctx->method != PAREC_METHOD_CHECK) {
-        if ((rc = getxattr(name, ctx->xattr_mtime, &x_mtime, sizeof(x_mtime))) < 0 && (errno != ENODATA)) {
-            PAREC_ERROR(ctx, "parec: fetching attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_mtime, name, strerror(errno), errno);
+        if (ctx->backend->stored(ctx, e, start, stored, out))
             return -1;
-        }
-        else if (rc == sizeof(x_mtime)) {
-            parec_log4c_DEBUG("comparing actual (%d) and stored (%d) mtime", start_mtime, x_mtime);
-            if (start_mtime == x_mtime) {
-                parec_log4c_INFO("checksums are already calculated, skipping '%s'", name);
-                return 0;
+        if (stored->layout >= 0) {
+            parec_log4c_DEBUG("comparing actual (%d) and stored (%d) mtime", p_stat->st_mtime, stored->mtime);
+            if (_parec_stamp_equal(start, stored)) {
+                parec_log4c_INFO("checksums are already calculated, skipping '%s'", e->name);
+                if (stored->layout != _parec_layout(ctx) && _parec_migrate(ctx, e, start))
+                    return -1;
+                _parec_tock(ctx, &tick, PAREC_PHASE_STORAGE);
+                _parec_count_entry(ctx, PAREC_EVENT_SKIP, start->clock);
+                if (ctx->event && _parec_event(ctx, PAREC_EVENT_SKIP, e, p_stat, NULL))
+                    return -1;
+                return 1;
             }
         }
     }
+    _parec_tock(ctx, &tick, PAREC_PHASE_STORAGE);
 
-    // the checksums need to be actually calculated
-    if ((rc = parec_init_evp(ctx))) return rc;
+    return 0;
+}
 
-    md_ctx = calloc(sizeof(*md_ctx), ctx->algorithms);
-    if (!md_ctx) {
-        PAREC_ERROR(ctx, "parec: out of memory");
+// checking the entry after the calculation and finalizing the checksums,
+// which are also copied to 'out' (one buffer for each algorithm), if it is set;
+// the checksums in 'computed', if it is set, are already calculated by the
+// multi-buffer engine, unless they are NULL
+static int _parec_finish(parec_ctx *ctx, const parec_entry *e, const parec_stamp *start, const parec_stamp *stored, parec_md *md_ctx, unsigned char **computed, unsigned char **out)
+{
+    int a;
+    unsigned char digest[ctx->algorithms + 1][EVP_MAX_MD_SIZE], x_digest[ctx->algorithms + 1][EVP_MAX_MD_SIZE];
+    unsigned char *p_digest[ctx->algorithms + 1], *p_x_digest[ctx->algorithms + 1];
+    parec_stamp end, x_stored;
+    struct stat p_stat;
+    parec_event_type type;
+    parec_tick tick;
+    int rc;
+
+    // checking the modification time at the end
+    _parec_tick(ctx, &tick);
+    rc = _parec_statx(e->fd, "", &p_stat);
+    _parec_tock(ctx, &tick, PAREC_PHASE_OPEN);
+    if (rc) {
+        PAREC_ERROR(ctx, "parec: could not stat %s with '%s(%d)'", e->name, strerror(errno), errno);
+        return -1;
+    }
+    _parec_stamp(&end, &p_stat);
+
+    if (!_parec_stamp_equal(&end, start)) {
+        ctx->backend->purge(ctx, e);
+        PAREC_ERROR(ctx, "parec: file %s has been modified while processing", e->name);
         return -1;
     }
 
+    // generating the final checksums
     for (a = 0; a < ctx->algorithms; a++) {
-        if (EVP_DigestInit(&md_ctx[a], ctx->evp_algorithm[a]) != 1) {
-            PAREC_ERROR(ctx, "parec: initializing digest '%s' has failed", ctx->algorithm[a]);
+        if (computed && computed[a])
+            memcpy(digest[a], computed[a], ctx->dlen[a]);
+        else if (_parec_md_final(ctx, md_ctx, a, digest[a]))
+            return -1;
+        if (out) {
+            memcpy(out[a], digest[a], ctx->dlen[a]);
+        }
+        p_digest[a] = digest[a];
+        p_x_digest[a] = x_digest[a];
+    }
+
+    // storing them in extended attributes or
+    // comparing them with the previous values
+    _parec_tick(ctx, &tick);
+    if (ctx->method != PAREC_METHOD_CHECK) {
+        if (ctx->backend->store(ctx, e, start, stored, p_digest))
+            return -1;
+    }
+    else {
+        parec_log4c_DEBUG("Comparing the stored checksums of '%s'", e->name);
+        if (ctx->backend->stored(ctx, e, NULL, &x_stored, p_x_digest)) {
             return -1;
         }
+        for (a = 0; a < ctx->algorithms; a++) {
+            if (x_stored.layout < 0 || memcmp(digest[a], x_digest[a], ctx->dlen[a])) {
+                PAREC_ERROR(ctx, "parec: checksums (%s) do not match on file '%s'", ctx->algorithm[a], e->name);
+                return -1;
+            }
+            parec_log4c_INFO("parec: checksums (%s) do match on file '%s'", ctx->algorithm[a], e->name);
+        }
+    }
+    _parec_tock(ctx, &tick, PAREC_PHASE_STORAGE);
+
+    type = S_ISREG(p_stat.st_mode) ? PAREC_EVENT_FILE : PAREC_EVENT_DIRECTORY;
+    _parec_count_entry(ctx, type, start->clock);
+    if (ctx->event && _parec_event(ctx, type, e, &p_stat, start))
+        return -1;
+
+    return 0;
+}
+
+// processing an entry, whose checksums are also returned in 'out'
+// (one buffer for each algorithm), if it is set; the entry is closed
+// at the end
+static int _parec_process(parec_ctx *ctx, parec_entry *e, unsigned char **out) {
+    int rc;
+    parec_md *md_ctx;
+    parec_stamp start, stored;
+    struct stat p_stat;
+
+    parec_log4c_DEBUG("Processing '%s'", e->name);
+
+    // the digest lengths are needed for the stored checksums as well
+    if ((rc = parec_init_evp(ctx))) return rc;
+
+    if ((rc = _parec_begin(ctx, e, &p_stat, &start, &stored, out))) {
+        if (rc < 0 && ctx->event)
+            _parec_event_error(ctx, e->name);
+        _parec_entry_close(e);
+        return (rc < 0) ? -1 : 0;
+    }
+
+    // the checksums need to be actually calculated
+    if (!(md_ctx = _parec_md_new(ctx, -1))) {
+        if (ctx->event)
+            _parec_event_error(ctx, e->name);
+        _parec_entry_close(e);
+        return -1;
     }
 
     // the processing function can assume that the entry has not been changed,
     // while processing, otherwise it is going to be detected by the calling
     // context
     if (S_ISREG(p_stat.st_mode)) {
-        if (_parec_file(ctx, name, md_ctx)) return -1;
-    }
-    else if (S_ISDIR(p_stat.st_mode)) {
-        if (_parec_directory(ctx, name, md_ctx)) return -1;
+        rc = _parec_file(ctx, -1, e, &p_stat, md_ctx);
     }
     else {
-        PAREC_ERROR(ctx, "parec: unknown entry type of '%s'", name);
-        return -1;
+        rc = _parec_directory(ctx, e, md_ctx);
     }
 
-    // checking the modification time at the end
-    if ((rc = stat(name, &p_stat))) {
-        PAREC_ERROR(ctx, "parec: could not stat %s (%d)", name, rc);
-        return -1;
+    if (!rc)
+        rc = _parec_finish(ctx, e, &start, &stored, md_ctx, NULL, out);
+
+    _parec_md_free(ctx, -1, md_ctx);
+    if (rc && ctx->event)
+        _parec_event_error(ctx, e->name);
+    _parec_entry_close(e);
+    if (rc) return -1;
+
+    parec_log4c_DEBUG("Finished '%s'", e->name);
+    return 0;
+}
+
+/* Parallel processing
+ *
+ * Each entry is processed by a task of the worker pool. A directory task
+ * reads the directory and submits a new task for each of its entries,
+ * then it returns without waiting for them. The entries pass their
+ * checksums directly into the digest arrays of their parent directory,
+ * and the last finished entry finalizes the checksum of the directory.
+ * Since the digest arrays are filled in the order of readdir(3), just
+ * like in the serial processing, the results are identical.
+ */
+
+// the location of the digest of an entry in the parent's digest array
+static unsigned char *_parec_node_slot(parec_node *node, int a)
+{
+    return node->parent->digest[a] + node->slot * _parec_digest_stride(node->walk->ctx, a);
+}
+
+// checking the entry before the calculation, the stored checksums
+// of an unchanged entry are passed to the parent
+static int _parec_node_begin(parec_node *node, struct stat *p_stat)
+{
+    parec_ctx *ctx = node->walk->ctx;
+    unsigned char *out[ctx->algorithms + 1];    // avoiding a zero length array
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        out[a] = node->parent ? _parec_node_slot(node, a) : NULL;
     }
-    end_mtime = p_stat.st_mtime;
 
-    if (start_mtime != end_mtime) {
-        _parec_purge(ctx, name);
-        PAREC_ERROR(ctx, "parec: file %s has been modified while processing", name);
-        return -1;
+    return _parec_begin(ctx, &node->entry, p_stat, &node->start, &node->stored, node->parent ? out : NULL);
+}
+
+static int _parec_node_finish(parec_node *node, unsigned char **computed)
+{
+    parec_ctx *ctx = node->walk->ctx;
+    unsigned char *out[ctx->algorithms + 1];    // avoiding a zero length array
+
+    for (int a = 0; a < ctx->algorithms; a++) {
+        out[a] = node->parent ? _parec_node_slot(node, a) : NULL;
     }
 
-    // generating the final checksum and
-    //      storing it in an extended attribute or
-    //      comparing it with a previous value
-    for (a = 0; a < ctx->algorithms; a++) {
-        if (EVP_DigestFinal (&md_ctx[a], digest, &dlen) != 1) {
-            PAREC_ERROR(ctx, "parec: finalizing digest '%s' has failed", ctx->algorithm[a]);
-            return -1;
+    return _parec_finish(ctx, &node->entry, &node->start, &node->stored, node->md_ctx, computed, node->parent ? out : NULL);
+}
+
+// Processing a batch of regular files at once: the files, which fit into
+// one buffer, are read by a single submission to io_uring, each one into
+// its own buffer, and they are digested in the order of completion, while
+// the rest of the reads are still in flight. Without io_uring the small
+// files are read one after the other into the buffer of the worker. The
+// algorithms of the multi-buffer engine digest the small files together,
+// once all of them are read. The larger files are read one by one
+// afterwards. The result of each entry is returned in 'rc'.
+static void _parec_node_batch(parec_node **node, int count, int worker, int *rc)
+{
+    parec_ctx *ctx = node[0]->walk->ctx;
+    parec_uring *uring = _parec_uring_get(ctx, worker);
+    struct stat p_stat[count];
+    parec_source src[count];
+    int opened[count], state[count];    // 0: finished, 1: reading, 2: read, 3: large file
+    int lane[count];                    // digested by the multi-buffer engine
+    const unsigned char *data[count];   // the contents of the files in the lanes
+    size_t len[count];
+    unsigned char mb_digest[count][ctx->algorithms + 1][PAREC_MB_MAX_LEN];
+    unsigned char *computed[count][ctx->algorithms + 1];
+    const unsigned char *mb_data[count];
+    size_t mb_len[count];
+    unsigned char *mb_out[count];
+    unsigned char *arena = NULL;        // the buffer of the worker without io_uring
+    size_t used = 0;
+    int mb = _parec_mb_used(ctx);
+    ssize_t n;
+    void *data_id;
+    int i, a, k, r, err;
+    parec_tick tick;
+
+    // checking the entries and starting the reads of the small files
+    for (i = 0; i < count; i++) {
+        rc[i] = 0;
+        opened[i] = 0;
+        state[i] = 0;
+        lane[i] = 0;
+        for (a = 0; a < ctx->algorithms; a++) {
+            computed[i][a] = NULL;
         }
-        if (ctx->method != PAREC_METHOD_CHECK) {
-            parec_log4c_DEBUG("Storing xattr(%s)", ctx->xattr_algorithm[a]);
-            if ((rc = setxattr(name, ctx->xattr_algorithm[a], digest, dlen, 0))) {
-                PAREC_ERROR(ctx, "parec: setting attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_algorithm[a], name, strerror(errno), errno);
-                return -1;
+        parec_log4c_DEBUG("Processing '%s'", node[i]->name);
+
+        if ((r = _parec_node_begin(node[i], &p_stat[i]))) {
+            rc[i] = (r < 0) ? -1 : 0;
+            continue;
+        }
+
+        if (!(node[i]->md_ctx = _parec_md_new(ctx, worker))) {
+            rc[i] = -1;
+            continue;
+        }
+        // the entry might have been replaced since reading the directory
+        if (!S_ISREG(p_stat[i].st_mode)) {
+            PAREC_ERROR(ctx, "parec: '%s' is not a regular file anymore", node[i]->name);
+            rc[i] = -1;
+            continue;
+        }
+        if (uring ? p_stat[i].st_size > BUFLEN
+                  : p_stat[i].st_size > MB_FILE_MAX || used + p_stat[i].st_size > BUFLEN) {
+            state[i] = 3;
+            continue;
+        }
+        lane[i] = mb && p_stat[i].st_size <= MB_FILE_MAX;
+
+        // the small files are too short for direct I/O to pay off
+        if (_parec_source_open(ctx, &src[i], &node[i]->entry, uring != NULL)) {
+            rc[i] = -1;
+            continue;
+        }
+        opened[i] = 1;
+        if (uring) {
+            parec_uring_read(uring, src[i].fd, i, 0, BUFLEN, (void *)(long)i);
+            state[i] = 1;
+            continue;
+        }
+
+        if (!arena && !(arena = _parec_buffer_get(ctx, worker))) {
+            rc[i] = -1;
+            continue;
+        }
+        state[i] = 2;
+        if ((n = _parec_source_pread(&src[i], arena + used, p_stat[i].st_size, 0)) < 0) {
+            PAREC_ERROR(ctx, "parec: reading file '%s' has failed with '%s(%d)'", node[i]->name, strerror(errno), errno);
+            rc[i] = -1;
+            continue;
+        }
+        data[i] = arena + used;
+        len[i] = n;
+        used += n;
+        rc[i] = lane[i] ? _parec_update_single(ctx, node[i]->md_ctx, data[i], n)
+                        : _parec_update(ctx, node[i]->md_ctx, data[i], n, 0, 1);
+    }
+
+    if (uring && parec_uring_submit(uring)) {
+        err = errno;
+        for (i = 0; i < count; i++) {
+            if (state[i] == 1) {
+                PAREC_ERROR(ctx, "parec: submitting read of file '%s' has failed with '%s(%d)'", node[i]->name, strerror(err), err);
+                break;
             }
         }
+    }
+
+    // digesting the small files as they arrive
+    while (uring && parec_uring_get_pending(uring) > 0) {
+        _parec_tick(ctx, &tick);
+        r = parec_uring_wait(uring, &data_id, &n);
+        _parec_tock(ctx, &tick, PAREC_PHASE_READ);
+        if (r) {
+            PAREC_ERROR(ctx, "parec: waiting for reads has failed with '%s(%d)'", strerror(errno), errno);
+            // the files are closed and the buffers are reused only after
+            // the rest of the reads are finished; their files have failed
+            parec_uring_drain(uring);
+            break;
+        }
+        i = (long)data_id;
+        state[i] = 2;
+        n = _parec_source_rest(&src[i], parec_uring_buffer(uring, i), n, p_stat[i].st_size, 0);
+        if (n < 0) {
+            PAREC_ERROR(ctx, "parec: reading file '%s' has failed with '%s(%d)'", node[i]->name, strerror(-n), -n);
+            rc[i] = -1;
+        }
         else {
-            parec_log4c_DEBUG("Comparing xattr(%s)", ctx->xattr_algorithm[a]);
-            if ((rc = getxattr(name, ctx->xattr_algorithm[a], x_digest, EVP_MAX_MD_SIZE)) < 0 && (errno != ENODATA)) {
-                PAREC_ERROR(ctx, "parec: fetching attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_algorithm[a], name, strerror(errno), errno);
+            data[i] = parec_uring_buffer(uring, i);
+            len[i] = n;
+            rc[i] = lane[i] ? _parec_update_single(ctx, node[i]->md_ctx, data[i], n)
+                            : _parec_update(ctx, node[i]->md_ctx, data[i], n, 0, 1);
+            if (!src[i].direct)
+                _parec_source_drop(&src[i], 0, n);
+        }
+    }
+
+    // the lanes of the small files, before the buffers are reused by the
+    // large files
+    for (a = 0; mb && a < ctx->algorithms; a++) {
+        if (ctx->mb_algorithm[a] < 0)
+            continue;
+        for (i = 0, k = 0; i < count; i++) {
+            if (state[i] != 2 || !lane[i] || rc[i])
+                continue;
+            mb_data[k] = data[i];
+            mb_len[k] = len[i];
+            mb_out[k++] = computed[i][a] = mb_digest[i][a];
+        }
+        _parec_tick(ctx, &tick);
+        parec_mb_digest(ctx->mb_algorithm[a], k, mb_data, mb_len, mb_out);
+        _parec_tock(ctx, &tick, PAREC_PHASE_DIGEST);
+        for (i = 0; i < k; i++) {
+            _parec_count_bytes(ctx, a, mb_len[i]);
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (opened[i])
+            _parec_source_close(&src[i]);
+        // the reads, which could not be submitted
+        if (state[i] == 1)
+            rc[i] = -1;
+        if (state[i] == 3)
+            rc[i] = _parec_file(ctx, worker, &node[i]->entry, &p_stat[i], node[i]->md_ctx);
+        if (state[i] && !rc[i])
+            rc[i] = _parec_node_finish(node[i], computed[i]);
+    }
+}
+
+// calculating the directory checksum, once all the entries are finished
+static int _parec_node_directory(parec_node *node)
+{
+    parec_ctx *ctx = node->walk->ctx;
+    size_t stride;
+
+    if (PAREC_WALK_FAILED(node->walk))
+        return -1;
+
+    // sorting the checksums and calculating the digests
+    for (int a = 0; a < ctx->algorithms; a++) {
+        stride = _parec_digest_stride(ctx, a);
+        if (_parec_digest_sort(ctx, a, node->digest[a], node->count))
+            return -1;
+        for (int i = 0; i < node->count; i++) {
+            if (_parec_md_update(ctx, node->md_ctx, a, node->digest[a] + i * stride, ctx->dlen[a]))
                 return -1;
+        }
+    }
+
+    return _parec_node_finish(node, NULL);
+}
+
+// releasing a finished entry and finalizing its parent directories,
+// if this was their last unfinished entry
+static void _parec_node_done(parec_node *node, int worker, int rc)
+{
+    parec_node *parent;
+
+    while (node) {
+        if (rc) {
+            PAREC_WALK_FAIL(node->walk);
+            if (node->walk->ctx->event)
+                _parec_event_error(node->walk->ctx, node->name);
+        }
+        else
+            parec_log4c_DEBUG("Finished '%s'", node->name);
+
+        parent = node->parent;
+        _parec_node_free(node, worker);
+
+        if (!parent || __sync_sub_and_fetch(&parent->pending, 1))
+            break;
+
+        rc = _parec_node_directory(parent);
+        node = parent;
+    }
+}
+
+static void _parec_node_task(void *arg, int worker);
+static void _parec_batch_task(void *arg, int worker);
+
+// reading the directory and submitting its entries
+static int _parec_node_scan(parec_node *node, int worker)
+{
+    parec_walk *walk = node->walk;
+    parec_ctx *ctx = walk->ctx;
+    parec_worker *w = _parec_worker(ctx, worker);
+    struct dirent64 *p_dirent;
+    parec_node **child, **tmp;
+    parec_batch *batch = NULL;
+    parec_dir *dir;
+    int rc = 0, i, depth = _parec_batch_len(ctx);
+
+    // the directory itself is kept open for its entries
+    if (!(dir = _parec_dir_open(ctx, worker, &node->entry)))
+        return -1;
+
+    // the entries are collected in the scratch array of the worker, which
+    // is free again, once they are submitted
+    while (!rc && (p_dirent = _parec_dir_read(ctx, dir, &rc)) != NULL) {
+        if (_parec_filter(ctx, p_dirent->d_name)) continue;
+        // extending the array of entries, if necessary
+        if (node->count == w->child_len) {
+            if (!(tmp = realloc(w->child, sizeof(*tmp) * (w->child_len ? w->child_len * 2 : 16)))) {
+                PAREC_ERROR(ctx, "parec: out of memory");
+                rc = -1;
+                break;
             }
-            else if ((rc != (int)dlen) || memcmp(digest, x_digest, dlen)) {
-                PAREC_ERROR(ctx, "parec: checksums (%s) do not match on file '%s'", ctx->algorithm[a], name);
-                return -1;
+            w->child = tmp;
+            w->child_len = w->child_len ? w->child_len * 2 : 16;
+        }
+        if (!(w->child[node->count] = _parec_node_new(walk, worker, node, node->count, node->name, p_dirent->d_name))) {
+            PAREC_ERROR(ctx, "parec: out of memory");
+            rc = -1;
+            break;
+        }
+        w->child[node->count]->entry.type = p_dirent->d_type;
+        node->count++;
+    }
+    child = w->child;
+    _parec_dir_close(ctx, worker, dir);
+
+    // the arrays to hold the digests of the entries
+    if (!rc)
+        rc = _parec_node_digests(node, node->count);
+
+    if (rc) {
+        for (i = 0; i < node->count; i++) {
+            _parec_node_free(child[i], worker);
+        }
+        return -1;
+    }
+    parec_log4c_DEBUG("# entries of '%s': %d", node->name, node->count);
+
+    // the directory itself is also counted as pending until all entries
+    // are submitted, otherwise it could be finalized too early
+    node->pending = node->count + 1;
+    for (i = 0; !rc && i < node->count; i++) {
+        // the regular files are grouped into batches for io_uring or
+        // for the multi-buffer engine
+        if (depth > 1 && child[i]->entry.type == DT_REG) {
+            if (!batch && !(batch = _parec_batch_new(ctx, worker))) {
+                rc = -1;
+                break;
             }
-            else {
-                parec_log4c_INFO("parec: checksums (%s) do match on file '%s'", ctx->algorithm[a], name);
+            batch->node[batch->count++] = child[i];
+            child[i] = NULL;
+            if (batch->count == depth) {
+                if ((rc = parec_pool_submit(ctx->pool, worker, _parec_batch_task, batch)))
+                    break;
+                batch = NULL;
             }
         }
+        else {
+            if ((rc = parec_pool_submit(ctx->pool, worker, _parec_node_task, child[i])))
+                break;
+            child[i] = NULL;
+        }
     }
-
-    // storing the mtime, that we know of unchanged during processing
-    if (x_mtime == 0 || ctx->method == PAREC_METHOD_FORCE) {
-        parec_log4c_DEBUG("Storing xattr(%s)", ctx->xattr_mtime);
-        if ((rc = setxattr(name, ctx->xattr_mtime, &start_mtime, sizeof(start_mtime), 0))) {
-            PAREC_ERROR(ctx, "parec: setting attribute %s has failed on %s with '%s(%d)'.\n", ctx->xattr_mtime, name, strerror(errno), errno);
-            return -1;
+    if (!rc && batch && batch->count) {
+        if (!(rc = parec_pool_submit(ctx->pool, worker, _parec_batch_task, batch)))
+            batch = NULL;
+    }
+    // releasing the entries, which could not be submitted
+    if (rc) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        PAREC_WALK_FAIL(walk);
+        for (i = 0; i < node->count; i++) {
+            if (child[i]) {
+                _parec_node_free(child[i], worker);
+                __sync_sub_and_fetch(&node->pending, 1);
+            }
+        }
+        for (i = 0; batch && i < batch->count; i++) {
+            _parec_node_free(batch->node[i], worker);
+            __sync_sub_and_fetch(&node->pending, 1);
         }
     }
+    if (batch)
+        _parec_batch_free(ctx, worker, batch);
 
+    // releasing the directory
+    if (__sync_sub_and_fetch(&node->pending, 1) == 0) {
+        _parec_node_done(node, worker, _parec_node_directory(node));
+    }
 
-    free(md_ctx);
-    parec_log4c_DEBUG("Finished '%s'", name);
     return 0;
 }
 
+static void _parec_node_task(void *arg, int worker)
+{
+    parec_node *node = arg;
+    parec_ctx *ctx = node->walk->ctx;
+    struct stat p_stat;
+    int rc;
+
+    if (PAREC_WALK_FAILED(node->walk)) {
+        _parec_node_done(node, worker, -1);
+        return;
+    }
+
+    parec_log4c_DEBUG("Processing '%s'", node->name);
+
+    if ((rc = _parec_node_begin(node, &p_stat))) {
+        _parec_node_done(node, worker, (rc < 0) ? -1 : 0);
+        return;
+    }
+
+    if (!(node->md_ctx = _parec_md_new(ctx, worker))) {
+        _parec_node_done(node, worker, -1);
+        return;
+    }
+
+    if (S_ISREG(p_stat.st_mode)) {
+        if ((rc = _parec_file(ctx, worker, &node->entry, &p_stat, node->md_ctx)) == 0)
+            rc = _parec_node_finish(node, NULL);
+        _parec_node_done(node, worker, rc);
+    }
+    else {
+        // the directory is finished by its last entry
+        if (_parec_node_scan(node, worker))
+            _parec_node_done(node, worker, -1);
+    }
+}
+
+static void _parec_batch_task(void *arg, int worker)
+{
+    parec_batch *batch = arg;
+    parec_ctx *ctx = batch->node[0]->walk->ctx;
+    int i, rc[batch->count];
+
+    if (PAREC_WALK_FAILED(batch->node[0]->walk)) {
+        for (i = 0; i < batch->count; i++) {
+            _parec_node_done(batch->node[i], worker, -1);
+        }
+    }
+    else if (!_parec_uring_get(ctx, worker) && !_parec_mb_used(ctx)) {
+        for (i = 0; i < batch->count; i++) {
+            _parec_node_task(batch->node[i], worker);
+        }
+    }
+    else {
+        _parec_node_batch(batch->node, batch->count, worker, rc);
+        for (i = 0; i < batch->count; i++) {
+            _parec_node_done(batch->node[i], worker, rc[i]);
+        }
+    }
+    _parec_batch_free(ctx, worker, batch);
+}
+
+// processing a batch of regular files of a directory in the serial mode,
+// the checksums are passed to the digest arrays of their parent node;
+// the nodes are released in any case
+static int _parec_process_batch(parec_node **node, int count)
+{
+    int i, rc[count], failed = 0;
+
+    _parec_node_batch(node, count, -1, rc);
+
+    for (i = 0; i < count; i++) {
+        if (!failed && rc[i]) {
+            failed = -1;
+            if (node[i]->walk->ctx->event)
+                _parec_event_error(node[i]->walk->ctx, node[i]->name);
+        }
+        else if (!failed)
+            parec_log4c_DEBUG("Finished '%s'", node[i]->name);
+        _parec_node_free(node[i], -1);
+    }
+
+    return failed;
+}
+
+static int _parec_process_parallel(parec_ctx *ctx, const char *name)
+{
+    parec_walk walk;
+    parec_node *root;
+
+    if (parec_init_evp(ctx)) return -1;
+
+    if (!ctx->pool && !(ctx->pool = parec_pool_new(ctx->threads))) {
+        PAREC_ERROR(ctx, "parec: could not start %d threads", ctx->threads);
+        return -1;
+    }
+
+    walk.ctx = ctx;
+    walk.failed = 0;
+    walk.dlen = ctx->dlen;
+
+    if (!(root = _parec_node_new(&walk, -1, NULL, 0, name, NULL))) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        return -1;
+    }
+
+    if (parec_pool_submit(ctx->pool, -1, _parec_node_task, root)) {
+        PAREC_ERROR(ctx, "parec: out of memory");
+        _parec_node_free(root, -1);
+        return -1;
+    }
+    parec_pool_wait(ctx->pool);
+
+    return walk.failed ? -1 : 0;
+}
+
+int parec_process(parec_ctx *ctx, const char *name) {
+    parec_entry e = { AT_FDCWD, name, name, -1, DT_UNKNOWN, 0, 0, NULL };
+
+    PAREC_CHECK_CONTEXT(ctx)
+
+    // the digest lengths are needed for the records of the index
+    if (parec_init_evp(ctx) || _parec_storage_start(ctx) || _parec_workers_start(ctx)) return -1;
+
+    ctx->event_failed = 0;
+    if (ctx->threads > 1)
+        return _parec_process_parallel(ctx, name);
+
+    return _parec_process(ctx, &e, NULL);
+}
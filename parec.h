@@ -35,6 +35,195 @@ typedef enum {
     PAREC_METHOD_FORCE,
 } parec_method;
 
+/**
+ * Cache policies of the reads:
+ * - NORMAL, the files are read through the page cache as usual
+ * - DROP_BEHIND, the pages of the files are dropped from the page cache
+ *                as soon as they are read
+ * - DIRECT, the files are read with O_DIRECT, bypassing the page cache,
+ *           except for their unaligned tail, which is dropped after reading
+ */
+typedef enum {
+    PAREC_CACHE_NORMAL,
+    PAREC_CACHE_DROP_BEHIND,
+    PAREC_CACHE_DIRECT,
+} parec_cache_policy;
+
+/**
+ * Reading methods of the files:
+ * - STDIO, reading the files block by block
+ * - URING, keeping multiple reads in flight through io_uring(7), both
+ *          for the blocks of a large file and for small files of the
+ *          same directory, falling back to STDIO, if io_uring is not
+ *          available
+ * - MMAP, digesting the files larger than a threshold directly from
+ *         their memory mapping, without copying them into a buffer
+ */
+typedef enum {
+    PAREC_IO_STDIO,
+    PAREC_IO_URING,
+    PAREC_IO_MMAP,
+} parec_io_method;
+
+/**
+ * Layouts of the stored checksums:
+ * - SEPARATE, one extended attribute for each algorithm with the digest
+ *             and one for the modification time
+ * - PACKED, a single extended attribute with a versioned record of the
+ *           digests of all the algorithms and the fingerprint of the
+ *           entry (modification time with nanoseconds and size), so
+ *           checking an entry takes only one system call
+ */
+typedef enum {
+    PAREC_XATTR_SEPARATE,
+    PAREC_XATTR_PACKED,
+} parec_xattr_format;
+
+/**
+ * Versions of the directory checksums, which are the digests of the
+ * sorted checksums of their entries:
+ * - V1, the checksums are ordered as C strings, that is only up to their
+ *       first zero byte, like the checksums stored by the earlier versions
+ * - V2, the checksums are ordered by all their bytes, and they are sorted
+ *       by a radix sort in a contiguous array, which is faster for large
+ *       directories
+ * The checksums of the files are the same in both versions.
+ */
+typedef enum {
+    PAREC_DIR_DIGEST_V1,
+    PAREC_DIR_DIGEST_V2,
+} parec_dir_digest;
+
+/**
+ * Storages of the checksums:
+ * - XATTR, extended attributes of the entries in one of the layouts
+ *          of parec_xattr_format
+ * - INDEX, a single memory mapped index file keyed by the device and
+ *          inode numbers of the entries (see parec_set_index_file()),
+ *          for file systems without user extended attributes, or to keep
+ *          the checksums of a dataset in one file
+ */
+typedef enum {
+    PAREC_STORAGE_XATTR,
+    PAREC_STORAGE_INDEX,
+} parec_storage;
+
+/**
+ * Formats of the manifests:
+ * - BINARY, a compact stream of the relative paths, types, sizes,
+ *           modification times and digests of the entries, which can
+ *           be imported (see parec_import())
+ * - TEXT, the format of 'md5sum --tag' for the files, with a line for
+ *         each algorithm, which can be checked by md5sum(1), sha1sum(1)
+ *         etc. with their '-c' option
+ */
+typedef enum {
+    PAREC_MANIFEST_BINARY,
+    PAREC_MANIFEST_TEXT,
+} parec_manifest_format;
+
+/**
+ * Kinds of the differences of two trees (see parec_diff()):
+ * - ADDED, the entry exists only in the second tree
+ * - REMOVED, the entry exists only in the first tree
+ * - CHANGED, the checksums or the types of the entries differ
+ * - UNKNOWN, the entries cannot be compared, since at least one of them
+ *            has no up-to-date checksums
+ */
+typedef enum {
+    PAREC_DIFF_ADDED,
+    PAREC_DIFF_REMOVED,
+    PAREC_DIFF_CHANGED,
+    PAREC_DIFF_UNKNOWN,
+} parec_diff_type;
+
+/**
+ * Callback of parec_diff(), which is called for each difference.
+ * @param path  The path of the entry relative to the roots of the trees,
+ *              "." for the roots themselves.
+ * @param type  The kind of the difference.
+ * @param arg   The argument given to parec_diff().
+ */
+typedef void (*parec_diff_callback)(const char *path, parec_diff_type type, void *arg);
+
+/**
+ * Events of the processing (see parec_set_event_callback()):
+ * - START, an entry is opened
+ * - FILE, the checksums of a regular file are calculated
+ * - SKIP, an entry is unchanged, so its stored checksums are used
+ * - DIRECTORY, the checksums of a directory are calculated
+ * - ERROR, an entry has failed, which stops the processing
+ */
+typedef enum {
+    PAREC_EVENT_START,
+    PAREC_EVENT_FILE,
+    PAREC_EVENT_SKIP,
+    PAREC_EVENT_DIRECTORY,
+    PAREC_EVENT_ERROR,
+} parec_event_type;
+
+/**
+ * An event of the processing, which is valid only during the callback.
+ */
+typedef struct {
+    parec_event_type    type;
+    const char          *name;      /**< The name of the entry. */
+    long long           size;       /**< The size of a regular file, 0 for the directories. */
+    double              seconds;    /**< The time of calculating the checksums of FILE and DIRECTORY. */
+    const char          *error;     /**< The error message of ERROR, NULL otherwise. */
+} parec_event;
+
+/**
+ * Callback of the events of parec_process().
+ * @param event The event.
+ * @param arg   The argument given to parec_set_event_callback().
+ * @return 0 to continue, or anything else to stop the processing
+ *         with an error. The return value of ERROR is ignored.
+ */
+typedef int (*parec_event_callback)(const parec_event *event, void *arg);
+
+/**
+ * Phases of the processing timed by the profiling (see parec_set_profile()):
+ * - OPEN, opening the entries and getting their status
+ * - DIRECTORY, reading the entries of the directories
+ * - STORAGE, reading, writing and removing the stored checksums
+ * - READ, reading the files, including the waits for io_uring
+ * - DIGEST, calculating the digests
+ * - SORT, sorting the checksums of the entries of the directories
+ */
+typedef enum {
+    PAREC_PHASE_OPEN,
+    PAREC_PHASE_DIRECTORY,
+    PAREC_PHASE_STORAGE,
+    PAREC_PHASE_READ,
+    PAREC_PHASE_DIGEST,
+    PAREC_PHASE_SORT,
+    PAREC_PHASES,
+} parec_phase;
+
+/** The number of the buckets of the latency histogram. */
+#define PAREC_STATS_BUCKETS 32
+
+/**
+ * Statistics of the profiling, summed over the threads.
+ */
+typedef struct {
+    unsigned long long  wall_ns[PAREC_PHASES];  /**< The wall-clock time of each phase. */
+    unsigned long long  cpu_ns[PAREC_PHASES];   /**< The CPU time of the threads in each phase. */
+    unsigned long long  calls[PAREC_PHASES];    /**< The number of timed operations of each phase. */
+    unsigned long long  xattr_get;              /**< The number of fgetxattr(2) calls. */
+    unsigned long long  xattr_set;              /**< The number of fsetxattr(2) calls. */
+    unsigned long long  xattr_remove;           /**< The number of fremovexattr(2) calls. */
+    unsigned long long  files_hashed;
+    unsigned long long  entries_skipped;        /**< The unchanged files and directories. */
+    unsigned long long  directories_hashed;
+    /** The hashed files by their latency: bucket 0 counts the files under
+     *  1 microsecond, bucket i the ones from 2^(i-1) to 2^i microseconds,
+     *  and the last bucket all the slower ones. */
+    unsigned long long  latency[PAREC_STATS_BUCKETS];
+    int                 algorithms;             /**< The number of algorithms. */
+    unsigned long long  *bytes;                 /**< The digested bytes of each algorithm. */
+} parec_stats;
 
 /* Opaque data structure used by the library. */
 typedef struct _parec_ctx   parec_ctx;
@@ -53,6 +242,10 @@ void parec_free(parec_ctx *ctx);
 
 /**
  * Add a new checksum algorithm to be used during calculations.
+ * The name is either one of the built in "blake3", "xxh3-128" and
+ * "crc32c", or the name of an OpenSSL digest, like "md5" or "sha1".
+ * Neither XXH3 nor CRC-32C is cryptographic: they detect accidental
+ * corruption only, but at the speed of the memory.
  * @param ctx   The parec context.
  * @param alg   The name of the algorithm.
  * @return 0 when successful and -1 in case of an error.
@@ -86,6 +279,8 @@ const char *parec_get_xattr_name(parec_ctx *ctx, int idx);
 
 /**
  * Get the value of the extended attribute for a given checksum algorithm.
+ * It is read from the storage of the context (see parec_set_storage()),
+ * from either layout of the extended attributes.
  * @param ctx   The parec context.
  * @param idx   The index of the checksum.
  * @param name      The file or directory name.
@@ -149,9 +344,360 @@ const char *parec_get_exclude_pattern(parec_ctx *ctx, int idx);
  */
 const char *parec_get_error(parec_ctx *ctx);
 
+/**
+ * Set the number of worker threads.
+ * With more than one thread the files and subdirectories of a directory
+ * are processed concurrently, and the checksum of a directory is calculated
+ * as soon as all of its entries are finished. The checksums are identical
+ * to the ones calculated by a single thread.
+ * @param ctx       The parec context.
+ * @param threads   The number of threads, 0 and 1 mean serial processing.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_threads(parec_ctx *ctx, int threads);
+
+/**
+ * Get the number of worker threads.
+ * @param ctx   The parec context.
+ * @return the number of worker threads and -1 in case of an error.
+ */
+int parec_get_threads(parec_ctx *ctx);
+
+/**
+ * Set the number of buffers for pipelined reading.
+ * Files larger than one buffer are read by a separate thread into a ring
+ * of buffers, while the already filled buffers are being digested, so the
+ * disk and the CPU are used at the same time.
+ * @param ctx       The parec context.
+ * @param buffers   The number of buffers in the ring, less than 2 disables
+ *                  pipelining (default).
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_pipeline(parec_ctx *ctx, int buffers);
+
+/**
+ * Get the number of buffers for pipelined reading.
+ * @param ctx   The parec context.
+ * @return the number of buffers and -1 in case of an error.
+ */
+int parec_get_pipeline(parec_ctx *ctx);
+
+/**
+ * Enable or disable the parallel digests.
+ * When enabled, every buffer of a file larger than one buffer is digested
+ * by all the algorithms at the same time, each of them in its own thread,
+ * so a large file is processed at the speed of the slowest algorithm,
+ * instead of the sum of all of them. The file is read ahead as described
+ * at parec_set_pipeline().
+ * @param ctx       The parec context.
+ * @param enabled   Non-zero to enable and zero to disable (default).
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_parallel_digests(parec_ctx *ctx, int enabled);
+
+/**
+ * Get whether the parallel digests are enabled.
+ * @param ctx   The parec context.
+ * @return 1 if enabled, 0 if disabled and -1 in case of an error.
+ */
+int parec_get_parallel_digests(parec_ctx *ctx);
+
+/**
+ * Set the number of threads hashing one file by a tree hash (blake3)
+ * or by chunks (see parec_set_chunk_size()).
+ * The large reads of a file are split into subtrees, which are hashed
+ * by the given number of threads, including the calling one, at the same
+ * time. The threads are shared by the worker threads, and only one file
+ * is hashed by them at a time, while the other files are hashed by their
+ * worker alone.
+ * @param ctx       The parec context.
+ * @param threads   The number of threads, 0 or 1 disables it (default).
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_tree_threads(parec_ctx *ctx, int threads);
+
+/**
+ * Get the number of threads hashing one file by a tree hash.
+ * @param ctx   The parec context.
+ * @return the number of threads and -1 in case of an error.
+ */
+int parec_get_tree_threads(parec_ctx *ctx);
+
+/**
+ * Enable or disable the multi-buffer digests of the small files.
+ * The small regular files of a directory are read together, and they
+ * are hashed by md5, sha1 and sha256 at the same time, each file in its
+ * own lane of the SIMD instructions. The other algorithms digest the
+ * files one by one as usual. SHA-1 and SHA-256 are left to OpenSSL on
+ * the processors with the SHA extensions.
+ * @param ctx       The parec context.
+ * @param enabled   Non-zero to enable it, 0 to disable it (default).
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_multi_buffer(parec_ctx *ctx, int enabled);
+
+/**
+ * Get whether the multi-buffer digests are enabled.
+ * @param ctx   The parec context.
+ * @return 1 if enabled, 0 if disabled and -1 in case of an error.
+ */
+int parec_get_multi_buffer(parec_ctx *ctx);
+
+/**
+ * Set the size of the chunks of the regular files.
+ * Each chunk of a file is hashed on its own by every algorithm, and the
+ * checksum of the file is the digest of the digests of its chunks in
+ * the order of the file (an empty file has no chunks). These checksums
+ * differ from the plain ones, so they are stored under the name of the
+ * algorithm with the chunk size, like "md5.chunked-4M". The chunks of
+ * a large file are read by pread(2) and hashed by the threads set by
+ * parec_set_tree_threads() at the same time. The files are read one by
+ * one in this mode, the I/O method and the parallel digests are not used.
+ * It has to be set before the checksums are initialized.
+ * @param ctx       The parec context.
+ * @param size      The size in bytes, a multiple of 4096,
+ *                  or 0 to disable it (default).
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_chunk_size(parec_ctx *ctx, long long size);
+
+/**
+ * Get the size of the chunks of the regular files.
+ * @param ctx   The parec context.
+ * @return the size in bytes, 0 if disabled and -1 in case of an error.
+ */
+long long parec_get_chunk_size(parec_ctx *ctx);
+
+/**
+ * Set the directory of the chunk lists.
+ * The digests of the chunks of each file (see parec_set_chunk_size())
+ * are kept in a list in this directory, and when a changed file is hashed
+ * again, only its chunks with a different length or different extents
+ * (FIEMAP) are read, like the appended tail of a log. The chunks without
+ * data (SEEK_DATA) are not read either, if they had none before. An
+ * overwrite in place, which keeps the blocks of the file, is not noticed,
+ * so it is meant for append-only files and copy-on-write file systems.
+ * The lists are not used by PAREC_METHOD_CHECK and PAREC_METHOD_FORCE,
+ * which read every chunk. The lists are named by the device and inode
+ * numbers of the files, and they are valid only for the same inode with
+ * the same creation time.
+ * @param ctx       The parec context.
+ * @param dirname   The name of an existing directory, or NULL to
+ *                  disable it (default).
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_chunk_store(parec_ctx *ctx, const char *dirname);
+
+/**
+ * Get the directory of the chunk lists.
+ * @param ctx   The parec context.
+ * @return the name of the directory and NULL, if it is not set.
+ * The caller should not deallocate the returned string.
+ */
+const char *parec_get_chunk_store(parec_ctx *ctx);
+
+/**
+ * Set the reading method of the files.
+ * With PAREC_IO_URING the reads of a large file are queued ahead into
+ * the buffers set by parec_set_pipeline() (8 by default), while the
+ * regular files of a directory, which fit into one buffer, are read
+ * by a single submission, saving a system call and a wakeup for each.
+ * Each worker thread has its own queue and buffers.
+ * With PAREC_IO_MMAP the files are mapped in windows of 64MB, which
+ * saves a copy of each byte, when the files are already in the page
+ * cache. Note that truncating a file while it is mapped raises SIGBUS.
+ * @param ctx       The parec context.
+ * @param io        The reading method.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_io_method(parec_ctx *ctx, parec_io_method io);
+
+/**
+ * Get the reading method of the files.
+ * @param ctx   The parec context.
+ * @return the reading method and -1 in case of an error.
+ */
+int parec_get_io_method(parec_ctx *ctx);
+
+/**
+ * Set the size of the smallest file to be mapped with PAREC_IO_MMAP.
+ * The smaller files are read through stdio.
+ * @param ctx       The parec context.
+ * @param size      The size in bytes, 1MB by default.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_mmap_threshold(parec_ctx *ctx, long long size);
+
+/**
+ * Get the size of the smallest file to be mapped.
+ * @param ctx   The parec context.
+ * @return the size in bytes and -1 in case of an error.
+ */
+long long parec_get_mmap_threshold(parec_ctx *ctx);
+
+/**
+ * Set the cache policy of the reads.
+ * A checksum sweep through a large tree reads every file only once,
+ * so caching them just evicts the working set of other processes.
+ * PAREC_CACHE_DIRECT falls back to PAREC_CACHE_DROP_BEHIND on file
+ * systems without direct I/O, for mapped files (see PAREC_IO_MMAP) and
+ * for the files up to 64KB, which are read by a single system call.
+ * @param ctx       The parec context.
+ * @param cache     The cache policy, PAREC_CACHE_NORMAL by default.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_cache_policy(parec_ctx *ctx, parec_cache_policy cache);
+
+/**
+ * Get the cache policy of the reads.
+ * @param ctx   The parec context.
+ * @return the cache policy and -1 in case of an error.
+ */
+int parec_get_cache_policy(parec_ctx *ctx);
+
+/**
+ * Set the layout of the stored checksums.
+ * Both layouts are read, the entries stored in the other layout are
+ * migrated, when they are processed next time.
+ * @param ctx       The parec context.
+ * @param format    The layout, PAREC_XATTR_SEPARATE by default.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_xattr_format(parec_ctx *ctx, parec_xattr_format format);
+
+/**
+ * Get the layout of the stored checksums.
+ * @param ctx   The parec context.
+ * @return the layout and -1 in case of an error.
+ */
+int parec_get_xattr_format(parec_ctx *ctx);
+
+/**
+ * Set the version of the directory checksums.
+ * The stored checksums of the directories can be checked only with the
+ * version, which calculated them.
+ * @param ctx       The parec context.
+ * @param version   The version, PAREC_DIR_DIGEST_V1 by default.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_dir_digest(parec_ctx *ctx, parec_dir_digest version);
+
+/**
+ * Get the version of the directory checksums.
+ * @param ctx   The parec context.
+ * @return the version and -1 in case of an error.
+ */
+int parec_get_dir_digest(parec_ctx *ctx);
+
+/**
+ * Set the memory budget of the checksums of a directory.
+ * The checksums of the entries of a directory are kept in memory until
+ * they are sorted. Above the budget they are sorted in runs, which are
+ * written into a temporary file in $TMPDIR (or /tmp), and the runs are
+ * merged into the directory checksum, which is the same as the one
+ * calculated in memory. The budget applies to the processing by the
+ * calling thread only: the worker threads (see parec_set_threads()) get
+ * every entry of a directory in memory anyway.
+ * @param ctx       The parec context.
+ * @param bytes     The budget in bytes, or 0 for no limit (default).
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_memory_budget(parec_ctx *ctx, long long bytes);
+
+/**
+ * Get the memory budget of the checksums of a directory.
+ * @param ctx   The parec context.
+ * @return the budget in bytes, 0 for no limit and -1 in case of an error.
+ */
+long long parec_get_memory_budget(parec_ctx *ctx);
+
+/**
+ * Set the storage of the checksums.
+ * With PAREC_STORAGE_INDEX the checksums and the fingerprints of the
+ * entries are kept in the index file set by parec_set_index_file(),
+ * which is opened at the first use and locked, while the context uses it.
+ * The stored entries are found by in-memory lookups, without a system call.
+ * Since the entries are identified by their device and inode numbers, the
+ * index is valid only on the file system where it was created, and it
+ * should be kept outside of the processed tree.
+ * @param ctx       The parec context.
+ * @param storage   The storage, PAREC_STORAGE_XATTR by default.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_storage(parec_ctx *ctx, parec_storage storage);
+
+/**
+ * Get the storage of the checksums.
+ * @param ctx   The parec context.
+ * @return the storage and -1 in case of an error.
+ */
+int parec_get_storage(parec_ctx *ctx);
+
+/**
+ * Set the name of the index file of PAREC_STORAGE_INDEX.
+ * The file is created, if it does not exist.
+ * @param ctx       The parec context.
+ * @param filename  The name of the index file.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_index_file(parec_ctx *ctx, const char *filename);
+
+/**
+ * Get the name of the index file.
+ * @param ctx   The parec context.
+ * @return the name of the index file and NULL, if it is not set.
+ * The caller should not deallocate the returned string.
+ */
+const char *parec_get_index_file(parec_ctx *ctx);
+
+/**
+ * Set the callback of the events of the processing.
+ * The callback is called by the worker threads as well (see
+ * parec_set_threads()), but only by one thread at a time, so it
+ * should return quickly. Only the first error of a processing is
+ * reported, the entries failing after it are not.
+ * @param ctx       The parec context.
+ * @param callback  The callback, or NULL to disable the events (default).
+ * @param arg       The argument passed to the callback.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_event_callback(parec_ctx *ctx, parec_event_callback callback, void *arg);
+
+/**
+ * Enable the profiling of the processing.
+ * The threads keep their own counters of the time spent in each phase
+ * (see parec_phase), the system calls of the extended attributes, the
+ * digested bytes and the latency of the files, which are summed by
+ * parec_get_stats(). The time of the helper threads (tree hashes,
+ * chunks, digest threads and read-ahead) is counted as well, so the CPU
+ * time of the phases may exceed the wall-clock time. Each timed
+ * operation costs a few system calls, so it is meant for diagnostics.
+ * @param ctx       The parec context.
+ * @param enabled   Non-zero to enable it with zero counters, 0 to disable
+ *                  it (default).
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_set_profile(parec_ctx *ctx, int enabled);
+
+/**
+ * Get, if the profiling is enabled.
+ * @param ctx   The parec context.
+ * @return 1, if it is enabled, 0, if not and -1 in case of an error.
+ */
+int parec_get_profile(parec_ctx *ctx);
+
+/**
+ * Get the statistics of the profiling since it was enabled, which are
+ * complete, when parec_process() has returned.
+ * @param ctx   The parec context.
+ * @return the statistics, which should be released by free(3) (including
+ *         their bytes in the same allocation), or NULL in case of an error.
+ */
+parec_stats *parec_get_stats(parec_ctx *ctx);
+
 /**
  * Process a file or directory.
- * The checksum values are set in extended attributes.
+ * The checksum values are set in the storage of the context.
  * @param ctx       The parec context.
  * @param name      The file or directory name.
  * @return 0 when successful and -1 in case of an error.
@@ -160,13 +706,71 @@ int parec_process(parec_ctx *ctx, const char *name);
 
 /**
  * Purge a file or directory.
- * The checksum values are remove from the extended attributes recursively.
+ * The checksum values are remove from the storage of the context recursively.
  * @param ctx       The parec context.
  * @param name      The file or directory name.
  * @return 0 when successful and -1 in case of an error.
  */
 int parec_purge(parec_ctx *ctx, const char *name);
 
+/**
+ * Migrate a file or directory to the layout of the stored checksums
+ * (see parec_set_xattr_format()) recursively, without recalculating
+ * them. With PAREC_STORAGE_INDEX the checksums found in the extended
+ * attributes are copied into the index. The entries, which have changed
+ * since their checksums were stored, are left as they are.
+ * @param ctx       The parec context.
+ * @param name      The file or directory name.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_migrate(parec_ctx *ctx, const char *name);
+
+/**
+ * Export the stored checksums of a file or directory recursively into a
+ * manifest. The entries are written as they are walked, with their paths
+ * relative to 'name' ("." is 'name' itself). The entries without
+ * up-to-date checksums are left out, so the tree should be processed first.
+ * @param ctx       The parec context.
+ * @param name      The file or directory name.
+ * @param manifest  The name of the manifest file, which is overwritten.
+ * @param format    The format of the manifest.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_export(parec_ctx *ctx, const char *name, const char *manifest, parec_manifest_format format);
+
+/**
+ * Import the checksums of a binary manifest into the storage of the
+ * context, without reading the data: the checksums of an entry are
+ * stored, only if its type, size and modification time (with nanoseconds)
+ * match the ones in the manifest. The size of the directories is ignored.
+ * This way a copy preserving the modification times, e.g. by 'cp -a' or
+ * 'rsync -a', inherits the checksums of the source, which can be
+ * verified later by PAREC_METHOD_CHECK. The other entries are left as
+ * they are.
+ * @param ctx       The parec context.
+ * @param name      The file or directory name, which the paths of the
+ *                  manifest are relative to.
+ * @param manifest  The name of the manifest file.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_import(parec_ctx *ctx, const char *name, const char *manifest);
+
+/**
+ * Compare two trees, which are already processed, by their stored
+ * checksums, without reading the files. The trees are descended only
+ * where the checksums of their directories differ, and the entries of
+ * the differing directories are matched by their names, so the cost is
+ * proportional to the number of differences, not to the size of the trees.
+ * A directory is reported as changed only, if none of its entries is.
+ * @param ctx       The parec context.
+ * @param a         The first file or directory.
+ * @param b         The second file or directory.
+ * @param callback  The function called for each difference.
+ * @param arg       The argument passed to the callback.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_diff(parec_ctx *ctx, const char *a, const char *b, parec_diff_callback callback, void *arg);
+
 #ifdef __cplusplus
 }
 #endif
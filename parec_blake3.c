@@ -0,0 +1,825 @@
+/*
+ * parec_blake3 -- BLAKE3 hash function
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "parec_blake3.h"
+
+/*
+ * The input is split into chunks of 16 blocks, and each chunk is
+ * compressed block by block into a chaining value. The chaining values
+ * are the leaves of a left-balanced binary tree, whose parents compress
+ * the chaining values of their two children. The root is compressed with
+ * the ROOT flag, which gives the digest.
+ *
+ * The hasher keeps the last, incomplete chunk and a stack of the
+ * chaining values of the complete subtrees. The large updates are hashed
+ * by whole subtrees, whose chunks and parents are compressed by several
+ * lanes of a SIMD kernel at the same time. The subtrees may also be split
+ * into equal pieces, which are hashed by the threads of a team.
+ */
+
+#define CHUNK_LEN 1024
+#define BLOCK_LEN 64
+#define OUT_LEN 32
+/* Number of lanes of the widest kernel. */
+#define MAX_DEGREE 16
+/* Depth of the tree for 2^64 bytes of input. */
+#define MAX_DEPTH 54
+/* Largest number of pieces of an input shared by a team. */
+#define TEAM_PIECES 64
+
+/* Smallest piece of an input hashed by a thread of a team. */
+static const size_t TEAM_PIECE = 128 * 1024;
+
+enum {
+    CHUNK_START = 1 << 0,
+    CHUNK_END = 1 << 1,
+    PARENT = 1 << 2,
+    ROOT = 1 << 3,
+};
+
+static const uint32_t IV[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+// the order of the message words in each round
+static const uint8_t MSG[7][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    {  2,  6,  3, 10,  7,  0,  4, 13,  1, 11, 12,  5,  9, 14, 15,  8 },
+    {  3,  4, 10, 12, 13,  2,  7, 14,  6,  5,  9,  0, 11, 15,  8,  1 },
+    { 10,  7, 12,  9, 14,  3, 13, 15,  4,  0, 11,  2,  5,  8,  1,  6 },
+    { 12, 13,  9, 11, 15, 10, 14,  8,  7,  2,  5,  3,  0,  1,  6,  4 },
+    {  9, 14, 11,  5,  8, 12, 15,  1, 13,  3,  0, 10,  2,  6,  4,  7 },
+    { 11, 15,  5,  0,  1,  9,  8,  6, 14, 10,  2, 12,  3,  4,  7, 13 },
+};
+
+// the operations work both on words and on vectors of words
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define G(v, a, b, c, d, x, y) { \
+    v[a] = v[a] + v[b] + (x); v[d] = ROTR(v[d] ^ v[a], 16); \
+    v[c] = v[c] + v[d];       v[b] = ROTR(v[b] ^ v[c], 12); \
+    v[a] = v[a] + v[b] + (y); v[d] = ROTR(v[d] ^ v[a], 8); \
+    v[c] = v[c] + v[d];       v[b] = ROTR(v[b] ^ v[c], 7); \
+}
+
+#define ROUND(v, m, r) { \
+    G(v, 0, 4,  8, 12, m[MSG[r][0]],  m[MSG[r][1]]) \
+    G(v, 1, 5,  9, 13, m[MSG[r][2]],  m[MSG[r][3]]) \
+    G(v, 2, 6, 10, 14, m[MSG[r][4]],  m[MSG[r][5]]) \
+    G(v, 3, 7, 11, 15, m[MSG[r][6]],  m[MSG[r][7]]) \
+    G(v, 0, 5, 10, 15, m[MSG[r][8]],  m[MSG[r][9]]) \
+    G(v, 1, 6, 11, 12, m[MSG[r][10]], m[MSG[r][11]]) \
+    G(v, 2, 7,  8, 13, m[MSG[r][12]], m[MSG[r][13]]) \
+    G(v, 3, 4,  9, 14, m[MSG[r][14]], m[MSG[r][15]]) \
+}
+
+#define ROUNDS(v, m) { \
+    ROUND(v, m, 0) ROUND(v, m, 1) ROUND(v, m, 2) ROUND(v, m, 3) \
+    ROUND(v, m, 4) ROUND(v, m, 5) ROUND(v, m, 6) \
+}
+
+// compressing the same number of blocks of several inputs, the lanes
+// of a kernel, into their chaining values
+typedef void (*parec_blake3_hash)(const uint8_t *const *inputs, size_t blocks, uint64_t counter, int increment, uint8_t flags, uint8_t flags_start, uint8_t flags_end, uint8_t *out);
+
+typedef struct {
+    const char                  *name;
+    size_t                      degree;         // number of lanes
+    parec_blake3_hash           hash;
+} parec_blake3_kernel_t;
+
+// the last chunk of the input
+typedef struct {
+    uint32_t                    cv[8];
+    uint64_t                    counter;        // index of the chunk
+    uint8_t                     buf[BLOCK_LEN]; // zero padded
+    uint8_t                     buf_len;
+    uint8_t                     blocks;         // number of compressed blocks
+} parec_blake3_chunk;
+
+// the last compression of a node, which is done either for the
+// chaining value or with the ROOT flag for the digest
+typedef struct {
+    uint32_t                    cv[8];
+    uint8_t                     block[BLOCK_LEN];
+    uint64_t                    counter;
+    uint8_t                     block_len;
+    uint8_t                     flags;
+} parec_blake3_output;
+
+struct _parec_blake3 {
+    parec_blake3_team           *team;
+    parec_blake3_chunk          chunk;
+    uint8_t                     cv_stack[(MAX_DEPTH + 1) * OUT_LEN];
+    uint8_t                     cv_stack_len;
+};
+
+struct _parec_blake3_team {
+    pthread_mutex_t             lock;
+    pthread_cond_t              work;           // signalled, when a new input is shared
+    pthread_cond_t              done;           // signalled, when the last piece is hashed
+    pthread_t                   *thread;
+    int                         threads;        // number of started threads
+    int                         quit;
+    int                         busy;           // a hasher is using the team
+    size_t                      max_pieces;
+    // the input being hashed
+    const uint8_t               *input;
+    size_t                      piece_len;
+    uint64_t                    counter;        // index of the first chunk
+    size_t                      pieces;
+    size_t                      next;           // the next piece to be hashed
+    size_t                      finished;       // number of hashed pieces
+    uint8_t                     cv[TEAM_PIECES * OUT_LEN];
+};
+
+// the available kernels, widest first, and their number
+static parec_blake3_kernel_t kernel[3];
+static int kernels;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static inline uint32_t _parec_blake3_load32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void _parec_blake3_store32(uint8_t *p, uint32_t w)
+{
+    p[0] = (uint8_t)w;
+    p[1] = (uint8_t)(w >> 8);
+    p[2] = (uint8_t)(w >> 16);
+    p[3] = (uint8_t)(w >> 24);
+}
+
+static void _parec_blake3_compress(uint32_t v[16], const uint32_t cv[8], const uint8_t block[BLOCK_LEN], uint8_t block_len, uint64_t counter, uint8_t flags)
+{
+    uint32_t m[16];
+
+    for (int i = 0; i < 16; i++) {
+        m[i] = _parec_blake3_load32(block + 4 * i);
+    }
+    for (int i = 0; i < 8; i++) {
+        v[i] = cv[i];
+    }
+    v[8] = IV[0];
+    v[9] = IV[1];
+    v[10] = IV[2];
+    v[11] = IV[3];
+    v[12] = (uint32_t)counter;
+    v[13] = (uint32_t)(counter >> 32);
+    v[14] = block_len;
+    v[15] = flags;
+
+    ROUNDS(v, m)
+}
+
+static void _parec_blake3_compress_cv(uint32_t cv[8], const uint8_t block[BLOCK_LEN], uint8_t block_len, uint64_t counter, uint8_t flags)
+{
+    uint32_t v[16];
+
+    _parec_blake3_compress(v, cv, block, block_len, counter, flags);
+    for (int i = 0; i < 8; i++) {
+        cv[i] = v[i] ^ v[i + 8];
+    }
+}
+
+// compressing the blocks of one input
+static void _parec_blake3_hash_one(const uint8_t *input, size_t blocks, uint64_t counter, uint8_t flags, uint8_t flags_start, uint8_t flags_end, uint8_t out[OUT_LEN])
+{
+    uint32_t cv[8];
+    uint8_t block_flags = flags | flags_start;
+
+    memcpy(cv, IV, sizeof(cv));
+    for (size_t b = 0; b < blocks; b++) {
+        if (b + 1 == blocks)
+            block_flags |= flags_end;
+        _parec_blake3_compress_cv(cv, input + b * BLOCK_LEN, BLOCK_LEN, counter, block_flags);
+        block_flags = flags;
+    }
+    for (int i = 0; i < 8; i++) {
+        _parec_blake3_store32(out + 4 * i, cv[i]);
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+/* A kernel compresses 'lanes' inputs at the same time, each of them in
+ * one lane of the vectors of the state. It is compiled for the
+ * instruction set of its target, and it is called only when the
+ * processor supports that. */
+#define PAREC_BLAKE3_KERNEL(name, isa, lanes) \
+typedef uint32_t name##_vec __attribute__((vector_size(4 * lanes))); \
+\
+__attribute__((target(isa))) \
+static void name(const uint8_t *const *inputs, size_t blocks, uint64_t counter, int increment, uint8_t flags, uint8_t flags_start, uint8_t flags_end, uint8_t *out) \
+{ \
+    name##_vec h[8], v[16], m[16], lo, hi; \
+    uint32_t w[16][lanes] __attribute__((aligned(4 * lanes))); \
+    uint8_t block_flags = flags | flags_start; \
+\
+    for (int l = 0; l < lanes; l++) { \
+        w[0][l] = (uint32_t)(counter + (increment ? l : 0)); \
+        w[1][l] = (uint32_t)((counter + (increment ? l : 0)) >> 32); \
+    } \
+    memcpy(&lo, w[0], sizeof(lo)); \
+    memcpy(&hi, w[1], sizeof(hi)); \
+    for (int i = 0; i < 8; i++) { \
+        h[i] = IV[i] + (name##_vec){ 0 }; \
+    } \
+\
+    for (size_t b = 0; b < blocks; b++) { \
+        if (b + 1 == blocks) \
+            block_flags |= flags_end; \
+        for (int l = 0; l < lanes; l++) { \
+            for (int j = 0; j < 16; j++) { \
+                w[j][l] = _parec_blake3_load32(inputs[l] + b * BLOCK_LEN + 4 * j); \
+            } \
+        } \
+        for (int j = 0; j < 16; j++) { \
+            memcpy(&m[j], w[j], sizeof(m[j])); \
+        } \
+        for (int i = 0; i < 8; i++) { \
+            v[i] = h[i]; \
+        } \
+        v[8] = IV[0] + (name##_vec){ 0 }; \
+        v[9] = IV[1] + (name##_vec){ 0 }; \
+        v[10] = IV[2] + (name##_vec){ 0 }; \
+        v[11] = IV[3] + (name##_vec){ 0 }; \
+        v[12] = lo; \
+        v[13] = hi; \
+        v[14] = BLOCK_LEN + (name##_vec){ 0 }; \
+        v[15] = block_flags + (name##_vec){ 0 }; \
+        ROUNDS(v, m) \
+        for (int i = 0; i < 8; i++) { \
+            h[i] = v[i] ^ v[i + 8]; \
+        } \
+        block_flags = flags; \
+    } \
+\
+    for (int l = 0; l < lanes; l++) { \
+        for (int i = 0; i < 8; i++) { \
+            _parec_blake3_store32(out + l * OUT_LEN + 4 * i, h[i][l]); \
+        } \
+    } \
+}
+
+PAREC_BLAKE3_KERNEL(_parec_blake3_sse41, "sse4.1", 4)
+PAREC_BLAKE3_KERNEL(_parec_blake3_avx2, "avx2", 8)
+PAREC_BLAKE3_KERNEL(_parec_blake3_avx512, "avx512f", 16)
+
+static void _parec_blake3_detect(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        kernel[kernels++] = (parec_blake3_kernel_t){ "avx512", 16, _parec_blake3_avx512 };
+    if (__builtin_cpu_supports("avx2"))
+        kernel[kernels++] = (parec_blake3_kernel_t){ "avx2", 8, _parec_blake3_avx2 };
+    if (__builtin_cpu_supports("sse4.1"))
+        kernel[kernels++] = (parec_blake3_kernel_t){ "sse41", 4, _parec_blake3_sse41 };
+}
+
+#else
+
+static void _parec_blake3_detect(void)
+{
+}
+
+#endif
+
+// the number of lanes of the widest kernel
+static size_t _parec_blake3_degree(void)
+{
+    pthread_once(&kernel_once, _parec_blake3_detect);
+    return kernels ? kernel[0].degree : 1;
+}
+
+const char *parec_blake3_kernel(void)
+{
+    pthread_once(&kernel_once, _parec_blake3_detect);
+    return kernels ? kernel[0].name : "portable";
+}
+
+// compressing the inputs by the widest kernels, and the remainder one by one
+static void _parec_blake3_hash_many(const uint8_t *const *inputs, size_t n, size_t blocks, uint64_t counter, int increment, uint8_t flags, uint8_t flags_start, uint8_t flags_end, uint8_t *out)
+{
+    for (int k = 0; k < kernels; k++) {
+        while (n >= kernel[k].degree) {
+            kernel[k].hash(inputs, blocks, counter, increment, flags, flags_start, flags_end, out);
+            inputs += kernel[k].degree;
+            n -= kernel[k].degree;
+            out += kernel[k].degree * OUT_LEN;
+            if (increment)
+                counter += kernel[k].degree;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        _parec_blake3_hash_one(inputs[i], blocks, counter, flags, flags_start, flags_end, out + i * OUT_LEN);
+        if (increment)
+            counter++;
+    }
+}
+
+static void _parec_blake3_chunk_init(parec_blake3_chunk *chunk, uint64_t counter)
+{
+    memcpy(chunk->cv, IV, sizeof(chunk->cv));
+    chunk->counter = counter;
+    memset(chunk->buf, 0, sizeof(chunk->buf));
+    chunk->buf_len = 0;
+    chunk->blocks = 0;
+}
+
+static size_t _parec_blake3_chunk_len(const parec_blake3_chunk *chunk)
+{
+    return BLOCK_LEN * (size_t)chunk->blocks + chunk->buf_len;
+}
+
+static uint8_t _parec_blake3_chunk_start(const parec_blake3_chunk *chunk)
+{
+    return chunk->blocks ? 0 : CHUNK_START;
+}
+
+// adding input to the chunk, which does not overflow it, the last
+// block is kept in the buffer until the chunk is finished
+static void _parec_blake3_chunk_update(parec_blake3_chunk *chunk, const uint8_t *input, size_t len)
+{
+    size_t take;
+
+    if (chunk->buf_len) {
+        take = BLOCK_LEN - chunk->buf_len;
+        if (take > len)
+            take = len;
+        memcpy(chunk->buf + chunk->buf_len, input, take);
+        chunk->buf_len += take;
+        input += take;
+        len -= take;
+        if (!len)
+            return;
+        _parec_blake3_compress_cv(chunk->cv, chunk->buf, BLOCK_LEN, chunk->counter, _parec_blake3_chunk_start(chunk));
+        chunk->blocks++;
+        chunk->buf_len = 0;
+        memset(chunk->buf, 0, sizeof(chunk->buf));
+    }
+
+    while (len > BLOCK_LEN) {
+        _parec_blake3_compress_cv(chunk->cv, input, BLOCK_LEN, chunk->counter, _parec_blake3_chunk_start(chunk));
+        chunk->blocks++;
+        input += BLOCK_LEN;
+        len -= BLOCK_LEN;
+    }
+
+    memcpy(chunk->buf, input, len);
+    chunk->buf_len = len;
+}
+
+static parec_blake3_output _parec_blake3_chunk_output(const parec_blake3_chunk *chunk)
+{
+    parec_blake3_output output;
+
+    memcpy(output.cv, chunk->cv, sizeof(output.cv));
+    memcpy(output.block, chunk->buf, sizeof(output.block));
+    output.counter = chunk->counter;
+    output.block_len = chunk->buf_len;
+    output.flags = _parec_blake3_chunk_start(chunk) | CHUNK_END;
+    return output;
+}
+
+static parec_blake3_output _parec_blake3_parent_output(const uint8_t block[BLOCK_LEN])
+{
+    parec_blake3_output output;
+
+    memcpy(output.cv, IV, sizeof(output.cv));
+    memcpy(output.block, block, sizeof(output.block));
+    output.counter = 0;
+    output.block_len = BLOCK_LEN;
+    output.flags = PARENT;
+    return output;
+}
+
+static void _parec_blake3_output_cv(const parec_blake3_output *output, uint8_t out[OUT_LEN])
+{
+    uint32_t cv[8];
+
+    memcpy(cv, output->cv, sizeof(cv));
+    _parec_blake3_compress_cv(cv, output->block, output->block_len, output->counter, output->flags);
+    for (int i = 0; i < 8; i++) {
+        _parec_blake3_store32(out + 4 * i, cv[i]);
+    }
+}
+
+static void _parec_blake3_output_root(const parec_blake3_output *output, uint8_t out[OUT_LEN])
+{
+    uint32_t v[16];
+
+    _parec_blake3_compress(v, output->cv, output->block, output->block_len, 0, output->flags | ROOT);
+    for (int i = 0; i < 8; i++) {
+        _parec_blake3_store32(out + 4 * i, v[i] ^ v[i + 8]);
+    }
+}
+
+// the chaining values of the chunks of at most 'degree' chunks of input
+static size_t _parec_blake3_chunks(const uint8_t *input, size_t len, uint64_t counter, uint8_t *out)
+{
+    const uint8_t *chunks[MAX_DEGREE];
+    parec_blake3_chunk chunk;
+    parec_blake3_output output;
+    size_t n = 0;
+
+    while (len - n * CHUNK_LEN >= CHUNK_LEN) {
+        chunks[n] = input + n * CHUNK_LEN;
+        n++;
+    }
+    _parec_blake3_hash_many(chunks, n, CHUNK_LEN / BLOCK_LEN, counter, 1, 0, CHUNK_START, CHUNK_END, out);
+
+    // the last, incomplete chunk
+    if (len > n * CHUNK_LEN) {
+        _parec_blake3_chunk_init(&chunk, counter + n);
+        _parec_blake3_chunk_update(&chunk, input + n * CHUNK_LEN, len - n * CHUNK_LEN);
+        output = _parec_blake3_chunk_output(&chunk);
+        _parec_blake3_output_cv(&output, out + n * OUT_LEN);
+        n++;
+    }
+    return n;
+}
+
+// the chaining values of the parents of pairs of chaining values, an
+// odd one is passed up as it is
+static size_t _parec_blake3_parents(const uint8_t *cvs, size_t n, uint8_t *out)
+{
+    const uint8_t *parents[MAX_DEGREE];
+    size_t p = 0;
+
+    while (n - 2 * p >= 2) {
+        parents[p] = cvs + 2 * p * OUT_LEN;
+        p++;
+    }
+    _parec_blake3_hash_many(parents, p, 1, 0, 0, PARENT, 0, 0, out);
+
+    if (n > 2 * p) {
+        memcpy(out + p * OUT_LEN, cvs + 2 * p * OUT_LEN, OUT_LEN);
+        p++;
+    }
+    return p;
+}
+
+// the length of the left subtree: the largest power of two of chunks,
+// which leaves at least one byte for the right subtree
+static size_t _parec_blake3_left_len(size_t len)
+{
+    uint64_t chunks = (len - 1) / CHUNK_LEN;
+
+    return (size_t)(1ULL << (63 - __builtin_clzll(chunks | 1))) * CHUNK_LEN;
+}
+
+// the chaining values of a subtree, at least two and at most 'degree'
+// of them, unless the subtree is a single chunk
+static size_t _parec_blake3_subtree_wide(const uint8_t *input, size_t len, uint64_t counter, uint8_t *out)
+{
+    uint8_t cvs[2 * MAX_DEGREE * OUT_LEN];
+    size_t degree = _parec_blake3_degree();
+    size_t left_len, left_n, right_n;
+
+    if (len <= degree * CHUNK_LEN)
+        return _parec_blake3_chunks(input, len, counter, out);
+
+    left_len = _parec_blake3_left_len(len);
+    // the portable one also returns two chaining values above the chunks
+    if (left_len > CHUNK_LEN && degree == 1)
+        degree = 2;
+
+    left_n = _parec_blake3_subtree_wide(input, left_len, counter, cvs);
+    right_n = _parec_blake3_subtree_wide(input + left_len, len - left_len, counter + left_len / CHUNK_LEN, cvs + degree * OUT_LEN);
+
+    if (left_n == 1) {
+        memcpy(out, cvs, 2 * OUT_LEN);
+        return 2;
+    }
+    return _parec_blake3_parents(cvs, left_n + right_n, out);
+}
+
+// the chaining values of the two children of the root of a subtree of
+// more than one chunk
+static void _parec_blake3_subtree(const uint8_t *input, size_t len, uint64_t counter, uint8_t out[2 * OUT_LEN])
+{
+    uint8_t cvs[MAX_DEGREE * OUT_LEN], parents[MAX_DEGREE * OUT_LEN / 2];
+    size_t n;
+
+    n = _parec_blake3_subtree_wide(input, len, counter, cvs);
+    while (n > 2) {
+        n = _parec_blake3_parents(cvs, n, parents);
+        memcpy(cvs, parents, n * OUT_LEN);
+    }
+    memcpy(out, cvs, 2 * OUT_LEN);
+}
+
+// the chaining value of a subtree of more than one chunk
+static void _parec_blake3_subtree_cv(const uint8_t *input, size_t len, uint64_t counter, uint8_t out[OUT_LEN])
+{
+    uint8_t block[BLOCK_LEN];
+    parec_blake3_output output;
+
+    _parec_blake3_subtree(input, len, counter, block);
+    output = _parec_blake3_parent_output(block);
+    _parec_blake3_output_cv(&output, out);
+}
+
+/* Teams
+ *
+ * A subtree of the input, which is a power of two chunks, is split into
+ * a power of two pieces, which are also subtrees. The caller and the
+ * threads of the team take the pieces one by one, and the chaining values
+ * of the pieces are reduced to the two children of the subtree by the
+ * caller at the end.
+ */
+
+// hashing the pieces of the shared input, called with the lock held
+static void _parec_blake3_team_work(parec_blake3_team *team)
+{
+    const uint8_t *input;
+    size_t p;
+
+    while (team->next < team->pieces) {
+        p = team->next++;
+        input = team->input + p * team->piece_len;
+        pthread_mutex_unlock(&team->lock);
+
+        _parec_blake3_subtree_cv(input, team->piece_len, team->counter + p * (team->piece_len / CHUNK_LEN), team->cv + p * OUT_LEN);
+
+        pthread_mutex_lock(&team->lock);
+        if (++team->finished == team->pieces)
+            pthread_cond_broadcast(&team->done);
+    }
+}
+
+static void *_parec_blake3_team_thread(void *arg)
+{
+    parec_blake3_team *team = arg;
+
+    pthread_mutex_lock(&team->lock);
+    while (!team->quit) {
+        if (team->next < team->pieces)
+            _parec_blake3_team_work(team);
+        else
+            pthread_cond_wait(&team->work, &team->lock);
+    }
+    pthread_mutex_unlock(&team->lock);
+
+    return NULL;
+}
+
+// hashing a subtree by the team, if it is not busy
+static int _parec_blake3_team_subtree(parec_blake3_team *team, const uint8_t *input, size_t len, uint64_t counter, uint8_t out[2 * OUT_LEN])
+{
+    uint8_t block[BLOCK_LEN];
+    parec_blake3_output output;
+    size_t pieces = team->max_pieces;
+
+    while (pieces > 2 && len / pieces < TEAM_PIECE) {
+        pieces /= 2;
+    }
+    if (len / pieces < TEAM_PIECE)
+        return -1;
+
+    pthread_mutex_lock(&team->lock);
+    if (team->busy) {
+        pthread_mutex_unlock(&team->lock);
+        return -1;
+    }
+    team->busy = 1;
+    team->input = input;
+    team->piece_len = len / pieces;
+    team->counter = counter;
+    team->pieces = pieces;
+    team->next = 0;
+    team->finished = 0;
+    pthread_cond_broadcast(&team->work);
+
+    _parec_blake3_team_work(team);
+    while (team->finished < team->pieces) {
+        pthread_cond_wait(&team->done, &team->lock);
+    }
+    pthread_mutex_unlock(&team->lock);
+
+    // reducing the pieces level by level to the two children of the root
+    while (pieces > 2) {
+        for (size_t p = 0; p < pieces / 2; p++) {
+            output = _parec_blake3_parent_output(team->cv + 2 * p * OUT_LEN);
+            _parec_blake3_output_cv(&output, block);
+            memcpy(team->cv + p * OUT_LEN, block, OUT_LEN);
+        }
+        pieces /= 2;
+    }
+    memcpy(out, team->cv, 2 * OUT_LEN);
+
+    pthread_mutex_lock(&team->lock);
+    team->busy = 0;
+    pthread_mutex_unlock(&team->lock);
+
+    return 0;
+}
+
+parec_blake3_team *parec_blake3_team_new(int threads)
+{
+    parec_blake3_team *team;
+    int rc;
+
+    if (threads < 2) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (!(team = calloc(sizeof(*team), 1)))
+        return NULL;
+    if (!(team->thread = calloc(sizeof(*(team->thread)), threads - 1))) {
+        free(team);
+        return NULL;
+    }
+    pthread_mutex_init(&team->lock, NULL);
+    pthread_cond_init(&team->work, NULL);
+    pthread_cond_init(&team->done, NULL);
+
+    // a few pieces for each thread to balance the load
+    team->max_pieces = 2;
+    while (team->max_pieces < 2 * (size_t)threads && team->max_pieces < TEAM_PIECES) {
+        team->max_pieces *= 2;
+    }
+
+    for (int t = 0; t < threads - 1; t++) {
+        if ((rc = pthread_create(&team->thread[t], NULL, _parec_blake3_team_thread, team))) {
+            parec_blake3_team_free(team);
+            errno = rc;
+            return NULL;
+        }
+        team->threads++;
+    }
+
+    return team;
+}
+
+void parec_blake3_team_free(parec_blake3_team *team)
+{
+    if (!team)
+        return;
+
+    pthread_mutex_lock(&team->lock);
+    team->quit = 1;
+    pthread_cond_broadcast(&team->work);
+    pthread_mutex_unlock(&team->lock);
+
+    for (int t = 0; t < team->threads; t++) {
+        pthread_join(team->thread[t], NULL);
+    }
+    pthread_cond_destroy(&team->done);
+    pthread_cond_destroy(&team->work);
+    pthread_mutex_destroy(&team->lock);
+    free(team->thread);
+    free(team);
+}
+
+/* Hashers */
+
+parec_blake3 *parec_blake3_new(parec_blake3_team *team)
+{
+    parec_blake3 *self;
+
+    pthread_once(&kernel_once, _parec_blake3_detect);
+    if (!(self = malloc(sizeof(*self))))
+        return NULL;
+    self->team = team;
+    parec_blake3_init(self);
+
+    return self;
+}
+
+void parec_blake3_free(parec_blake3 *self)
+{
+    free(self);
+}
+
+void parec_blake3_init(parec_blake3 *self)
+{
+    _parec_blake3_chunk_init(&self->chunk, 0);
+    self->cv_stack_len = 0;
+}
+
+// merging the completed subtrees on the stack, but keeping the last one,
+// which may be the root, so there is a chaining value for each bit of
+// the number of chunks
+static void _parec_blake3_merge(parec_blake3 *self, uint64_t chunks)
+{
+    parec_blake3_output output;
+    uint8_t *block;
+
+    while (self->cv_stack_len > __builtin_popcountll(chunks)) {
+        block = self->cv_stack + (self->cv_stack_len - 2) * OUT_LEN;
+        output = _parec_blake3_parent_output(block);
+        _parec_blake3_output_cv(&output, block);
+        self->cv_stack_len--;
+    }
+}
+
+static void _parec_blake3_push(parec_blake3 *self, const uint8_t cv[OUT_LEN], uint64_t counter)
+{
+    _parec_blake3_merge(self, counter);
+    memcpy(self->cv_stack + self->cv_stack_len * OUT_LEN, cv, OUT_LEN);
+    self->cv_stack_len++;
+}
+
+void parec_blake3_update(parec_blake3 *self, const void *data, size_t len)
+{
+    const uint8_t *input = data;
+    parec_blake3_chunk chunk;
+    parec_blake3_output output;
+    uint8_t cv[2 * OUT_LEN];
+    size_t take, subtree_len;
+    uint64_t chunks;
+
+    // completing the last chunk first
+    if (_parec_blake3_chunk_len(&self->chunk)) {
+        take = CHUNK_LEN - _parec_blake3_chunk_len(&self->chunk);
+        if (take > len)
+            take = len;
+        _parec_blake3_chunk_update(&self->chunk, input, take);
+        input += take;
+        len -= take;
+        if (!len)
+            return;
+        output = _parec_blake3_chunk_output(&self->chunk);
+        _parec_blake3_output_cv(&output, cv);
+        _parec_blake3_push(self, cv, self->chunk.counter);
+        _parec_blake3_chunk_init(&self->chunk, self->chunk.counter + 1);
+    }
+
+    // hashing the largest complete subtrees, which are aligned to their
+    // size, but keeping at least one byte for the last chunk
+    while (len > CHUNK_LEN) {
+        subtree_len = (size_t)1 << (63 - __builtin_clzll(len));
+        while ((subtree_len - 1) & (self->chunk.counter * CHUNK_LEN)) {
+            subtree_len /= 2;
+        }
+        chunks = subtree_len / CHUNK_LEN;
+
+        if (subtree_len <= CHUNK_LEN) {
+            _parec_blake3_chunk_init(&chunk, self->chunk.counter);
+            _parec_blake3_chunk_update(&chunk, input, subtree_len);
+            output = _parec_blake3_chunk_output(&chunk);
+            _parec_blake3_output_cv(&output, cv);
+            _parec_blake3_push(self, cv, self->chunk.counter);
+        }
+        else {
+            if (!self->team || _parec_blake3_team_subtree(self->team, input, subtree_len, self->chunk.counter, cv))
+                _parec_blake3_subtree(input, subtree_len, self->chunk.counter, cv);
+            _parec_blake3_push(self, cv, self->chunk.counter);
+            _parec_blake3_push(self, cv + OUT_LEN, self->chunk.counter + chunks / 2);
+        }
+        self->chunk.counter += chunks;
+        input += subtree_len;
+        len -= subtree_len;
+    }
+
+    if (len) {
+        _parec_blake3_chunk_update(&self->chunk, input, len);
+        _parec_blake3_merge(self, self->chunk.counter);
+    }
+}
+
+void parec_blake3_final(const parec_blake3 *self, unsigned char *digest)
+{
+    parec_blake3_output output;
+    uint8_t block[BLOCK_LEN];
+    size_t n;
+
+    if (!self->cv_stack_len) {
+        output = _parec_blake3_chunk_output(&self->chunk);
+        _parec_blake3_output_root(&output, digest);
+        return;
+    }
+
+    // the last chunk or the last two subtrees are merged with the stack
+    if (_parec_blake3_chunk_len(&self->chunk)) {
+        n = self->cv_stack_len;
+        output = _parec_blake3_chunk_output(&self->chunk);
+    }
+    else {
+        n = self->cv_stack_len - 2;
+        output = _parec_blake3_parent_output(self->cv_stack + n * OUT_LEN);
+    }
+    while (n > 0) {
+        n--;
+        memcpy(block, self->cv_stack + n * OUT_LEN, OUT_LEN);
+        _parec_blake3_output_cv(&output, block + OUT_LEN);
+        output = _parec_blake3_parent_output(block);
+    }
+    _parec_blake3_output_root(&output, digest);
+}
@@ -0,0 +1,96 @@
+/**
+ * parec_blake3 -- BLAKE3 hash function
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#ifndef _PAREC_BLAKE3_H
+#define _PAREC_BLAKE3_H
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * BLAKE3 splits the input into chunks of 1 KiB and hashes them as the
+ * leaves of a binary tree. The chunks are compressed by the widest
+ * SIMD kernel of the processor (SSE4.1, AVX2 or AVX-512), which is
+ * selected at runtime. The large inputs may also be shared by the
+ * threads of a team, which hash the subtrees of the input on several
+ * cores at the same time.
+ */
+
+/** Length of the digest in bytes. */
+#define PAREC_BLAKE3_LEN 32
+
+/* Opaque data structure of the hasher. */
+typedef struct _parec_blake3 parec_blake3;
+
+/* Opaque data structure of a team of threads. */
+typedef struct _parec_blake3_team parec_blake3_team;
+
+/**
+ * Allocates a new team of threads.
+ * @param threads   The number of threads hashing an input, including
+ *                  the thread of the caller.
+ * @return      The team or NULL in case of an error (see errno).
+ */
+parec_blake3_team *parec_blake3_team_new(int threads);
+
+/**
+ * Stops the threads and frees the team.
+ * @param team  The team to be disposed.
+ */
+void parec_blake3_team_free(parec_blake3_team *team);
+
+/**
+ * Allocates a new hasher, which is initialized.
+ * @param team  The team of threads for the large inputs or NULL.
+ *              A team is used by one hasher at a time, the others
+ *              hash their input alone meanwhile.
+ * @return      The hasher or NULL if memory allocation has failed.
+ */
+parec_blake3 *parec_blake3_new(parec_blake3_team *team);
+
+/**
+ * Free the hasher.
+ * @param self  The hasher to be disposed.
+ */
+void parec_blake3_free(parec_blake3 *self);
+
+/**
+ * Initializes the hasher for a new input.
+ * @param self  The hasher.
+ */
+void parec_blake3_init(parec_blake3 *self);
+
+/**
+ * Adds the next part of the input.
+ * @param self  The hasher.
+ * @param input The data.
+ * @param len   The length of the data.
+ */
+void parec_blake3_update(parec_blake3 *self, const void *input, size_t len);
+
+/**
+ * Calculates the digest of the input. The hasher is not modified,
+ * so the input may be continued.
+ * @param self  The hasher.
+ * @param digest The buffer of PAREC_BLAKE3_LEN bytes for the digest.
+ */
+void parec_blake3_final(const parec_blake3 *self, unsigned char *digest);
+
+/**
+ * Get the name of the SIMD kernel used for the chunks.
+ * @return "avx512", "avx2", "sse41" or "portable".
+ */
+const char *parec_blake3_kernel(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PAREC_BLAKE3_H */
@@ -0,0 +1,193 @@
+/*
+ * parec_crc32c -- CRC-32C (Castagnoli) checksum
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "parec_crc32c.h"
+
+/*
+ * The polynomial is used in the reflected bit order, where the
+ * coefficient of x^0 is the highest bit, so the register of the CRC is
+ * a polynomial of degree below 32 modulo the polynomial.
+ *
+ * The CRC32 instruction has a latency of three cycles, but a new one
+ * may be started in each cycle. Therefore the long inputs are split
+ * into three streams, which are checksummed at the same time, and
+ * their registers are combined at the end: the register of a stream is
+ * shifted over the bytes after it by a multiplication with x^(8*len).
+ */
+
+#define POLY 0x82f63b78
+/* Lengths of the streams, interleaved by three. */
+#define LONG 8192
+#define SHORT 256
+
+typedef uint32_t (*parec_crc32c_update)(uint32_t crc, const uint8_t *input, size_t len);
+
+typedef struct {
+    const char                  *name;
+    parec_crc32c_update         update;
+} parec_crc32c_kernel_t;
+
+static parec_crc32c_kernel_t kernel;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+// lookup tables for 8 bytes at a time
+static uint32_t table[8][256];
+// x^(8*LONG) and x^(8*SHORT) modulo the polynomial
+static uint32_t shift_long, shift_short;
+
+// multiplication of two polynomials modulo the polynomial
+static uint32_t _parec_crc32c_multmodp(uint32_t a, uint32_t b)
+{
+    uint32_t m = 1U << 31, p = 0;
+
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ POLY : b >> 1;
+    }
+    return p;
+}
+
+// x^(8*len) modulo the polynomial
+static uint32_t _parec_crc32c_x8nmodp(size_t len)
+{
+    uint32_t p = 1U << 31, x2n = 1U << 30;
+    size_t n = len * 8;
+
+    // x2n is x^(2^k) in the k-th step
+    while (n) {
+        if (n & 1)
+            p = _parec_crc32c_multmodp(x2n, p);
+        x2n = _parec_crc32c_multmodp(x2n, x2n);
+        n >>= 1;
+    }
+    return p;
+}
+
+static uint32_t _parec_crc32c_portable(uint32_t crc, const uint8_t *input, size_t len)
+{
+    uint64_t word;
+
+    while (len && ((uintptr_t)input & 7)) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *input++) & 0xff];
+        len--;
+    }
+    while (len >= 8) {
+        memcpy(&word, input, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        word ^= crc;
+        crc = table[7][word & 0xff] ^ table[6][(word >> 8) & 0xff] ^
+              table[5][(word >> 16) & 0xff] ^ table[4][(word >> 24) & 0xff] ^
+              table[3][(word >> 32) & 0xff] ^ table[2][(word >> 40) & 0xff] ^
+              table[1][(word >> 48) & 0xff] ^ table[0][word >> 56];
+        input += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *input++) & 0xff];
+    }
+    return crc;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+
+#include <immintrin.h>
+
+// three streams of 'stream' bytes in each round
+#define PAREC_CRC32C_STREAMS(stream, shift) \
+    while (len >= 3 * (stream)) { \
+        uint64_t crc0 = crc, crc1 = 0, crc2 = 0, word; \
+        const uint8_t *end = input + (stream); \
+        do { \
+            memcpy(&word, input, sizeof(word)); \
+            crc0 = _mm_crc32_u64(crc0, word); \
+            memcpy(&word, input + (stream), sizeof(word)); \
+            crc1 = _mm_crc32_u64(crc1, word); \
+            memcpy(&word, input + 2 * (stream), sizeof(word)); \
+            crc2 = _mm_crc32_u64(crc2, word); \
+            input += 8; \
+        } while (input < end); \
+        crc = _parec_crc32c_multmodp(shift, (uint32_t)crc0) ^ (uint32_t)crc1; \
+        crc = _parec_crc32c_multmodp(shift, crc) ^ (uint32_t)crc2; \
+        input += 2 * (stream); \
+        len -= 3 * (stream); \
+    }
+
+__attribute__((target("sse4.2")))
+static uint32_t _parec_crc32c_sse42(uint32_t crc, const uint8_t *input, size_t len)
+{
+    uint64_t word;
+
+    while (len && ((uintptr_t)input & 7)) {
+        crc = _mm_crc32_u8(crc, *input++);
+        len--;
+    }
+    PAREC_CRC32C_STREAMS(LONG, shift_long)
+    PAREC_CRC32C_STREAMS(SHORT, shift_short)
+    while (len >= 8) {
+        memcpy(&word, input, sizeof(word));
+        crc = (uint32_t)_mm_crc32_u64(crc, word);
+        input += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *input++);
+    }
+    return crc;
+}
+
+#endif
+
+static void _parec_crc32c_detect(void)
+{
+    uint32_t crc;
+
+    for (int n = 0; n < 256; n++) {
+        crc = n;
+        for (int k = 0; k < 8; k++) {
+            crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+        }
+        table[0][n] = crc;
+    }
+    for (int n = 0; n < 256; n++) {
+        for (int k = 1; k < 8; k++) {
+            table[k][n] = (table[k - 1][n] >> 8) ^ table[0][table[k - 1][n] & 0xff];
+        }
+    }
+    shift_long = _parec_crc32c_x8nmodp(LONG);
+    shift_short = _parec_crc32c_x8nmodp(SHORT);
+
+    kernel = (parec_crc32c_kernel_t){ "portable", _parec_crc32c_portable };
+#if defined(__GNUC__) && defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+        kernel = (parec_crc32c_kernel_t){ "sse42", _parec_crc32c_sse42 };
+#endif
+}
+
+const char *parec_crc32c_kernel(void)
+{
+    pthread_once(&kernel_once, _parec_crc32c_detect);
+    return kernel.name;
+}
+
+uint32_t parec_crc32c(uint32_t crc, const void *input, size_t len)
+{
+    pthread_once(&kernel_once, _parec_crc32c_detect);
+    return ~kernel.update(~crc, input, len);
+}
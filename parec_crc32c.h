@@ -0,0 +1,47 @@
+/**
+ * parec_crc32c -- CRC-32C (Castagnoli) checksum
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#ifndef _PAREC_CRC32C_H
+#define _PAREC_CRC32C_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * CRC-32C is the checksum of iSCSI, SCTP, ext4 and btrfs, which detects
+ * accidental changes, but not deliberate ones. It is calculated by the
+ * CRC32 instruction of SSE4.2, if the processor has it, otherwise by
+ * lookup tables. The digest is the checksum in big endian order.
+ */
+
+/** Length of the digest in bytes. */
+#define PAREC_CRC32C_LEN 4
+
+/**
+ * Updates the checksum with the next part of the input.
+ * @param crc   The checksum of the previous parts, 0 at the start.
+ * @param input The data.
+ * @param len   The length of the data.
+ * @return      The checksum including the data.
+ */
+uint32_t parec_crc32c(uint32_t crc, const void *input, size_t len);
+
+/**
+ * Get the name of the implementation used for the checksum.
+ * @return "sse42" or "portable".
+ */
+const char *parec_crc32c_kernel(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PAREC_CRC32C_H */
@@ -0,0 +1,382 @@
+/*
+ * parec_index -- memory mapped index of the checksums
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "parec_index.h"
+
+/*
+ * The file starts with a header, which is followed by the hash table and
+ * the heap of the paths. The table is searched by linear probing, the
+ * removed records are marked, and both the removed records and the
+ * replaced paths are dropped, when the file is rebuilt with a larger
+ * table or heap.
+ */
+
+/* Magic, version and byte order mark of the file. */
+static const char INDEX_MAGIC[8] = "PARECIDX";
+static const uint32_t INDEX_VERSION = 1;
+static const uint32_t INDEX_BOM = 0x01020304;
+/* Initial number of slots (a power of two) and size of the path heap. */
+static const uint64_t INDEX_SLOTS = 1024;
+static const uint64_t INDEX_HEAP = 64 * 1024;
+
+typedef struct {
+    char                        magic[8];
+    uint32_t                    version;
+    uint32_t                    bom;
+    uint64_t                    value_len;
+    uint64_t                    slots;          // number of slots, a power of two
+    uint64_t                    count;          // number of records
+    uint64_t                    used;           // number of records and removed slots
+    uint64_t                    heap_len;       // used length of the path heap
+    uint64_t                    heap_cap;       // size of the path heap
+} parec_index_header;
+
+// a slot of the table, which is followed by the value
+typedef struct {
+    uint64_t                    dev;
+    uint64_t                    ino;
+    uint64_t                    path;           // offset of the path in the heap
+    uint32_t                    path_len;
+    uint32_t                    state;
+} parec_index_slot;
+
+enum { SLOT_FREE = 0, SLOT_USED, SLOT_REMOVED };
+
+struct _parec_index {
+    char                        *filename;
+    int                         fd;
+    unsigned char               *map;
+    size_t                      map_len;
+    parec_index_header          *header;
+    size_t                      slot_len;       // length of a slot with its value
+    pthread_rwlock_t            lock;           // the writers may remap the file
+};
+
+static size_t _parec_index_slot_len(uint64_t value_len)
+{
+    return (sizeof(parec_index_slot) + value_len + 7) / 8 * 8;
+}
+
+static size_t _parec_index_len(size_t slot_len, uint64_t slots, uint64_t heap_cap)
+{
+    return sizeof(parec_index_header) + slot_len * slots + heap_cap;
+}
+
+static parec_index_slot *_parec_index_slot(parec_index *index, uint64_t i)
+{
+    return (parec_index_slot *) (index->map + sizeof(parec_index_header) + index->slot_len * i);
+}
+
+static char *_parec_index_heap(parec_index *index)
+{
+    return (char *) index->map + sizeof(parec_index_header) + index->slot_len * index->header->slots;
+}
+
+static uint64_t _parec_index_hash(uint64_t dev, uint64_t ino)
+{
+    // splitmix64 finalizer
+    uint64_t h = ino ^ (dev * 0x9e3779b97f4a7c15ULL);
+
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+// the slot of an entry, or the slot to insert it into, if 'insert' is set;
+// returns NULL, if it is not found
+static parec_index_slot *_parec_index_find(parec_index *index, uint64_t dev, uint64_t ino, int insert)
+{
+    uint64_t mask = index->header->slots - 1;
+    parec_index_slot *slot, *removed = NULL;
+
+    for (uint64_t i = _parec_index_hash(dev, ino) & mask; ; i = (i + 1) & mask) {
+        slot = _parec_index_slot(index, i);
+        if (slot->state == SLOT_FREE)
+            return insert ? (removed ? removed : slot) : NULL;
+        if (slot->state == SLOT_REMOVED) {
+            if (!removed)
+                removed = slot;
+        }
+        else if (slot->dev == dev && slot->ino == ino) {
+            return slot;
+        }
+    }
+}
+
+// creating an empty index in the opened file 'fd' and mapping it
+static int _parec_index_init(parec_index *index, int fd, uint64_t value_len, uint64_t slots, uint64_t heap_cap)
+{
+    size_t slot_len = _parec_index_slot_len(value_len);
+    size_t len = _parec_index_len(slot_len, slots, heap_cap);
+    unsigned char *map;
+
+    // the new file is all zero, so every slot is free
+    if (ftruncate(fd, len))
+        return -1;
+    if ((map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+        return -1;
+
+    index->fd = fd;
+    index->map = map;
+    index->map_len = len;
+    index->slot_len = slot_len;
+    index->header = (parec_index_header *) map;
+    memcpy(index->header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    index->header->version = INDEX_VERSION;
+    index->header->bom = INDEX_BOM;
+    index->header->value_len = value_len;
+    index->header->slots = slots;
+    index->header->heap_cap = heap_cap;
+    return 0;
+}
+
+static void _parec_index_unmap(parec_index *index)
+{
+    if (index->map)
+        munmap(index->map, index->map_len);
+    if (index->fd >= 0)
+        close(index->fd);
+    index->map = NULL;
+    index->fd = -1;
+}
+
+// rebuilding the file with the given table and heap sizes into a new file,
+// which then replaces the old one
+static int _parec_index_grow(parec_index *index, uint64_t slots, uint64_t heap_cap)
+{
+    parec_index new_index, *old = index;
+    parec_index_slot *slot, *new_slot;
+    char *tmpname;
+    int fd, err;
+
+    if (!(tmpname = malloc(strlen(index->filename) + 5)))
+        return -1;
+    strcpy(tmpname, index->filename);
+    strcat(tmpname, ".tmp");
+
+    if ((fd = open(tmpname, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+        free(tmpname);
+        return -1;
+    }
+    // the new file is locked before it replaces the old one
+    new_index.fd = -1;
+    new_index.map = NULL;
+    if (flock(fd, LOCK_EX) || _parec_index_init(&new_index, fd, old->header->value_len, slots, heap_cap)) {
+        err = errno;
+        if (new_index.fd < 0)
+            close(fd);
+        _parec_index_unmap(&new_index);
+        unlink(tmpname);
+        free(tmpname);
+        errno = err;
+        return -1;
+    }
+
+    // copying the records and their paths
+    for (uint64_t i = 0; i < old->header->slots; i++) {
+        slot = _parec_index_slot(old, i);
+        if (slot->state != SLOT_USED)
+            continue;
+        new_slot = _parec_index_find(&new_index, slot->dev, slot->ino, 1);
+        memcpy(new_slot, slot, old->slot_len);
+        new_slot->path = new_index.header->heap_len;
+        memcpy(_parec_index_heap(&new_index) + new_slot->path, _parec_index_heap(old) + slot->path, slot->path_len + 1);
+        new_index.header->heap_len += slot->path_len + 1;
+        new_index.header->count++;
+        new_index.header->used++;
+    }
+
+    if (rename(tmpname, index->filename)) {
+        err = errno;
+        _parec_index_unmap(&new_index);
+        unlink(tmpname);
+        free(tmpname);
+        errno = err;
+        return -1;
+    }
+    free(tmpname);
+
+    _parec_index_unmap(index);
+    index->fd = new_index.fd;
+    index->map = new_index.map;
+    index->map_len = new_index.map_len;
+    index->header = new_index.header;
+    index->slot_len = new_index.slot_len;
+    return 0;
+}
+
+parec_index *parec_index_open(const char *filename, size_t value_len)
+{
+    parec_index *index;
+    struct stat p_stat;
+    parec_index_header *header;
+    int fd, err;
+
+    if (!(index = calloc(sizeof(*index), 1)))
+        return NULL;
+    index->fd = -1;
+    pthread_rwlock_init(&index->lock, NULL);
+    if (!(index->filename = strdup(filename))) {
+        parec_index_close(index);
+        return NULL;
+    }
+
+    if ((fd = open(filename, O_RDWR | O_CREAT, 0644)) < 0) {
+        parec_index_close(index);
+        return NULL;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) || fstat(fd, &p_stat)) {
+        err = errno;
+        close(fd);
+        parec_index_close(index);
+        errno = err;
+        return NULL;
+    }
+
+    // a new file
+    if (p_stat.st_size == 0) {
+        if (_parec_index_init(index, fd, value_len, INDEX_SLOTS, INDEX_HEAP)) {
+            err = errno;
+            close(fd);
+            parec_index_close(index);
+            errno = err;
+            return NULL;
+        }
+        return index;
+    }
+
+    index->fd = fd;
+    err = EINVAL;
+    if ((size_t) p_stat.st_size >= sizeof(*header)
+        && (index->map = mmap(NULL, p_stat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        err = errno;
+        index->map = NULL;
+    }
+    if (index->map) {
+        index->map_len = p_stat.st_size;
+        header = index->header = (parec_index_header *) index->map;
+        index->slot_len = _parec_index_slot_len(header->value_len);
+        if (!memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) && header->version == INDEX_VERSION
+            && header->bom == INDEX_BOM && header->slots && !(header->slots & (header->slots - 1))
+            && header->heap_len <= header->heap_cap && header->used < header->slots
+            && _parec_index_len(index->slot_len, header->slots, header->heap_cap) <= index->map_len)
+            return index;
+    }
+
+    parec_index_close(index);
+    errno = err;
+    return NULL;
+}
+
+void parec_index_close(parec_index *index)
+{
+    if (!index)
+        return;
+
+    _parec_index_unmap(index);
+    pthread_rwlock_destroy(&index->lock);
+    free(index->filename);
+    free(index);
+}
+
+size_t parec_index_get_value_len(parec_index *index)
+{
+    return index->header->value_len;
+}
+
+uint64_t parec_index_get_count(parec_index *index)
+{
+    uint64_t count;
+
+    pthread_rwlock_rdlock(&index->lock);
+    count = index->header->count;
+    pthread_rwlock_unlock(&index->lock);
+    return count;
+}
+
+int parec_index_get(parec_index *index, uint64_t dev, uint64_t ino, void *value)
+{
+    parec_index_slot *slot;
+
+    pthread_rwlock_rdlock(&index->lock);
+    if ((slot = _parec_index_find(index, dev, ino, 0)))
+        memcpy(value, slot + 1, index->header->value_len);
+    pthread_rwlock_unlock(&index->lock);
+
+    return slot ? 1 : 0;
+}
+
+int parec_index_put(parec_index *index, uint64_t dev, uint64_t ino, const char *path, const void *value)
+{
+    parec_index_header *header;
+    parec_index_slot *slot;
+    size_t len = strlen(path);
+    uint64_t slots;
+
+    pthread_rwlock_wrlock(&index->lock);
+    header = index->header;
+
+    // keeping the table at most 3/4 full, the removed slots are dropped
+    // by the rebuild, so the table may not need to be larger
+    if (header->used + 1 > header->slots / 4 * 3 || header->heap_len + len + 1 > header->heap_cap) {
+        slots = header->slots;
+        if (header->count + 1 > slots / 2)
+            slots *= 2;
+        if (_parec_index_grow(index, slots, header->heap_cap * 2 + len + 1)) {
+            pthread_rwlock_unlock(&index->lock);
+            return -1;
+        }
+        header = index->header;
+    }
+
+    slot = _parec_index_find(index, dev, ino, 1);
+    if (slot->state != SLOT_USED) {
+        if (slot->state == SLOT_FREE)
+            header->used++;
+        header->count++;
+        slot->dev = dev;
+        slot->ino = ino;
+        slot->state = SLOT_USED;
+        slot->path_len = 0;
+        slot->path = header->heap_cap;
+    }
+    // the path is only stored again, if it has changed
+    if (slot->path_len != len || slot->path >= header->heap_cap || memcmp(_parec_index_heap(index) + slot->path, path, len)) {
+        slot->path = header->heap_len;
+        slot->path_len = len;
+        memcpy(_parec_index_heap(index) + slot->path, path, len + 1);
+        header->heap_len += len + 1;
+    }
+    memcpy(slot + 1, value, header->value_len);
+
+    pthread_rwlock_unlock(&index->lock);
+    return 0;
+}
+
+void parec_index_remove(parec_index *index, uint64_t dev, uint64_t ino)
+{
+    parec_index_slot *slot;
+
+    pthread_rwlock_wrlock(&index->lock);
+    if ((slot = _parec_index_find(index, dev, ino, 0))) {
+        slot->state = SLOT_REMOVED;
+        index->header->count--;
+    }
+    pthread_rwlock_unlock(&index->lock);
+}
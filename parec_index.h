@@ -0,0 +1,97 @@
+/**
+ * parec_index -- memory mapped index of the checksums
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#ifndef _PAREC_INDEX_H
+#define _PAREC_INDEX_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The index is a single file, which is mapped into the memory. It is
+ * a hash table of records keyed by the device and inode numbers of the
+ * entries. Every record has the path of the entry and a value of fixed
+ * length, which is opaque for the index. The lookups are in-memory
+ * probes, and the file grows by doubling, when it gets full.
+ *
+ * The file is locked, while it is open, so it is used by one process
+ * at a time, but it may be used by any number of threads of the process.
+ * The records are stored in the byte order of the host.
+ */
+
+/* Opaque data structure of the index. */
+typedef struct _parec_index parec_index;
+
+/**
+ * Opens an index file or creates a new one, if it does not exist.
+ * @param filename  The name of the index file.
+ * @param value_len The length of the values for a new file.
+ * @return      The index or NULL in case of an error, which is
+ *              reported in errno (EINVAL, if the file is not an index,
+ *              and EWOULDBLOCK, if it is used by another process).
+ */
+parec_index *parec_index_open(const char *filename, size_t value_len);
+
+/**
+ * Closes the index.
+ * @param index The index to be closed.
+ */
+void parec_index_close(parec_index *index);
+
+/**
+ * Get the length of the values of the index, which may differ from the
+ * one given at the opening for an existing file.
+ * @param index The index.
+ * @return the length of the values.
+ */
+size_t parec_index_get_value_len(parec_index *index);
+
+/**
+ * Get the number of records.
+ * @param index The index.
+ * @return the number of records.
+ */
+uint64_t parec_index_get_count(parec_index *index);
+
+/**
+ * Looks up the record of an entry.
+ * @param index The index.
+ * @param dev   The device number of the entry.
+ * @param ino   The inode number of the entry.
+ * @param value The buffer of the value, which is copied, if it is found.
+ * @return 1, if the record is found, and 0 otherwise.
+ */
+int parec_index_get(parec_index *index, uint64_t dev, uint64_t ino, void *value);
+
+/**
+ * Adds or updates the record of an entry.
+ * @param index The index.
+ * @param dev   The device number of the entry.
+ * @param ino   The inode number of the entry.
+ * @param path  The path of the entry.
+ * @param value The value of the record.
+ * @return 0 when successful and -1 in case of an error (see errno).
+ */
+int parec_index_put(parec_index *index, uint64_t dev, uint64_t ino, const char *path, const void *value);
+
+/**
+ * Removes the record of an entry, if there is any.
+ * @param index The index.
+ * @param dev   The device number of the entry.
+ * @param ino   The inode number of the entry.
+ */
+void parec_index_remove(parec_index *index, uint64_t dev, uint64_t ino);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PAREC_INDEX_H */
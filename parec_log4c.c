@@ -5,6 +5,7 @@
  * License: LGPLv2.1
  */
 
+#define _GNU_SOURCE                 /* for localtime_r() */
 #include <stdio.h>                  /* for NULL */
 #include <stdlib.h>                 /* for free() */
 #include <string.h>                 /* for strcmpy() and strlen() */
@@ -78,7 +79,6 @@ void parec_log4c_done(void) {
 /* The goal: 2009-07-27 10:40:01,655 */
 #define PAREC_LOG4C_TIME_FORMAT "%F %T"
 #define PAREC_LOG4C_TIME_LENGTH 25
-static char parec_log4c_time[PAREC_LOG4C_TIME_LENGTH];
 
 void parec_log4c_printf(parec_log4c_log_level loglevel, 
     const char *file, const char *function, const int line,
@@ -90,17 +90,17 @@ void parec_log4c_printf(parec_log4c_log_level loglevel,
     va_list ap;
     FILE *logfile = parec_log4c_current_logfile;
     time_t logt;
-    struct tm *logtm;
+    struct tm logtm;
+    char parec_log4c_time[PAREC_LOG4C_TIME_LENGTH];
     const char *basename;
 
     if (NULL == logfile) logfile = stderr;
     
     logt = time(NULL);
-    logtm = localtime(&logt);
-    if (logtm == NULL) {
+    if (localtime_r(&logt, &logtm) == NULL) {
         parec_log4c_time[0] = '\0';
     }
-    else if(strftime(parec_log4c_time, sizeof(parec_log4c_time), PAREC_LOG4C_TIME_FORMAT, logtm) == 0) {
+    else if(strftime(parec_log4c_time, sizeof(parec_log4c_time), PAREC_LOG4C_TIME_FORMAT, &logtm) == 0) {
         parec_log4c_time[0] = '\0';
     }
     
@@ -113,10 +113,13 @@ void parec_log4c_printf(parec_log4c_log_level loglevel,
     }
 
 	va_start(ap, format);
+    // keeping the lines of concurrent threads together
+    flockfile(logfile);
     fprintf(logfile, "%s %s - ", parec_log4c_time, parec_log4c_loglevel_names[loglevel]);
     vfprintf(logfile, format, ap);
     fprintf(logfile, " - %s#%s:%d\n", basename, function, line);
     fflush(logfile);
+    funlockfile(logfile);
 	va_end(ap);
 }
 
@@ -0,0 +1,410 @@
+/*
+ * parec_mb -- multi-buffer MD5, SHA-1 and SHA-256
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+#include "parec_mb.h"
+
+/*
+ * Each lane of a kernel holds the state of one input, and a kernel
+ * compresses a run of consecutive blocks in every lane. The scheduler
+ * runs the kernel, until the shortest input of the lanes is finished,
+ * then it finalizes that input and starts the next one in its lane.
+ *
+ * The full blocks are compressed directly from the input, and the last,
+ * partial block with the padding and the length (one or two blocks) is
+ * built in a buffer of the lane. The idle lanes, when there are no more
+ * inputs, repeat the blocks of another lane and their results are
+ * dropped.
+ */
+
+#define BLOCK_LEN 64
+/* Number of lanes of the widest kernel. */
+#define MAX_LANES 16
+
+enum { MD5, SHA1, SHA256 };
+
+// compressing 'blocks' consecutive blocks of each lane
+typedef void (*parec_mb_compress)(uint32_t state[8][MAX_LANES], const uint8_t *const *block, size_t blocks);
+
+typedef struct {
+    const char                  *name;
+    int                         lanes;
+    parec_mb_compress           compress[3];    // md5, sha1, sha256
+} parec_mb_kernel_t;
+
+typedef struct {
+    const char                  *name;
+    int                         dlen;
+    int                         big_endian;     // of the words and the length
+    uint32_t                    iv[8];
+} parec_mb_algorithm_t;
+
+static const parec_mb_algorithm_t ALGORITHMS[] = {
+    { "md5", 16, 0, { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 } },
+    { "sha1", 20, 1, { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 } },
+    { "sha256", 32, 1, { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 } },
+};
+
+static const uint32_t MD5_K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static parec_mb_kernel_t kernel;
+// the processor has the SHA extensions, which beat the lanes
+static int sha_extensions;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static inline uint32_t _parec_mb_load_le(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t _parec_mb_load_be(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void _parec_mb_store(uint8_t *p, uint32_t v, int big_endian)
+{
+    for (int i = 0; i < 4; i++) {
+        p[big_endian ? 3 - i : i] = (uint8_t)(v >> (8 * i));
+    }
+}
+
+/* The steps of the rounds work on the words of one input and on the
+ * vectors of the lanes alike. */
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define MD5_F(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define MD5_G(b, c, d) ((c) ^ ((d) & ((b) ^ (c))))
+#define MD5_H(b, c, d) ((b) ^ (c) ^ (d))
+#define MD5_I(b, c, d) ((c) ^ ((b) | ~(d)))
+
+#define MD5_STEP(f, a, b, c, d, x, k, s) { \
+    a += f(b, c, d) + (x) + (k); \
+    a = ROTL(a, s) + b; \
+}
+
+// four steps of a round, with the message words of the steps i..i+3
+#define MD5_STEPS(f, m, i, g0, g1, s0, s1, s2, s3) { \
+    MD5_STEP(f, a, b, c, d, m[((g0) + (g1) * (i)) & 15], MD5_K[i], s0) \
+    MD5_STEP(f, d, a, b, c, m[((g0) + (g1) * ((i) + 1)) & 15], MD5_K[(i) + 1], s1) \
+    MD5_STEP(f, c, d, a, b, m[((g0) + (g1) * ((i) + 2)) & 15], MD5_K[(i) + 2], s2) \
+    MD5_STEP(f, b, c, d, a, m[((g0) + (g1) * ((i) + 3)) & 15], MD5_K[(i) + 3], s3) \
+}
+
+#define MD5_BLOCK(m) { \
+    for (int i = 0; i < 16; i += 4) MD5_STEPS(MD5_F, m, i, 0, 1, 7, 12, 17, 22) \
+    for (int i = 16; i < 32; i += 4) MD5_STEPS(MD5_G, m, i, 1, 5, 5, 9, 14, 20) \
+    for (int i = 32; i < 48; i += 4) MD5_STEPS(MD5_H, m, i, 5, 3, 4, 11, 16, 23) \
+    for (int i = 48; i < 64; i += 4) MD5_STEPS(MD5_I, m, i, 0, 7, 6, 10, 15, 21) \
+}
+
+#define SHA1_CH(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define SHA1_PARITY(b, c, d) ((b) ^ (c) ^ (d))
+#define SHA1_MAJ(b, c, d) (((b) & (c)) | ((d) & ((b) | (c))))
+
+// the message schedule in place of the last 16 words
+#define SHA1_W(m, i) ((i) < 16 ? m[i] : (m[(i) & 15] = ROTL(m[((i) - 3) & 15] ^ m[((i) - 8) & 15] ^ m[((i) - 14) & 15] ^ m[(i) & 15], 1)))
+
+#define SHA1_STEP(f, a, b, c, d, e, w, k) { \
+    e += ROTL(a, 5) + f(b, c, d) + (w) + (k); \
+    b = ROTL(b, 30); \
+}
+
+#define SHA1_STEPS(f, m, i, k) { \
+    SHA1_STEP(f, a, b, c, d, e, SHA1_W(m, i), k) \
+    SHA1_STEP(f, e, a, b, c, d, SHA1_W(m, (i) + 1), k) \
+    SHA1_STEP(f, d, e, a, b, c, SHA1_W(m, (i) + 2), k) \
+    SHA1_STEP(f, c, d, e, a, b, SHA1_W(m, (i) + 3), k) \
+    SHA1_STEP(f, b, c, d, e, a, SHA1_W(m, (i) + 4), k) \
+}
+
+#define SHA1_BLOCK(m) { \
+    for (int i = 0; i < 20; i += 5) SHA1_STEPS(SHA1_CH, m, i, 0x5a827999) \
+    for (int i = 20; i < 40; i += 5) SHA1_STEPS(SHA1_PARITY, m, i, 0x6ed9eba1) \
+    for (int i = 40; i < 60; i += 5) SHA1_STEPS(SHA1_MAJ, m, i, 0x8f1bbcdc) \
+    for (int i = 60; i < 80; i += 5) SHA1_STEPS(SHA1_PARITY, m, i, 0xca62c1d6) \
+}
+
+#define SHA256_S0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define SHA256_S1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SHA256_s0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SHA256_s1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+#define SHA256_W(m, i) ((i) < 16 ? m[i] : (m[(i) & 15] += SHA256_s1(m[((i) - 2) & 15]) + m[((i) - 7) & 15] + SHA256_s0(m[((i) - 15) & 15])))
+
+#define SHA256_STEP(a, b, c, d, e, f, g, h, w, k) { \
+    h += SHA256_S1(e) + SHA1_CH(e, f, g) + (w) + (k); \
+    d += h; \
+    h += SHA256_S0(a) + SHA1_MAJ(a, b, c); \
+}
+
+#define SHA256_BLOCK(m) { \
+    for (int i = 0; i < 64; i += 8) { \
+        SHA256_STEP(a, b, c, d, e, f, g, h, SHA256_W(m, i), SHA256_K[i]) \
+        SHA256_STEP(h, a, b, c, d, e, f, g, SHA256_W(m, i + 1), SHA256_K[i + 1]) \
+        SHA256_STEP(g, h, a, b, c, d, e, f, SHA256_W(m, i + 2), SHA256_K[i + 2]) \
+        SHA256_STEP(f, g, h, a, b, c, d, e, SHA256_W(m, i + 3), SHA256_K[i + 3]) \
+        SHA256_STEP(e, f, g, h, a, b, c, d, SHA256_W(m, i + 4), SHA256_K[i + 4]) \
+        SHA256_STEP(d, e, f, g, h, a, b, c, SHA256_W(m, i + 5), SHA256_K[i + 5]) \
+        SHA256_STEP(c, d, e, f, g, h, a, b, SHA256_W(m, i + 6), SHA256_K[i + 6]) \
+        SHA256_STEP(b, c, d, e, f, g, h, a, SHA256_W(m, i + 7), SHA256_K[i + 7]) \
+    } \
+}
+
+/* The kernels of 'lanes' inputs are compiled for the instruction set of
+ * their target, and they are called only when the processor supports
+ * that. The message words are transposed through the scratch array, so
+ * each vector holds the same word of every lane. */
+#define PAREC_MB_LOAD(vec, lanes, m, w, block, b, load) { \
+    for (int l = 0; l < lanes; l++) { \
+        for (int j = 0; j < 16; j++) { \
+            w[j][l] = load(block[l] + (b) * BLOCK_LEN + 4 * j); \
+        } \
+    } \
+    for (int j = 0; j < 16; j++) { \
+        memcpy(&m[j], w[j], sizeof(vec)); \
+    } \
+}
+
+#define PAREC_MB_KERNEL(name, target, lanes) \
+typedef uint32_t name##_vec __attribute__((vector_size(4 * lanes))); \
+\
+target \
+static void name##_md5(uint32_t state[8][MAX_LANES], const uint8_t *const *block, size_t blocks) \
+{ \
+    name##_vec m[16], a, b, c, d, s[4]; \
+    uint32_t w[16][lanes] __attribute__((aligned(4 * lanes))); \
+\
+    for (int i = 0; i < 4; i++) { \
+        memcpy(&s[i], state[i], sizeof(s[i])); \
+    } \
+    for (size_t n = 0; n < blocks; n++) { \
+        PAREC_MB_LOAD(name##_vec, lanes, m, w, block, n, _parec_mb_load_le) \
+        a = s[0]; b = s[1]; c = s[2]; d = s[3]; \
+        MD5_BLOCK(m) \
+        s[0] += a; s[1] += b; s[2] += c; s[3] += d; \
+    } \
+    for (int i = 0; i < 4; i++) { \
+        memcpy(state[i], &s[i], sizeof(s[i])); \
+    } \
+} \
+\
+target \
+static void name##_sha1(uint32_t state[8][MAX_LANES], const uint8_t *const *block, size_t blocks) \
+{ \
+    name##_vec m[16], a, b, c, d, e, s[5]; \
+    uint32_t w[16][lanes] __attribute__((aligned(4 * lanes))); \
+\
+    for (int i = 0; i < 5; i++) { \
+        memcpy(&s[i], state[i], sizeof(s[i])); \
+    } \
+    for (size_t n = 0; n < blocks; n++) { \
+        PAREC_MB_LOAD(name##_vec, lanes, m, w, block, n, _parec_mb_load_be) \
+        a = s[0]; b = s[1]; c = s[2]; d = s[3]; e = s[4]; \
+        SHA1_BLOCK(m) \
+        s[0] += a; s[1] += b; s[2] += c; s[3] += d; s[4] += e; \
+    } \
+    for (int i = 0; i < 5; i++) { \
+        memcpy(state[i], &s[i], sizeof(s[i])); \
+    } \
+} \
+\
+target \
+static void name##_sha256(uint32_t state[8][MAX_LANES], const uint8_t *const *block, size_t blocks) \
+{ \
+    name##_vec m[16], a, b, c, d, e, f, g, h, s[8]; \
+    uint32_t w[16][lanes] __attribute__((aligned(4 * lanes))); \
+\
+    for (int i = 0; i < 8; i++) { \
+        memcpy(&s[i], state[i], sizeof(s[i])); \
+    } \
+    for (size_t n = 0; n < blocks; n++) { \
+        PAREC_MB_LOAD(name##_vec, lanes, m, w, block, n, _parec_mb_load_be) \
+        a = s[0]; b = s[1]; c = s[2]; d = s[3]; e = s[4]; f = s[5]; g = s[6]; h = s[7]; \
+        SHA256_BLOCK(m) \
+        s[0] += a; s[1] += b; s[2] += c; s[3] += d; s[4] += e; s[5] += f; s[6] += g; s[7] += h; \
+    } \
+    for (int i = 0; i < 8; i++) { \
+        memcpy(state[i], &s[i], sizeof(s[i])); \
+    } \
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+PAREC_MB_KERNEL(_parec_mb_sse2, __attribute__((target("sse2"))), 4)
+PAREC_MB_KERNEL(_parec_mb_avx2, __attribute__((target("avx2"))), 8)
+PAREC_MB_KERNEL(_parec_mb_avx512, __attribute__((target("avx512f"))), 16)
+
+static void _parec_mb_detect(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        sha_extensions = (ebx >> 29) & 1;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        kernel = (parec_mb_kernel_t){ "avx512", 16, { _parec_mb_avx512_md5, _parec_mb_avx512_sha1, _parec_mb_avx512_sha256 } };
+    else if (__builtin_cpu_supports("avx2"))
+        kernel = (parec_mb_kernel_t){ "avx2", 8, { _parec_mb_avx2_md5, _parec_mb_avx2_sha1, _parec_mb_avx2_sha256 } };
+    else
+        kernel = (parec_mb_kernel_t){ "sse2", 4, { _parec_mb_sse2_md5, _parec_mb_sse2_sha1, _parec_mb_sse2_sha256 } };
+}
+
+#else
+
+// the vectors of the compiler, whatever they are mapped to
+PAREC_MB_KERNEL(_parec_mb_portable, , 4)
+
+static void _parec_mb_detect(void)
+{
+    kernel = (parec_mb_kernel_t){ "portable", 4, { _parec_mb_portable_md5, _parec_mb_portable_sha1, _parec_mb_portable_sha256 } };
+}
+
+#endif
+
+int parec_mb_find(const char *name)
+{
+    pthread_once(&kernel_once, _parec_mb_detect);
+    for (size_t n = 0; n < sizeof(ALGORITHMS) / sizeof(ALGORITHMS[0]); n++) {
+        if (!strcmp(ALGORITHMS[n].name, name))
+            return (n != MD5 && sha_extensions) ? -1 : (int)n;
+    }
+    return -1;
+}
+
+int parec_mb_lanes(void)
+{
+    pthread_once(&kernel_once, _parec_mb_detect);
+    return kernel.lanes;
+}
+
+const char *parec_mb_kernel(void)
+{
+    pthread_once(&kernel_once, _parec_mb_detect);
+    return kernel.name;
+}
+
+// the padded last block(s) of an input, returns their number
+static size_t _parec_mb_tail(const parec_mb_algorithm_t *alg, uint8_t *tail, const unsigned char *input, size_t len)
+{
+    size_t rest = len % BLOCK_LEN, blocks = rest < BLOCK_LEN - 8 ? 1 : 2;
+    uint64_t bits = (uint64_t)len * 8;
+
+    memcpy(tail, input + len - rest, rest);
+    tail[rest] = 0x80;
+    memset(tail + rest + 1, 0, blocks * BLOCK_LEN - rest - 1);
+    for (int i = 0; i < 8; i++) {
+        tail[blocks * BLOCK_LEN - 8 + (alg->big_endian ? 7 - i : i)] = (uint8_t)(bits >> (8 * i));
+    }
+    return blocks;
+}
+
+void parec_mb_digest(int alg, int count, const unsigned char *const *input, const size_t *len, unsigned char *const *digest)
+{
+    const parec_mb_algorithm_t *a = &ALGORITHMS[alg];
+    uint32_t state[8][MAX_LANES];
+    const uint8_t *block[MAX_LANES];
+    uint8_t tail[MAX_LANES][2 * BLOCK_LEN];
+    size_t left[MAX_LANES];     // blocks of the current part of the input
+    size_t tails[MAX_LANES];    // blocks of the tail after the full ones
+    int current[MAX_LANES];     // input of the lane, -1 if it is idle
+    int lanes, next = 0, active = 0, busy = 0, l, i;
+    size_t run;
+
+    pthread_once(&kernel_once, _parec_mb_detect);
+    lanes = kernel.lanes;
+    for (l = 0; l < lanes; l++) {
+        current[l] = -1;
+    }
+
+    for (;;) {
+        // starting the next inputs in the idle lanes
+        for (l = 0; l < lanes && next < count; l++) {
+            if (current[l] >= 0)
+                continue;
+            current[l] = next;
+            for (i = 0; i < 8; i++) {
+                state[i][l] = a->iv[i];
+            }
+            tails[l] = _parec_mb_tail(a, tail[l], input[next], len[next]);
+            left[l] = len[next] / BLOCK_LEN;
+            block[l] = input[next];
+            if (!left[l]) {
+                left[l] = tails[l];
+                tails[l] = 0;
+                block[l] = tail[l];
+            }
+            next++;
+            active++;
+        }
+        if (!active)
+            break;
+
+        // until the end of the shortest part, the idle lanes follow
+        // a busy one
+        run = SIZE_MAX;
+        for (l = 0; l < lanes; l++) {
+            if (current[l] >= 0 && left[l] < run) {
+                run = left[l];
+                busy = l;
+            }
+        }
+        for (l = 0; l < lanes; l++) {
+            if (current[l] < 0)
+                block[l] = block[busy];
+        }
+        kernel.compress[alg](state, block, run);
+
+        for (l = 0; l < lanes; l++) {
+            if (current[l] < 0)
+                continue;
+            block[l] += run * BLOCK_LEN;
+            if ((left[l] -= run))
+                continue;
+            if (tails[l]) {
+                left[l] = tails[l];
+                tails[l] = 0;
+                block[l] = tail[l];
+                continue;
+            }
+            for (i = 0; i < a->dlen / 4; i++) {
+                _parec_mb_store(digest[current[l]] + 4 * i, state[i][l], a->big_endian);
+            }
+            current[l] = -1;
+            active--;
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/**
+ * parec_mb -- multi-buffer MD5, SHA-1 and SHA-256
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#ifndef _PAREC_MB_H
+#define _PAREC_MB_H
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The Merkle-Damgard hashes compress their input block by block, so one
+ * input cannot use the lanes of the SIMD instructions. The multi-buffer
+ * engine hashes several independent inputs at the same time instead,
+ * each of them in its own lane, and a lane takes the next input as soon
+ * as its previous one is finished. The digests are identical to the
+ * ones of OpenSSL.
+ *
+ * The widest kernel of the processor (SSE2, AVX2 or AVX-512) is selected
+ * at runtime, which has 4, 8 or 16 lanes.
+ */
+
+/** The largest digest length of the algorithms in bytes. */
+#define PAREC_MB_MAX_LEN 32
+
+/**
+ * Look up an algorithm of the engine by its OpenSSL name.
+ * @param name  "md5", "sha1" or "sha256".
+ * @return      The identifier of the algorithm or -1, if it is not
+ *              supported by the engine. SHA-1 and SHA-256 are not
+ *              supported on the processors with the SHA extensions,
+ *              which hash one input faster than the lanes.
+ */
+int parec_mb_find(const char *name);
+
+/**
+ * Calculate the digests of several inputs by the same algorithm.
+ * @param alg   The identifier of the algorithm from parec_mb_find().
+ * @param count The number of inputs.
+ * @param input The inputs.
+ * @param len   The lengths of the inputs.
+ * @param digest The buffers for the digests of the inputs.
+ */
+void parec_mb_digest(int alg, int count, const unsigned char *const *input, const size_t *len, unsigned char *const *digest);
+
+/**
+ * Get the number of lanes of the kernel, that is the number of inputs
+ * hashed at the same time.
+ * @return 4, 8 or 16.
+ */
+int parec_mb_lanes(void);
+
+/**
+ * Get the name of the SIMD kernel.
+ * @return "avx512", "avx2", "sse2" or "portable".
+ */
+const char *parec_mb_kernel(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PAREC_MB_H */
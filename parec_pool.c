@@ -0,0 +1,262 @@
+/*
+ * parec_pool -- work-stealing thread pool for parec
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "parec_pool.h"
+
+typedef struct {
+    parec_pool_fn               fn;
+    void                        *arg;
+} parec_task;
+
+// double ended queue of a worker, used as a ring buffer:
+// the owner pushes and pops at the bottom, thieves steal at the top
+typedef struct {
+    pthread_mutex_t             lock;
+    parec_task                  *task;
+    int                         len;        // allocation length of the task array
+    int                         top;        // index of the oldest task
+    int                         count;      // number of queued tasks
+} parec_deque;
+
+typedef struct {
+    parec_pool                  *pool;
+    int                         index;
+} parec_worker;
+
+struct _parec_pool {
+    int                         threads;
+    pthread_t                   *thread;
+    parec_worker                *worker;
+    parec_deque                 *deque;
+    pthread_mutex_t             lock;       // protects the counters below
+    pthread_cond_t              work;       // signalled, when a task is queued
+    pthread_cond_t              done;       // signalled, when all tasks are finished
+    int                         queued;     // number of tasks in the queues
+    int                         pending;    // number of submitted, but unfinished tasks
+    int                         shutdown;
+    int                         deques;     // number of initialized deques
+    int                         started;    // number of started threads
+};
+
+static const int DEQUE_LEN = 64;
+
+static int _parec_deque_push(parec_deque *q, parec_pool_fn fn, void *arg)
+{
+    pthread_mutex_lock(&q->lock);
+    // extending the ring buffer, if necessary
+    if (q->count == q->len) {
+        parec_task *task = malloc(sizeof(*task) * q->len * 2);
+        if (!task) {
+            pthread_mutex_unlock(&q->lock);
+            return -1;
+        }
+        for (int i = 0; i < q->count; i++) {
+            task[i] = q->task[(q->top + i) % q->len];
+        }
+        free(q->task);
+        q->task = task;
+        q->len *= 2;
+        q->top = 0;
+    }
+    q->task[(q->top + q->count) % q->len].fn = fn;
+    q->task[(q->top + q->count) % q->len].arg = arg;
+    q->count++;
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+// taking the newest task from the bottom
+static int _parec_deque_pop(parec_deque *q, parec_task *task)
+{
+    int rc = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->count > 0) {
+        q->count--;
+        *task = q->task[(q->top + q->count) % q->len];
+        rc = 0;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return rc;
+}
+
+// taking the oldest task from the top
+static int _parec_deque_steal(parec_deque *q, parec_task *task)
+{
+    int rc = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->count > 0) {
+        *task = q->task[q->top];
+        q->top = (q->top + 1) % q->len;
+        q->count--;
+        rc = 0;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return rc;
+}
+
+static int _parec_pool_take(parec_pool *pool, int w, parec_task *task)
+{
+    if (!_parec_deque_pop(&pool->deque[w], task))
+        return 0;
+    for (int i = 1; i < pool->threads; i++) {
+        if (!_parec_deque_steal(&pool->deque[(w + i) % pool->threads], task))
+            return 0;
+    }
+    return -1;
+}
+
+static void *_parec_pool_run(void *arg)
+{
+    parec_worker *worker = arg;
+    parec_pool *pool = worker->pool;
+    parec_task task;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->shutdown) {
+        if (pool->queued <= 0) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        // the task might have been taken by an other worker meanwhile
+        if (_parec_pool_take(pool, worker->index, &task)) {
+            pthread_mutex_lock(&pool->lock);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        pool->queued--;
+        pthread_mutex_unlock(&pool->lock);
+
+        task.fn(task.arg, worker->index);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+parec_pool *parec_pool_new(int threads)
+{
+    parec_pool *pool;
+    int w;
+
+    if (threads < 1)
+        return NULL;
+
+    pool = calloc(sizeof(*pool), 1);
+    if (!pool)
+        return NULL;
+
+    pool->thread = calloc(sizeof(*(pool->thread)), threads);
+    pool->worker = calloc(sizeof(*(pool->worker)), threads);
+    pool->deque = calloc(sizeof(*(pool->deque)), threads);
+    if (!pool->thread || !pool->worker || !pool->deque) {
+        free(pool->thread);
+        free(pool->worker);
+        free(pool->deque);
+        free(pool);
+        return NULL;
+    }
+
+    pool->threads = threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (w = 0; w < threads; w++) {
+        pool->deque[w].len = DEQUE_LEN;
+        pool->deque[w].task = malloc(sizeof(*(pool->deque[w].task)) * DEQUE_LEN);
+        if (!pool->deque[w].task) {
+            parec_pool_free(pool);
+            return NULL;
+        }
+        pthread_mutex_init(&pool->deque[w].lock, NULL);
+        pool->deques++;
+    }
+
+    for (w = 0; w < threads; w++) {
+        pool->worker[w].pool = pool;
+        pool->worker[w].index = w;
+        if (pthread_create(&pool->thread[w], NULL, _parec_pool_run, &pool->worker[w])) {
+            parec_pool_free(pool);
+            return NULL;
+        }
+        pool->started++;
+    }
+
+    return pool;
+}
+
+void parec_pool_free(parec_pool *pool)
+{
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int w = 0; w < pool->started; w++) {
+        pthread_join(pool->thread[w], NULL);
+    }
+
+    for (int w = 0; w < pool->deques; w++) {
+        pthread_mutex_destroy(&pool->deque[w].lock);
+        free(pool->deque[w].task);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+
+    free(pool->thread);
+    free(pool->worker);
+    free(pool->deque);
+    free(pool);
+}
+
+int parec_pool_get_threads(parec_pool *pool)
+{
+    return pool->threads;
+}
+
+int parec_pool_submit(parec_pool *pool, int worker, parec_pool_fn fn, void *arg)
+{
+    // tasks from the outside are queued at the first worker
+    if (worker < 0 || worker >= pool->threads)
+        worker = 0;
+
+    if (_parec_deque_push(&pool->deque[worker], fn, arg))
+        return -1;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->queued++;
+    pool->pending++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    return 0;
+}
+
+void parec_pool_wait(parec_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* End of file. */
@@ -0,0 +1,77 @@
+/**
+ * parec_pool -- work-stealing thread pool for parec
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#ifndef _PAREC_POOL_H
+#define _PAREC_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Every worker thread of the pool has its own task queue. A task
+ * submitted from a worker goes to the queue of that worker, which
+ * takes its own tasks in LIFO order (depth-first, cache friendly),
+ * while idle workers steal from the other end of the queues (FIFO,
+ * i.e. the biggest pieces of work).
+ */
+
+/* Opaque data structure of the pool. */
+typedef struct _parec_pool  parec_pool;
+
+/**
+ * A task function.
+ * @param arg       The argument given at submission.
+ * @param worker    The index of the executing worker in [0,threads).
+ */
+typedef void (*parec_pool_fn)(void *arg, int worker);
+
+/**
+ * Allocates a new pool and starts its worker threads.
+ * @param threads   The number of worker threads.
+ * @return      The pool or NULL if the initialization has failed.
+ */
+parec_pool *parec_pool_new(int threads);
+
+/**
+ * Stops the worker threads and frees the pool.
+ * There must not be any running or queued tasks.
+ * @param pool  The pool to be disposed.
+ */
+void parec_pool_free(parec_pool *pool);
+
+/**
+ * Get the number of worker threads.
+ * @param pool  The pool.
+ * @return the number of worker threads.
+ */
+int parec_pool_get_threads(parec_pool *pool);
+
+/**
+ * Submit a new task.
+ * @param pool      The pool.
+ * @param worker    The index of the submitting worker or -1,
+ *                  if it is called from outside of the pool.
+ * @param fn        The task function.
+ * @param arg       The argument of the task function.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_pool_submit(parec_pool *pool, int worker, parec_pool_fn fn, void *arg);
+
+/**
+ * Wait until all the submitted tasks (including the ones submitted
+ * by the tasks themselves) are finished.
+ * It must not be called by a worker of the same pool.
+ * @param pool  The pool.
+ */
+void parec_pool_wait(parec_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PAREC_POOL_H */
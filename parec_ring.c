@@ -0,0 +1,178 @@
+/*
+ * parec_ring -- ring of buffers between a reader and its consumers
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "parec_ring.h"
+
+struct _parec_ring {
+    int                         buffers;
+    int                         consumers;
+    unsigned char               **buffer;
+    ssize_t                     *len;           // length of the data in each buffer
+    int                         *refs;          // number of consumers still using each buffer
+    long                        produced;       // number of published buffers
+    long                        *consumed;      // number of released buffers of each consumer
+    int                         cancelled;
+    int                         error;
+    pthread_mutex_t             lock;
+    pthread_cond_t              filled;         // signalled, when a buffer is published
+    pthread_cond_t              freed;          // signalled, when a buffer is released
+};
+
+parec_ring *parec_ring_new(int buffers, size_t buflen, int consumers)
+{
+    parec_ring *ring;
+
+    if (buffers < 1 || consumers < 1)
+        return NULL;
+
+    ring = calloc(sizeof(*ring), 1);
+    if (!ring)
+        return NULL;
+
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->filled, NULL);
+    pthread_cond_init(&ring->freed, NULL);
+
+    ring->buffers = buffers;
+    ring->consumers = consumers;
+    ring->buffer = calloc(sizeof(*(ring->buffer)), buffers);
+    ring->len = calloc(sizeof(*(ring->len)), buffers);
+    ring->refs = calloc(sizeof(*(ring->refs)), buffers);
+    ring->consumed = calloc(sizeof(*(ring->consumed)), consumers);
+    if (!ring->buffer || !ring->len || !ring->refs || !ring->consumed) {
+        parec_ring_free(ring);
+        return NULL;
+    }
+    // page aligned buffers, so they can be used for direct I/O
+    for (int b = 0; b < buffers; b++) {
+        if (posix_memalign((void **) &ring->buffer[b], sysconf(_SC_PAGESIZE), buflen)) {
+            ring->buffer[b] = NULL;
+            parec_ring_free(ring);
+            return NULL;
+        }
+    }
+
+    return ring;
+}
+
+void parec_ring_free(parec_ring *ring)
+{
+    if (!ring)
+        return;
+
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->filled);
+    pthread_cond_destroy(&ring->freed);
+
+    if (ring->buffer) {
+        for (int b = 0; b < ring->buffers; b++) {
+            free(ring->buffer[b]);
+        }
+    }
+    free(ring->buffer);
+    free(ring->len);
+    free(ring->refs);
+    free(ring->consumed);
+    free(ring);
+}
+
+void parec_ring_reset(parec_ring *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    for (int b = 0; b < ring->buffers; b++) {
+        ring->len[b] = 0;
+        ring->refs[b] = 0;
+    }
+    for (int c = 0; c < ring->consumers; c++) {
+        ring->consumed[c] = 0;
+    }
+    ring->produced = 0;
+    ring->cancelled = 0;
+    ring->error = 0;
+    pthread_mutex_unlock(&ring->lock);
+}
+
+unsigned char *parec_ring_acquire(parec_ring *ring)
+{
+    unsigned char *buffer;
+    int b;
+
+    pthread_mutex_lock(&ring->lock);
+    b = ring->produced % ring->buffers;
+    while (ring->refs[b] > 0 && !ring->cancelled) {
+        pthread_cond_wait(&ring->freed, &ring->lock);
+    }
+    buffer = ring->cancelled ? NULL : ring->buffer[b];
+    pthread_mutex_unlock(&ring->lock);
+
+    return buffer;
+}
+
+void parec_ring_publish(parec_ring *ring, ssize_t len, int error)
+{
+    int b;
+
+    pthread_mutex_lock(&ring->lock);
+    b = ring->produced % ring->buffers;
+    ring->len[b] = len;
+    ring->refs[b] = ring->consumers;
+    if (len < 0)
+        ring->error = error;
+    ring->produced++;
+    pthread_cond_broadcast(&ring->filled);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+ssize_t parec_ring_next(parec_ring *ring, int consumer, const unsigned char **buffer)
+{
+    int b;
+    ssize_t len;
+
+    pthread_mutex_lock(&ring->lock);
+    while (ring->consumed[consumer] == ring->produced && !ring->cancelled) {
+        pthread_cond_wait(&ring->filled, &ring->lock);
+    }
+    b = ring->consumed[consumer] % ring->buffers;
+    len = ring->cancelled ? -1 : ring->len[b];
+    pthread_mutex_unlock(&ring->lock);
+
+    *buffer = ring->buffer[b];
+    return len;
+}
+
+void parec_ring_release(parec_ring *ring, int consumer)
+{
+    int b;
+
+    pthread_mutex_lock(&ring->lock);
+    b = ring->consumed[consumer] % ring->buffers;
+    ring->consumed[consumer]++;
+    if (--ring->refs[b] == 0)
+        pthread_cond_signal(&ring->freed);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+void parec_ring_cancel(parec_ring *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    ring->cancelled = 1;
+    pthread_cond_broadcast(&ring->filled);
+    pthread_cond_broadcast(&ring->freed);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+int parec_ring_get_error(parec_ring *ring)
+{
+    return ring->error;
+}
+
+/* End of file. */
@@ -0,0 +1,102 @@
+/**
+ * parec_ring -- ring of buffers between a reader and its consumers
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#ifndef _PAREC_RING_H
+#define _PAREC_RING_H
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The producer fills the buffers of the ring in order, while the
+ * consumers process them in the same order. Every consumer sees every
+ * buffer and a buffer is reused by the producer only when all the
+ * consumers have released it. The buffers are page aligned.
+ */
+
+/* Opaque data structure of the ring. */
+typedef struct _parec_ring  parec_ring;
+
+/**
+ * Allocates a new ring.
+ * @param buffers   The number of buffers in the ring.
+ * @param buflen    The size of one buffer.
+ * @param consumers The number of consumers.
+ * @return      The ring or NULL if memory allocation has failed.
+ */
+parec_ring *parec_ring_new(int buffers, size_t buflen, int consumers);
+
+/**
+ * Free the ring.
+ * @param ring  The ring to be disposed.
+ */
+void parec_ring_free(parec_ring *ring);
+
+/**
+ * Reset the ring to its initial state for a new stream.
+ * The producer and the consumers of the previous stream must have
+ * finished already.
+ * @param ring  The ring.
+ */
+void parec_ring_reset(parec_ring *ring);
+
+/**
+ * Get the next empty buffer to be filled by the producer.
+ * It blocks until the buffer is released by all the consumers.
+ * @param ring  The ring.
+ * @return the buffer and NULL, if the ring was cancelled.
+ */
+unsigned char *parec_ring_acquire(parec_ring *ring);
+
+/**
+ * Pass the last acquired buffer to the consumers.
+ * @param ring  The ring.
+ * @param len   The length of the data, 0 at the end of the stream
+ *              and -1 in case of an error.
+ * @param error The errno value of the error.
+ */
+void parec_ring_publish(parec_ring *ring, ssize_t len, int error);
+
+/**
+ * Get the next filled buffer of a consumer.
+ * It blocks until the buffer is published by the producer.
+ * @param ring      The ring.
+ * @param consumer  The index of the consumer.
+ * @param buffer    The filled buffer.
+ * @return the length of the data, 0 at the end of the stream and -1,
+ *         if the producer has failed or the ring was cancelled.
+ */
+ssize_t parec_ring_next(parec_ring *ring, int consumer, const unsigned char **buffer);
+
+/**
+ * Release the last buffer of a consumer.
+ * @param ring      The ring.
+ * @param consumer  The index of the consumer.
+ */
+void parec_ring_release(parec_ring *ring, int consumer);
+
+/**
+ * Stop the producer and all the consumers, e.g. after an error.
+ * @param ring  The ring.
+ */
+void parec_ring_cancel(parec_ring *ring);
+
+/**
+ * Get the error of the producer.
+ * @param ring  The ring.
+ * @return the errno value passed by the producer.
+ */
+int parec_ring_get_error(parec_ring *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PAREC_RING_H */
@@ -0,0 +1,355 @@
+/*
+ * parec_uring -- batched asynchronous reads through io_uring
+ *
+ * The engine talks to the kernel directly through the io_uring system
+ * calls, so it does not need liburing. On systems without io_uring
+ * (non-Linux or kernel headers older than 5.6) parec_uring_new() always
+ * fails with ENOSYS and the callers fall back to the stdio reads.
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "parec_uring.h"
+
+#ifdef __linux__
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+#define PAREC_HAVE_URING 1
+#endif
+#endif
+
+#ifdef PAREC_HAVE_URING
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+struct _parec_uring {
+    int                         fd;
+    int                         depth;
+    size_t                      buflen;
+    unsigned char               **buffer;
+    int                         registered;     // buffers are registered with the kernel
+    int                         queued;         // number of prepared, but not submitted reads
+    int                         pending;        // number of submitted, but not collected reads
+    // submission queue
+    void                        *sq_ring;
+    size_t                      sq_ring_len;
+    unsigned int                *sq_head;
+    unsigned int                *sq_tail;
+    unsigned int                *sq_mask;
+    unsigned int                *sq_array;
+    struct io_uring_sqe         *sqes;
+    size_t                      sqes_len;
+    // completion queue
+    void                        *cq_ring;       // same as sq_ring with IORING_FEAT_SINGLE_MMAP
+    size_t                      cq_ring_len;
+    unsigned int                *cq_head;
+    unsigned int                *cq_tail;
+    unsigned int                *cq_mask;
+    struct io_uring_cqe         *cqes;
+};
+
+static int _parec_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int _parec_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int _parec_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr_args)
+{
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+parec_uring *parec_uring_new(int depth, size_t buflen)
+{
+    parec_uring *uring;
+    struct io_uring_params p;
+    struct iovec iov[depth > 0 ? depth : 1];
+    unsigned char *ring;
+
+    if (depth < 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    uring = calloc(sizeof(*uring), 1);
+    if (!uring)
+        return NULL;
+    uring->fd = -1;
+    uring->depth = depth;
+    uring->buflen = buflen;
+
+    memset(&p, 0, sizeof(p));
+    if ((uring->fd = _parec_uring_setup(depth, &p)) < 0) {
+        parec_uring_free(uring);
+        return NULL;
+    }
+
+    // mapping the rings, which may share a single mapping on newer kernels
+    uring->sq_ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    uring->cq_ring_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (uring->cq_ring_len > uring->sq_ring_len)
+            uring->sq_ring_len = uring->cq_ring_len;
+        uring->cq_ring_len = uring->sq_ring_len;
+    }
+    uring->sq_ring = mmap(NULL, uring->sq_ring_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+    if (uring->sq_ring == MAP_FAILED) {
+        uring->sq_ring = NULL;
+        parec_uring_free(uring);
+        return NULL;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        uring->cq_ring = uring->sq_ring;
+    }
+    else {
+        uring->cq_ring = mmap(NULL, uring->cq_ring_len, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING);
+        if (uring->cq_ring == MAP_FAILED) {
+            uring->cq_ring = NULL;
+            parec_uring_free(uring);
+            return NULL;
+        }
+    }
+    uring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sqes = mmap(NULL, uring->sqes_len, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED) {
+        uring->sqes = NULL;
+        parec_uring_free(uring);
+        return NULL;
+    }
+
+    ring = uring->sq_ring;
+    uring->sq_head = (unsigned int *) (ring + p.sq_off.head);
+    uring->sq_tail = (unsigned int *) (ring + p.sq_off.tail);
+    uring->sq_mask = (unsigned int *) (ring + p.sq_off.ring_mask);
+    uring->sq_array = (unsigned int *) (ring + p.sq_off.array);
+    ring = uring->cq_ring;
+    uring->cq_head = (unsigned int *) (ring + p.cq_off.head);
+    uring->cq_tail = (unsigned int *) (ring + p.cq_off.tail);
+    uring->cq_mask = (unsigned int *) (ring + p.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe *) (ring + p.cq_off.cqes);
+
+    // page aligned buffers, so they can be pinned by the kernel
+    uring->buffer = calloc(sizeof(*(uring->buffer)), depth);
+    if (!uring->buffer) {
+        parec_uring_free(uring);
+        return NULL;
+    }
+    for (int b = 0; b < depth; b++) {
+        if (posix_memalign((void **) &uring->buffer[b], sysconf(_SC_PAGESIZE), buflen)) {
+            uring->buffer[b] = NULL;
+            parec_uring_free(uring);
+            errno = ENOMEM;
+            return NULL;
+        }
+        iov[b].iov_base = uring->buffer[b];
+        iov[b].iov_len = buflen;
+    }
+
+    // registered buffers save mapping the pages at every read, however
+    // they count against RLIMIT_MEMLOCK, so plain reads are used otherwise
+    if (_parec_uring_register(uring->fd, IORING_REGISTER_BUFFERS, iov, depth) == 0)
+        uring->registered = 1;
+
+    return uring;
+}
+
+int parec_uring_free(parec_uring *uring)
+{
+    int busy;
+
+    if (!uring)
+        return 0;
+
+    // the kernel may write into the buffers until the reads in flight are
+    // completed, so they are rather leaked, if the reads cannot be waited out
+    busy = parec_uring_drain(uring) != 0;
+
+    if (uring->sqes)
+        munmap(uring->sqes, uring->sqes_len);
+    if (uring->cq_ring && uring->cq_ring != uring->sq_ring)
+        munmap(uring->cq_ring, uring->cq_ring_len);
+    if (uring->sq_ring)
+        munmap(uring->sq_ring, uring->sq_ring_len);
+    // closing the ring also unregisters the buffers
+    if (uring->fd >= 0)
+        close(uring->fd);
+
+    if (busy)
+        return -1;
+
+    if (uring->buffer) {
+        for (int b = 0; b < uring->depth; b++) {
+            free(uring->buffer[b]);
+        }
+    }
+    free(uring->buffer);
+    free(uring);
+    return 0;
+}
+
+int parec_uring_read(parec_uring *uring, int fd, int b, off_t offset, size_t len, void *data)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int tail, idx;
+
+    if (b < 0 || b >= uring->depth || len > uring->buflen) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // the kernel consumes the entries at submission, so there is
+    // always room for one entry per buffer
+    tail = *uring->sq_tail;
+    idx = tail & *uring->sq_mask;
+    sqe = &uring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = uring->registered ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = (unsigned long) uring->buffer[b];
+    sqe->len = len;
+    sqe->buf_index = uring->registered ? b : 0;
+    sqe->user_data = (unsigned long) data;
+    uring->sq_array[idx] = idx;
+
+    // publishing the entry to the kernel
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    uring->queued++;
+
+    return 0;
+}
+
+int parec_uring_submit(parec_uring *uring)
+{
+    int rc;
+
+    while (uring->queued > 0) {
+        if ((rc = _parec_uring_enter(uring->fd, uring->queued, 0, 0)) <= 0) {
+            if (rc < 0 && errno == EINTR)
+                continue;
+            if (rc == 0)
+                errno = EBUSY;
+            // taking back the entries, which were not consumed by the kernel
+            __atomic_store_n(uring->sq_tail, *uring->sq_tail - uring->queued, __ATOMIC_RELEASE);
+            uring->queued = 0;
+            return -1;
+        }
+        uring->queued -= rc;
+        uring->pending += rc;
+    }
+
+    return 0;
+}
+
+int parec_uring_wait(parec_uring *uring, void **data, ssize_t *res)
+{
+    struct io_uring_cqe *cqe;
+    unsigned int head;
+
+    if (uring->pending == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    head = *uring->cq_head;
+    while (head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE)) {
+        if (_parec_uring_enter(uring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            return -1;
+    }
+
+    cqe = &uring->cqes[head & *uring->cq_mask];
+    *data = (void *) (unsigned long) cqe->user_data;
+    *res = cqe->res;
+
+    // giving back the entry to the kernel
+    __atomic_store_n(uring->cq_head, head + 1, __ATOMIC_RELEASE);
+    uring->pending--;
+
+    return 0;
+}
+
+#else /* PAREC_HAVE_URING */
+
+struct _parec_uring {
+    int                         depth;
+    int                         pending;
+    unsigned char               **buffer;
+};
+
+parec_uring *parec_uring_new(int depth, size_t buflen)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+int parec_uring_free(parec_uring *uring)
+{
+    return 0;
+}
+
+int parec_uring_read(parec_uring *uring, int fd, int b, off_t offset, size_t len, void *data)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int parec_uring_submit(parec_uring *uring)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int parec_uring_wait(parec_uring *uring, void **data, ssize_t *res)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif /* PAREC_HAVE_URING */
+
+int parec_uring_drain(parec_uring *uring)
+{
+    void *data;
+    ssize_t res;
+
+    while (uring->pending > 0) {
+        if (parec_uring_wait(uring, &data, &res))
+            return -1;
+    }
+
+    return 0;
+}
+
+int parec_uring_get_depth(parec_uring *uring)
+{
+    return uring->depth;
+}
+
+int parec_uring_get_pending(parec_uring *uring)
+{
+    return uring->pending;
+}
+
+unsigned char *parec_uring_buffer(parec_uring *uring, int b)
+{
+    return uring->buffer[b];
+}
+
+/* End of file. */
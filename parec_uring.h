@@ -0,0 +1,114 @@
+/**
+ * parec_uring -- batched asynchronous reads through io_uring
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#ifndef _PAREC_URING_H
+#define _PAREC_URING_H
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The engine owns a fixed number of buffers, which are registered with
+ * the kernel, if possible. Reads are queued into these buffers with
+ * parec_uring_read(), sent to the kernel in one system call by
+ * parec_uring_submit() and their completions are collected, in any
+ * order, by parec_uring_wait().
+ *
+ * An engine must be used only by one thread at a time.
+ */
+
+/* Opaque data structure of the engine. */
+typedef struct _parec_uring parec_uring;
+
+/**
+ * Allocates a new engine.
+ * @param depth     The number of buffers and the maximum number
+ *                  of reads in flight.
+ * @param buflen    The size of one buffer.
+ * @return      The engine or NULL if io_uring is not available
+ *              (errno is set) or memory allocation has failed.
+ */
+parec_uring *parec_uring_new(int depth, size_t buflen);
+
+/**
+ * Free the engine.
+ * The reads in flight are waited out first. If they cannot be, the
+ * engine is not freed, since the kernel may still write into its buffers.
+ * @param uring The engine to be disposed.
+ * @return 0 when successful and -1, if the engine is leaked (errno is set).
+ */
+int parec_uring_free(parec_uring *uring);
+
+/**
+ * Get the number of buffers of the engine.
+ * @param uring The engine.
+ * @return the number of buffers.
+ */
+int parec_uring_get_depth(parec_uring *uring);
+
+/**
+ * Get the number of submitted reads, which are not collected yet.
+ * @param uring The engine.
+ * @return the number of reads in flight.
+ */
+int parec_uring_get_pending(parec_uring *uring);
+
+/**
+ * Get a buffer of the engine.
+ * @param uring The engine.
+ * @param b     The index of the buffer in [0,depth).
+ * @return the buffer.
+ */
+unsigned char *parec_uring_buffer(parec_uring *uring, int b);
+
+/**
+ * Queue a read into a buffer of the engine.
+ * @param uring     The engine.
+ * @param fd        The file descriptor to read from.
+ * @param b         The index of the buffer.
+ * @param offset    The offset in the file.
+ * @param len       The number of bytes to read (at most the buffer size).
+ * @param data      User data returned with the completion.
+ * @return 0 when successful and -1 in case of an error.
+ */
+int parec_uring_read(parec_uring *uring, int fd, int b, off_t offset, size_t len, void *data);
+
+/**
+ * Send the queued reads to the kernel.
+ * The reads, which could not be submitted, are dropped and they
+ * are not going to be completed.
+ * @param uring     The engine.
+ * @return 0 when successful and -1 in case of an error (errno is set).
+ */
+int parec_uring_submit(parec_uring *uring);
+
+/**
+ * Wait for the completion of a submitted read.
+ * @param uring     The engine.
+ * @param data      The user data of the read.
+ * @param res       The number of bytes read or the negated errno value.
+ * @return 0 when successful and -1 in case of an error (errno is set).
+ */
+int parec_uring_wait(parec_uring *uring, void **data, ssize_t *res);
+
+/**
+ * Wait for the completion of all submitted reads and drop their results,
+ * so the buffers and the file descriptors of the reads may be reused.
+ * @param uring     The engine.
+ * @return 0 when successful and -1 in case of an error (errno is set),
+ *         when some reads may be still in flight.
+ */
+int parec_uring_drain(parec_uring *uring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PAREC_URING_H */
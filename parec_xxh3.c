@@ -0,0 +1,524 @@
+/*
+ * parec_xxh3 -- 128 bit XXH3 hash function
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "parec_xxh3.h"
+
+/*
+ * The inputs of at most 240 bytes are hashed at once by dedicated
+ * functions for their length. The longer inputs are split into stripes
+ * of 64 bytes, which are accumulated into 8 lanes of 64 bits with the
+ * consecutive 8 byte offsets of the secret. The lanes are scrambled
+ * after each block of 16 stripes, and the last, possibly overlapping
+ * stripe and the lanes are merged into the digest at the end.
+ *
+ * The hasher keeps the accumulators and a buffer of 256 bytes: the
+ * input is accumulated only when more is coming, since the last stripe
+ * is treated differently.
+ */
+
+#define STRIPE_LEN 64
+#define SECRET_LEN 192
+/* Offset of the secret between two stripes. */
+#define CONSUME_RATE 8
+#define STRIPES_PER_BLOCK ((SECRET_LEN - STRIPE_LEN) / CONSUME_RATE)
+/* Offset of the secret of the scrambling. */
+#define SECRET_LIMIT (SECRET_LEN - STRIPE_LEN)
+#define BUFFER_LEN 256
+#define MIDSIZE_MAX 240
+#define MIDSIZE_STARTOFFSET 3
+#define MIDSIZE_LASTOFFSET 17
+#define SECRET_SIZE_MIN 136
+#define LASTACC_START 7
+#define MERGEACCS_START 11
+
+static const uint32_t PRIME32_1 = 0x9E3779B1U;
+static const uint32_t PRIME32_2 = 0x85EBCA77U;
+static const uint32_t PRIME32_3 = 0xC2B2AE3DU;
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+static const uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+static const uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+
+// the default secret
+static const uint8_t SECRET[SECRET_LEN] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+__extension__ typedef unsigned __int128 parec_xxh3_u128;
+
+typedef struct {
+    uint64_t                    low;
+    uint64_t                    high;
+} parec_xxh3_hash;
+
+// accumulating the stripes of the input with the consecutive offsets
+// of the secret
+typedef void (*parec_xxh3_accumulate)(uint64_t acc[8], const uint8_t *input, const uint8_t *secret, size_t stripes);
+
+typedef struct {
+    const char                  *name;
+    parec_xxh3_accumulate       accumulate;
+} parec_xxh3_kernel_t;
+
+struct _parec_xxh3 {
+    uint64_t                    acc[8];
+    uint8_t                     buffer[BUFFER_LEN];
+    size_t                      buffered;       // number of bytes in the buffer
+    size_t                      stripes;        // number of stripes in the current block
+    uint64_t                    len;            // total length of the input
+};
+
+static parec_xxh3_kernel_t kernel;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static inline uint32_t _parec_xxh3_read32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t _parec_xxh3_read64(const uint8_t *p)
+{
+    return (uint64_t)_parec_xxh3_read32(p) | ((uint64_t)_parec_xxh3_read32(p + 4) << 32);
+}
+
+static inline void _parec_xxh3_write64be(uint8_t *p, uint64_t v)
+{
+    for (int i = 7; i >= 0; i--) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+static inline uint32_t _parec_xxh3_swap32(uint32_t x)
+{
+    return __builtin_bswap32(x);
+}
+
+static inline uint64_t _parec_xxh3_swap64(uint64_t x)
+{
+    return __builtin_bswap64(x);
+}
+
+static inline uint32_t _parec_xxh3_rotl32(uint32_t x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline parec_xxh3_hash _parec_xxh3_mult128(uint64_t a, uint64_t b)
+{
+    parec_xxh3_u128 product = (parec_xxh3_u128)a * b;
+    parec_xxh3_hash h = { (uint64_t)product, (uint64_t)(product >> 64) };
+
+    return h;
+}
+
+static inline uint64_t _parec_xxh3_mult128_fold(uint64_t a, uint64_t b)
+{
+    parec_xxh3_hash h = _parec_xxh3_mult128(a, b);
+
+    return h.low ^ h.high;
+}
+
+static uint64_t _parec_xxh64_avalanche(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t _parec_xxh3_avalanche(uint64_t h)
+{
+    h ^= h >> 37;
+    h *= PRIME_MX1;
+    h ^= h >> 32;
+    return h;
+}
+
+/* Short inputs */
+
+static parec_xxh3_hash _parec_xxh3_len_0(void)
+{
+    parec_xxh3_hash h;
+
+    h.low = _parec_xxh64_avalanche(_parec_xxh3_read64(SECRET + 64) ^ _parec_xxh3_read64(SECRET + 72));
+    h.high = _parec_xxh64_avalanche(_parec_xxh3_read64(SECRET + 80) ^ _parec_xxh3_read64(SECRET + 88));
+    return h;
+}
+
+static parec_xxh3_hash _parec_xxh3_len_1to3(const uint8_t *input, size_t len)
+{
+    uint32_t combinedl, combinedh;
+    parec_xxh3_hash h;
+
+    combinedl = ((uint32_t)input[0] << 16) | ((uint32_t)input[len >> 1] << 24) | (uint32_t)input[len - 1] | ((uint32_t)len << 8);
+    combinedh = _parec_xxh3_rotl32(_parec_xxh3_swap32(combinedl), 13);
+    h.low = _parec_xxh64_avalanche(combinedl ^ (uint64_t)(_parec_xxh3_read32(SECRET) ^ _parec_xxh3_read32(SECRET + 4)));
+    h.high = _parec_xxh64_avalanche(combinedh ^ (uint64_t)(_parec_xxh3_read32(SECRET + 8) ^ _parec_xxh3_read32(SECRET + 12)));
+    return h;
+}
+
+static parec_xxh3_hash _parec_xxh3_len_4to8(const uint8_t *input, size_t len)
+{
+    uint64_t input64, keyed;
+    parec_xxh3_hash m;
+
+    input64 = _parec_xxh3_read32(input) + ((uint64_t)_parec_xxh3_read32(input + len - 4) << 32);
+    keyed = input64 ^ (_parec_xxh3_read64(SECRET + 16) ^ _parec_xxh3_read64(SECRET + 24));
+
+    m = _parec_xxh3_mult128(keyed, PRIME64_1 + (len << 2));
+    m.high += m.low << 1;
+    m.low ^= m.high >> 3;
+    m.low ^= m.low >> 35;
+    m.low *= PRIME_MX2;
+    m.low ^= m.low >> 28;
+    m.high = _parec_xxh3_avalanche(m.high);
+    return m;
+}
+
+static parec_xxh3_hash _parec_xxh3_len_9to16(const uint8_t *input, size_t len)
+{
+    uint64_t bitflipl, bitfliph, input_lo, input_hi;
+    parec_xxh3_hash m, h;
+
+    bitflipl = _parec_xxh3_read64(SECRET + 32) ^ _parec_xxh3_read64(SECRET + 40);
+    bitfliph = _parec_xxh3_read64(SECRET + 48) ^ _parec_xxh3_read64(SECRET + 56);
+    input_lo = _parec_xxh3_read64(input);
+    input_hi = _parec_xxh3_read64(input + len - 8);
+
+    m = _parec_xxh3_mult128(input_lo ^ input_hi ^ bitflipl, PRIME64_1);
+    m.low += (uint64_t)(len - 1) << 54;
+    input_hi ^= bitfliph;
+    m.high += input_hi + (uint64_t)(uint32_t)input_hi * (PRIME32_2 - 1);
+    m.low ^= _parec_xxh3_swap64(m.high);
+
+    h = _parec_xxh3_mult128(m.low, PRIME64_2);
+    h.high += m.high * PRIME64_2;
+    h.low = _parec_xxh3_avalanche(h.low);
+    h.high = _parec_xxh3_avalanche(h.high);
+    return h;
+}
+
+static uint64_t _parec_xxh3_mix16(const uint8_t *input, const uint8_t *secret, uint64_t seed)
+{
+    return _parec_xxh3_mult128_fold(_parec_xxh3_read64(input) ^ (_parec_xxh3_read64(secret) + seed),
+                                    _parec_xxh3_read64(input + 8) ^ (_parec_xxh3_read64(secret + 8) - seed));
+}
+
+static parec_xxh3_hash _parec_xxh3_mix32(parec_xxh3_hash acc, const uint8_t *input1, const uint8_t *input2, const uint8_t *secret, uint64_t seed)
+{
+    acc.low += _parec_xxh3_mix16(input1, secret, seed);
+    acc.low ^= _parec_xxh3_read64(input2) + _parec_xxh3_read64(input2 + 8);
+    acc.high += _parec_xxh3_mix16(input2, secret + 16, seed);
+    acc.high ^= _parec_xxh3_read64(input1) + _parec_xxh3_read64(input1 + 8);
+    return acc;
+}
+
+static parec_xxh3_hash _parec_xxh3_mix_final(parec_xxh3_hash acc, size_t len)
+{
+    parec_xxh3_hash h;
+
+    h.low = _parec_xxh3_avalanche(acc.low + acc.high);
+    h.high = 0 - _parec_xxh3_avalanche(acc.low * PRIME64_1 + acc.high * PRIME64_4 + len * PRIME64_2);
+    return h;
+}
+
+static parec_xxh3_hash _parec_xxh3_len_17to128(const uint8_t *input, size_t len)
+{
+    parec_xxh3_hash acc = { len * PRIME64_1, 0 };
+
+    if (len > 32) {
+        if (len > 64) {
+            if (len > 96)
+                acc = _parec_xxh3_mix32(acc, input + 48, input + len - 64, SECRET + 96, 0);
+            acc = _parec_xxh3_mix32(acc, input + 32, input + len - 48, SECRET + 64, 0);
+        }
+        acc = _parec_xxh3_mix32(acc, input + 16, input + len - 32, SECRET + 32, 0);
+    }
+    acc = _parec_xxh3_mix32(acc, input, input + len - 16, SECRET, 0);
+
+    return _parec_xxh3_mix_final(acc, len);
+}
+
+static parec_xxh3_hash _parec_xxh3_len_129to240(const uint8_t *input, size_t len)
+{
+    parec_xxh3_hash acc = { len * PRIME64_1, 0 };
+    size_t i;
+
+    for (i = 32; i < 160; i += 32) {
+        acc = _parec_xxh3_mix32(acc, input + i - 32, input + i - 16, SECRET + i - 32, 0);
+    }
+    acc.low = _parec_xxh3_avalanche(acc.low);
+    acc.high = _parec_xxh3_avalanche(acc.high);
+    // the last 32 bytes are repeated, if the length is a multiple of 32
+    for (i = 160; i <= len; i += 32) {
+        acc = _parec_xxh3_mix32(acc, input + i - 32, input + i - 16, SECRET + MIDSIZE_STARTOFFSET + i - 160, 0);
+    }
+    acc = _parec_xxh3_mix32(acc, input + len - 16, input + len - 32, SECRET + SECRET_SIZE_MIN - MIDSIZE_LASTOFFSET - 16, 0);
+
+    return _parec_xxh3_mix_final(acc, len);
+}
+
+static parec_xxh3_hash _parec_xxh3_short(const uint8_t *input, size_t len)
+{
+    if (len > 128)
+        return _parec_xxh3_len_129to240(input, len);
+    if (len > 16)
+        return _parec_xxh3_len_17to128(input, len);
+    if (len > 8)
+        return _parec_xxh3_len_9to16(input, len);
+    if (len >= 4)
+        return _parec_xxh3_len_4to8(input, len);
+    if (len)
+        return _parec_xxh3_len_1to3(input, len);
+    return _parec_xxh3_len_0();
+}
+
+/* Long inputs */
+
+static void _parec_xxh3_accumulate_portable(uint64_t acc[8], const uint8_t *input, const uint8_t *secret, size_t stripes)
+{
+    uint64_t data, key;
+
+    for (size_t n = 0; n < stripes; n++) {
+        for (int i = 0; i < 8; i++) {
+            data = _parec_xxh3_read64(input + n * STRIPE_LEN + i * 8);
+            key = data ^ _parec_xxh3_read64(secret + n * CONSUME_RATE + i * 8);
+            acc[i ^ 1] += data;
+            acc[i] += (key & 0xFFFFFFFF) * (key >> 32);
+        }
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+
+#include <immintrin.h>
+
+/* A kernel holds the 8 lanes in the vectors of its target, and only the
+ * multiplication of the low halves of the lanes needs an intrinsic. The
+ * stripes and the secret are read in the little endian byte order of
+ * the host. */
+#define PAREC_XXH3_KERNEL(name, isa, bytes, mul) \
+__attribute__((target(isa))) \
+static void name(uint64_t acc[8], const uint8_t *input, const uint8_t *secret, size_t stripes) \
+{ \
+    typedef uint64_t vec __attribute__((vector_size(bytes))); \
+    typedef long long ivec __attribute__((vector_size(bytes))); \
+    enum { LANES = bytes / 8, VECS = 64 / bytes }; \
+    vec a[VECS], data, key, swapped; \
+\
+    memcpy(a, acc, sizeof(a)); \
+    for (size_t n = 0; n < stripes; n++) { \
+        for (int v = 0; v < VECS; v++) { \
+            memcpy(&data, input + n * STRIPE_LEN + v * bytes, sizeof(data)); \
+            memcpy(&key, secret + n * CONSUME_RATE + v * bytes, sizeof(key)); \
+            key ^= data; \
+            for (int i = 0; i < LANES; i++) { \
+                swapped[i] = data[i ^ 1]; \
+            } \
+            a[v] += swapped + (vec)mul((ivec)key, (ivec)(key >> 32)); \
+        } \
+    } \
+    memcpy(acc, a, sizeof(a)); \
+}
+
+PAREC_XXH3_KERNEL(_parec_xxh3_sse2, "sse2", 16, _mm_mul_epu32)
+PAREC_XXH3_KERNEL(_parec_xxh3_avx2, "avx2", 32, _mm256_mul_epu32)
+PAREC_XXH3_KERNEL(_parec_xxh3_avx512, "avx512f", 64, _mm512_mul_epu32)
+
+static void _parec_xxh3_detect(void)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        kernel = (parec_xxh3_kernel_t){ "avx512", _parec_xxh3_avx512 };
+    else if (__builtin_cpu_supports("avx2"))
+        kernel = (parec_xxh3_kernel_t){ "avx2", _parec_xxh3_avx2 };
+    else if (__builtin_cpu_supports("sse2"))
+        kernel = (parec_xxh3_kernel_t){ "sse2", _parec_xxh3_sse2 };
+    else
+        kernel = (parec_xxh3_kernel_t){ "portable", _parec_xxh3_accumulate_portable };
+}
+
+#else
+
+static void _parec_xxh3_detect(void)
+{
+    kernel = (parec_xxh3_kernel_t){ "portable", _parec_xxh3_accumulate_portable };
+}
+
+#endif
+
+const char *parec_xxh3_kernel(void)
+{
+    pthread_once(&kernel_once, _parec_xxh3_detect);
+    return kernel.name;
+}
+
+static void _parec_xxh3_scramble(uint64_t acc[8])
+{
+    for (int i = 0; i < 8; i++) {
+        acc[i] ^= acc[i] >> 47;
+        acc[i] ^= _parec_xxh3_read64(SECRET + SECRET_LIMIT + i * 8);
+        acc[i] *= PRIME32_1;
+    }
+}
+
+// accumulating whole stripes, the secret restarts at each block
+static const uint8_t *_parec_xxh3_stripes(uint64_t acc[8], size_t *stripes_so_far, const uint8_t *input, size_t stripes)
+{
+    size_t n;
+
+    while (stripes) {
+        n = STRIPES_PER_BLOCK - *stripes_so_far;
+        if (n > stripes)
+            n = stripes;
+        kernel.accumulate(acc, input, SECRET + *stripes_so_far * CONSUME_RATE, n);
+        input += n * STRIPE_LEN;
+        stripes -= n;
+        *stripes_so_far += n;
+        if (*stripes_so_far == STRIPES_PER_BLOCK) {
+            _parec_xxh3_scramble(acc);
+            *stripes_so_far = 0;
+        }
+    }
+    return input;
+}
+
+static uint64_t _parec_xxh3_merge(const uint64_t acc[8], const uint8_t *secret, uint64_t start)
+{
+    uint64_t result = start;
+
+    for (int i = 0; i < 4; i++) {
+        result += _parec_xxh3_mult128_fold(acc[2 * i] ^ _parec_xxh3_read64(secret + 16 * i),
+                                           acc[2 * i + 1] ^ _parec_xxh3_read64(secret + 16 * i + 8));
+    }
+    return _parec_xxh3_avalanche(result);
+}
+
+/* Hashers */
+
+parec_xxh3 *parec_xxh3_new(void)
+{
+    parec_xxh3 *self;
+
+    pthread_once(&kernel_once, _parec_xxh3_detect);
+    if (!(self = malloc(sizeof(*self))))
+        return NULL;
+    parec_xxh3_init(self);
+
+    return self;
+}
+
+void parec_xxh3_free(parec_xxh3 *self)
+{
+    free(self);
+}
+
+void parec_xxh3_init(parec_xxh3 *self)
+{
+    self->acc[0] = PRIME32_3;
+    self->acc[1] = PRIME64_1;
+    self->acc[2] = PRIME64_2;
+    self->acc[3] = PRIME64_3;
+    self->acc[4] = PRIME64_4;
+    self->acc[5] = PRIME32_2;
+    self->acc[6] = PRIME64_5;
+    self->acc[7] = PRIME32_1;
+    self->buffered = 0;
+    self->stripes = 0;
+    self->len = 0;
+}
+
+void parec_xxh3_update(parec_xxh3 *self, const void *data, size_t len)
+{
+    const uint8_t *input = data, *end = input + len;
+    size_t take;
+
+    self->len += len;
+
+    if (len <= BUFFER_LEN - self->buffered) {
+        memcpy(self->buffer + self->buffered, input, len);
+        self->buffered += len;
+        return;
+    }
+
+    // the buffer is full and more input is coming
+    if (self->buffered) {
+        take = BUFFER_LEN - self->buffered;
+        memcpy(self->buffer + self->buffered, input, take);
+        input += take;
+        _parec_xxh3_stripes(self->acc, &self->stripes, self->buffer, BUFFER_LEN / STRIPE_LEN);
+        self->buffered = 0;
+    }
+
+    // the stripes of the input itself, but keeping its last one, which
+    // is also kept at the end of the buffer for the last stripe
+    if (end - input > BUFFER_LEN) {
+        input = _parec_xxh3_stripes(self->acc, &self->stripes, input, (size_t)(end - 1 - input) / STRIPE_LEN);
+        memcpy(self->buffer + BUFFER_LEN - STRIPE_LEN, input - STRIPE_LEN, STRIPE_LEN);
+    }
+
+    memcpy(self->buffer, input, end - input);
+    self->buffered = end - input;
+}
+
+void parec_xxh3_final(const parec_xxh3 *self, unsigned char *digest)
+{
+    uint64_t acc[8];
+    uint8_t last[STRIPE_LEN];
+    const uint8_t *p;
+    size_t stripes;
+    parec_xxh3_hash h;
+
+    if (self->len <= MIDSIZE_MAX) {
+        h = _parec_xxh3_short(self->buffer, self->len);
+    }
+    else {
+        // on a copy of the accumulators, so the input may be continued
+        memcpy(acc, self->acc, sizeof(acc));
+        if (self->buffered >= STRIPE_LEN) {
+            stripes = self->stripes;
+            _parec_xxh3_stripes(acc, &stripes, self->buffer, (self->buffered - 1) / STRIPE_LEN);
+            p = self->buffer + self->buffered - STRIPE_LEN;
+        }
+        else {
+            // the last stripe continues the end of the previous buffer
+            memcpy(last, self->buffer + BUFFER_LEN - (STRIPE_LEN - self->buffered), STRIPE_LEN - self->buffered);
+            memcpy(last + STRIPE_LEN - self->buffered, self->buffer, self->buffered);
+            p = last;
+        }
+        kernel.accumulate(acc, p, SECRET + SECRET_LIMIT - LASTACC_START, 1);
+
+        h.low = _parec_xxh3_merge(acc, SECRET + MERGEACCS_START, self->len * PRIME64_1);
+        h.high = _parec_xxh3_merge(acc, SECRET + SECRET_LEN - sizeof(acc) - MERGEACCS_START, ~(self->len * PRIME64_2));
+    }
+
+    _parec_xxh3_write64be(digest, h.high);
+    _parec_xxh3_write64be(digest + 8, h.low);
+}
@@ -0,0 +1,77 @@
+/**
+ * parec_xxh3 -- 128 bit XXH3 hash function
+ *
+ * Copyright (c) Akos FROHNER <akos@frohner.hu> 2009.
+ * License: LGPLv2.1
+ */
+
+#ifndef _PAREC_XXH3_H
+#define _PAREC_XXH3_H
+
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * XXH3 is a non-cryptographic hash function, which detects accidental
+ * changes, but not deliberate ones. The 128 bit variant without a seed
+ * is implemented, and its digest is the canonical form of 'xxh128sum':
+ * the high and the low 64 bits in big endian order.
+ *
+ * The stripes of the input are accumulated by the widest SIMD kernel of
+ * the processor (SSE2, AVX2 or AVX-512), which is selected at runtime.
+ */
+
+/** Length of the digest in bytes. */
+#define PAREC_XXH3_LEN 16
+
+/* Opaque data structure of the hasher. */
+typedef struct _parec_xxh3 parec_xxh3;
+
+/**
+ * Allocates a new hasher, which is initialized.
+ * @return      The hasher or NULL if memory allocation has failed.
+ */
+parec_xxh3 *parec_xxh3_new(void);
+
+/**
+ * Free the hasher.
+ * @param self  The hasher to be disposed.
+ */
+void parec_xxh3_free(parec_xxh3 *self);
+
+/**
+ * Initializes the hasher for a new input.
+ * @param self  The hasher.
+ */
+void parec_xxh3_init(parec_xxh3 *self);
+
+/**
+ * Adds the next part of the input.
+ * @param self  The hasher.
+ * @param input The data.
+ * @param len   The length of the data.
+ */
+void parec_xxh3_update(parec_xxh3 *self, const void *input, size_t len);
+
+/**
+ * Calculates the digest of the input. The hasher is not modified,
+ * so the input may be continued.
+ * @param self  The hasher.
+ * @param digest The buffer of PAREC_XXH3_LEN bytes for the digest.
+ */
+void parec_xxh3_final(const parec_xxh3 *self, unsigned char *digest);
+
+/**
+ * Get the name of the SIMD kernel used for the stripes.
+ * @return "avx512", "avx2", "sse2" or "portable".
+ */
+const char *parec_xxh3_kernel(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PAREC_XXH3_H */
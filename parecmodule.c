@@ -14,11 +14,19 @@ static PyObject *ParecError;
 typedef struct {
     PyObject_HEAD
     parec_ctx* ctx;
+    PyObject *event;            // the callable of the events or NULL
+    PyObject *event_type;       // the exception raised by the callable
+    PyObject *event_value;
+    PyObject *event_traceback;
 } Parec;
 
 static void Parec_dealloc(Parec *self)
 {
     parec_free(self->ctx);
+    Py_XDECREF(self->event);
+    Py_XDECREF(self->event_type);
+    Py_XDECREF(self->event_value);
+    Py_XDECREF(self->event_traceback);
     self->ob_type->tp_free((PyObject*)self);
 }
 
@@ -38,16 +46,44 @@ static PyObject *Parec_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     return (PyObject *)self;
 }
 
+static int Parec_init(Parec *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"threads", NULL};
+    int threads = 1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", kwlist, &threads)) {
+        // error already set
+        return -1;
+    }
+    if (parec_set_threads(self->ctx, threads)) {
+        PyErr_SetString(ParecError, parec_get_error(self->ctx));
+        return -1;
+    }
+
+    return 0;
+}
+
 
 static PyObject *Parec_process(Parec *self, PyObject *args)
 {
     const char *name;
+    int rc;
 
     if (!PyArg_ParseTuple(args, "s", &name)) {
         // error already set
         return NULL;
     }
-    if (parec_process(self->ctx, name)) {
+    // the worker threads need the GIL for the events
+    Py_BEGIN_ALLOW_THREADS
+    rc = parec_process(self->ctx, name);
+    Py_END_ALLOW_THREADS
+    // the exception of the callable has stopped the processing
+    if (self->event_type) {
+        PyErr_Restore(self->event_type, self->event_value, self->event_traceback);
+        self->event_type = self->event_value = self->event_traceback = NULL;
+        return NULL;
+    }
+    if (rc) {
         PyErr_SetString(ParecError, parec_get_error(self->ctx));
         return NULL;
     }
@@ -55,6 +91,61 @@ static PyObject *Parec_process(Parec *self, PyObject *args)
     Py_RETURN_NONE;
 }
 
+// calling the callable of the events, which may be called by the worker
+// threads as well; an exception stops the processing
+static int Parec_event(const parec_event *event, void *arg)
+{
+    static const char *types[] = { "start", "file", "skip", "directory", "error" };
+    Parec *self = arg;
+    PyGILState_STATE gil;
+    PyObject *result;
+    int rc = 0;
+
+    gil = PyGILState_Ensure();
+    // the error caused by the exception is not reported
+    if (self->event_type) {
+        PyGILState_Release(gil);
+        return -1;
+    }
+    result = PyObject_CallFunction(self->event, "ssLdz", types[event->type], event->name, event->size, event->seconds, event->error);
+    if (result) {
+        Py_DECREF(result);
+    }
+    else {
+        PyErr_Fetch(&self->event_type, &self->event_value, &self->event_traceback);
+        rc = -1;
+    }
+    PyGILState_Release(gil);
+
+    return rc;
+}
+
+static PyObject *Parec_set_event_callback(Parec *self, PyObject *args)
+{
+    PyObject *callback;
+
+    if (!PyArg_ParseTuple(args, "O", &callback)) {
+        // error already set
+        return NULL;
+    }
+    if (callback != Py_None && !PyCallable_Check(callback)) {
+        PyErr_SetString(PyExc_TypeError, "the callback must be callable");
+        return NULL;
+    }
+    if (parec_set_event_callback(self->ctx, callback != Py_None ? Parec_event : NULL, self)) {
+        PyErr_SetString(ParecError, parec_get_error(self->ctx));
+        return NULL;
+    }
+    Py_XDECREF(self->event);
+    self->event = NULL;
+    if (callback != Py_None) {
+        Py_INCREF(callback);
+        self->event = callback;
+    }
+
+    Py_RETURN_NONE;
+}
+
 static PyObject *Parec_purge(Parec *self, PyObject *args)
 {
     const char *name;
@@ -261,6 +352,75 @@ static PyObject *Parec_get_xattr_values(Parec *self, PyObject *args)
     return xattr_values;
 }
 
+static PyObject *Parec_set_profile(Parec *self, PyObject *args)
+{
+    int enabled;
+
+    if (!PyArg_ParseTuple(args, "i", &enabled)) {
+        // error already set
+        return NULL;
+    }
+    if (parec_set_profile(self->ctx, enabled)) {
+        PyErr_SetString(ParecError, parec_get_error(self->ctx));
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *Parec_get_stats(Parec *self)
+{
+    static const char *phases[PAREC_PHASES] = { "open", "directory", "storage", "read", "digest", "sort" };
+    parec_stats *stats;
+    PyObject *result = NULL, *phase = NULL, *bytes = NULL, *latency = NULL, *value;
+    int i;
+
+    if (!(stats = parec_get_stats(self->ctx))) {
+        PyErr_SetString(ParecError, parec_get_error(self->ctx));
+        return NULL;
+    }
+
+    if (!(phase = PyDict_New()) || !(bytes = PyDict_New()) || !(latency = PyList_New(PAREC_STATS_BUCKETS)))
+        goto error;
+    for (i = 0; i < PAREC_PHASES; i++) {
+        // (calls, wall-clock seconds, CPU seconds) of each phase
+        if (!(value = Py_BuildValue("(Kdd)", stats->calls[i], stats->wall_ns[i] / 1e9, stats->cpu_ns[i] / 1e9)))
+            goto error;
+        if (PyDict_SetItemString(phase, phases[i], value)) {
+            Py_DECREF(value);
+            goto error;
+        }
+        Py_DECREF(value);
+    }
+    for (i = 0; i < stats->algorithms; i++) {
+        if (!(value = PyLong_FromUnsignedLongLong(stats->bytes[i])))
+            goto error;
+        if (PyDict_SetItemString(bytes, parec_get_checksum_name(self->ctx, i), value)) {
+            Py_DECREF(value);
+            goto error;
+        }
+        Py_DECREF(value);
+    }
+    for (i = 0; i < PAREC_STATS_BUCKETS; i++) {
+        if (!(value = PyLong_FromUnsignedLongLong(stats->latency[i])))
+            goto error;
+        PyList_SET_ITEM(latency, i, value);
+    }
+
+    result = Py_BuildValue("{sOsOsOsKsKsKsKsKsK}", "phases", phase, "bytes", bytes, "latency", latency,
+                           "xattr_get", stats->xattr_get, "xattr_set", stats->xattr_set, "xattr_remove", stats->xattr_remove,
+                           "files_hashed", stats->files_hashed, "entries_skipped", stats->entries_skipped,
+                           "directories_hashed", stats->directories_hashed);
+
+error:
+    Py_XDECREF(phase);
+    Py_XDECREF(bytes);
+    Py_XDECREF(latency);
+    free(stats);
+
+    return result;
+}
+
 static PyMethodDef Parec_methods[] = {
     {"process", (PyCFunction)Parec_process, METH_VARARGS, 
       "Process a file or directory." },
@@ -280,6 +440,14 @@ static PyMethodDef Parec_methods[] = {
      "Set the calculation method." },
     {"get_xattr_values", (PyCFunction)Parec_get_xattr_values, METH_VARARGS, 
       "Get the extended attributes associated with a file or directory." },
+    {"set_event_callback", (PyCFunction)Parec_set_event_callback, METH_VARARGS, 
+      "Set the callable of the events of the processing, called with the event\n"
+      "('start', 'file', 'skip', 'directory' or 'error'), the name, the size,\n"
+      "the seconds and the error message of each event, or None." },
+    {"set_profile", (PyCFunction)Parec_set_profile, METH_VARARGS, 
+      "Enable the profiling with zero counters, or disable it." },
+    {"get_stats", (PyCFunction)Parec_get_stats, METH_NOARGS, 
+      "Returns the statistics of the profiling in a dictionary." },
     {NULL, NULL, 0, NULL}
 };
 
@@ -320,7 +488,7 @@ static PyTypeObject ParecType = {
     0,                         /* tp_descr_get */
     0,                         /* tp_descr_set */
     0,                         /* tp_dictoffset */
-    0,                         /* tp_init */
+    (initproc)Parec_init,      /* tp_init */
     0,                         /* tp_alloc */
     Parec_new,                 /* tp_new */
 };
@@ -337,6 +505,9 @@ initparec(void)
     if (PyType_Ready(&ParecType) < 0)
         return;
 
+    // the events are called by the worker threads
+    PyEval_InitThreads();
+
     m = Py_InitModule3("parec", parec_methods, "Parallel Recursive Checkums");
     if (NULL == m) return;
 